@@ -21,3 +21,7 @@ Motion::Project::App.setup do |app|
     main_activity['android:theme'] = '@android:style/Theme.NoTitleBar.Fullscreen'
   end
 end
+
+require File.join(File.dirname(__FILE__), 'assets.rb')
+MotionGame::Assets.texture_formats = [:etc1]
+MotionGame::Assets.pack_before('build:emulator', 'build:device')
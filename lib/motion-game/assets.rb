@@ -0,0 +1,240 @@
+# Texture atlas packing.
+#
+# Every directory under `assets/atlases' is packed by `rake assets:pack' into
+# a texture atlas, written in the `resources' directory as a PNG image and a
+# spritesheet property list named after the directory. Frames keep the name
+# of their image file, relative to the atlas directory. The frames are listed
+# in `resources/atlas_index.plist', which lets MG::Sprite.new('bird_one.png')
+# find the frame in its atlas without loading the spritesheet first.
+#
+# Options can be passed to the native packer (see packer/packer.cpp) from the
+# project Rakefile:
+#
+#   MotionGame::Assets.packer_options = '--max-size 4096 --no-rotate'
+#
+# `rake assets:compress' then creates GPU compressed variants of the images
+# of the `resources' directory, next to the PNG files: `x.pvr' (PVRTC 4bpp,
+# made with PVRTexToolCLI) for square power of two images, and `x.pkm' (ETC1,
+# made with etc1tool from the Android SDK) for opaque images. At runtime,
+# MG::Sprite.new('x.png') loads the variant supported by the device, or the
+# PNG file. Each platform selects its formats, iOS and tvOS use PVRTC and
+# Android uses ETC1; atlases are packed into square textures when PVRTC is
+# selected. Formats whose tool cannot be found are skipped.
+#
+# `rake assets:timelines' compiles the JSON timelines of `assets/timelines'
+# into the binary format loaded by MG::Timeline.load, `assets/timelines/x.json'
+# becoming `resources/x.tl' (see src/timeline.cpp for both formats).
+
+require 'rake'
+require 'json'
+
+module MotionGame
+  module Assets
+    extend Rake::FileUtilsExt
+
+    ATLASES_DIR = 'assets/atlases'
+    OUTPUT_DIR = 'resources'
+    INDEX_FILE = 'atlas_index.plist'
+    BUILD_DIR = 'build/assets'
+    PACKER_DIR = File.join(File.dirname(__FILE__), 'packer')
+    TOOLS = { :pvrtc => 'PVRTexToolCLI', :etc1 => 'etc1tool' }
+    TIMELINES_DIR = 'assets/timelines'
+
+    # The MC_PROPERTY_* values of each timeline property, and the easing
+    # families in the order of src/tween.cpp.
+    TIMELINE_PROPERTIES = {
+      'x' => [0], 'y' => [1], 'position' => [0, 1], 'alpha' => [2],
+      'rotation' => [3], 'scale' => [4, 5], 'scale_x' => [4], 'scale_y' => [5],
+      'skew_x' => [6], 'skew_y' => [7], 'color' => [8, 9, 10]
+    }
+    EASE_FAMILIES = %w{linear sine quad cubic quart quint expo circ back elastic bounce}
+    EASE_MODES = { 'in' => 1, 'out' => 2, 'in_out' => 3 }
+
+    @texture_formats = []
+    @compress_exclude = ['Default*.png', 'Icon*.png']
+
+    class << self
+      attr_accessor :packer_options, :texture_formats, :compress_exclude
+
+      # Compiles the native packer with the host compiler, if needed.
+      def packer
+        bin = File.join(BUILD_DIR, 'mg-packer')
+        sources = Dir.glob(File.join(PACKER_DIR, '*.{cpp,h}'))
+        if !File.exist?(bin) or sources.any? { |x| File.mtime(x) > File.mtime(bin) }
+          mkdir_p BUILD_DIR
+          cxx = ENV['CXX'] || 'c++'
+          cpp_files = sources.select { |x| x.end_with?('.cpp') }.map { |x| "\"#{x}\"" }.join(' ')
+          sh "#{cxx} -O2 -std=c++11 -o \"#{bin}\" #{cpp_files} -lz"
+        end
+        bin
+      end
+
+      def pack
+        atlases = Dir.glob(File.join(ATLASES_DIR, '*')).select { |x| File.directory?(x) }.sort
+        return if atlases.empty?
+
+        index = {}
+        atlases.each do |dir|
+          name = File.basename(dir)
+          listing = File.join(BUILD_DIR, "#{name}.txt")
+          options_file = File.join(BUILD_DIR, "#{name}.options")
+          options = packer_options.to_s
+          options += ' --square' if texture_formats.include?(:pvrtc)
+          outputs = Dir.glob(File.join(OUTPUT_DIR, "#{name}{,-[0-9]*}.{png,plist,pvr,pkm}"))
+          inputs = [dir] + Dir.glob(File.join(dir, '**', '*')) + [packer]
+          if outputs.empty? or !File.exist?(listing) or inputs.map { |x| File.mtime(x) }.max > File.mtime(listing) or !File.exist?(options_file) or File.read(options_file) != options
+            rm_f outputs unless outputs.empty?
+            mkdir_p OUTPUT_DIR
+            frames = `"#{packer}" #{options} "#{name}" "#{OUTPUT_DIR}" "#{dir}"`
+            raise "Failed to pack texture atlas `#{name}'" unless $?.success?
+            File.write(listing, frames)
+            File.write(options_file, options)
+            puts "     Pack #{dir}"
+          end
+          File.read(listing).each_line do |line|
+            frame, plist = line.chomp.split("\t")
+            if index[frame]
+              raise "Frame `#{frame}' is defined in both #{index[frame]} and #{plist}"
+            end
+            index[frame] = plist
+          end
+        end
+        write_index(index)
+      end
+
+      def compress
+        formats = texture_formats.select do |format|
+          tool(format) or (puts("     Skip #{format} textures, #{TOOLS[format]} not found"); false)
+        end
+        return if formats.empty?
+
+        Dir.glob(File.join(OUTPUT_DIR, '*.png')).sort.each do |png|
+          next if compress_exclude.any? { |x| File.fnmatch(x, File.basename(png)) }
+          width = height = opaque = nil
+          formats.each do |format|
+            variant = png.sub(/\.png\z/, format == :pvrtc ? '.pvr' : '.pkm')
+            next if File.exist?(variant) and File.mtime(variant) >= File.mtime(png)
+            if width.nil?
+              info = `"#{packer}" --info "#{png}"`.split
+              raise "Failed to read `#{png}'" unless $?.success?
+              width, height, opaque = info[0].to_i, info[1].to_i, info[2] == 'opaque'
+            end
+            case format
+              when :pvrtc
+                # iOS only accepts square, power of two PVRTC textures.
+                next unless width == height and (width & (width - 1)) == 0
+                sh "\"#{tool(format)}\" -i \"#{png}\" -o \"#{variant}\" -f PVRTC1_4 -q pvrtcbest -p"
+              when :etc1
+                # ETC1 has no alpha channel.
+                next unless opaque
+                sh "\"#{tool(format)}\" \"#{png}\" --encode -o \"#{variant}\""
+            end
+          end
+        end
+      end
+
+      def timelines
+        Dir.glob(File.join(TIMELINES_DIR, '**', '*.json')).sort.each do |json|
+          output = File.join(OUTPUT_DIR, json[TIMELINES_DIR.size + 1..-1].sub(/\.json\z/, '.tl'))
+          next if File.exist?(output) and File.mtime(output) >= File.mtime(json)
+          data = begin
+            compile_timeline(JSON.parse(File.read(json)))
+          rescue JSON::ParserError, ArgumentError, TypeError => e
+            raise "Failed to compile timeline `#{json}': #{e.message}"
+          end
+          mkdir_p File.dirname(output)
+          File.open(output, 'wb') { |io| io.write(data) }
+          puts "     Compile #{json}"
+        end
+      end
+
+      # Makes the given tasks pack the atlases, create the compressed
+      # textures and compile the timelines first, when they exist.
+      def pack_before(*tasks)
+        tasks.each do |task|
+          Rake::Task[task].enhance(['assets:compress', 'assets:timelines']) if Rake::Task.task_defined?(task)
+        end
+      end
+
+      private
+
+      def tool(format)
+        name = TOOLS[format]
+        candidates = [ENV[name.upcase]]
+        candidates << File.join(ENV['ANDROID_HOME'], 'tools', name) if ENV['ANDROID_HOME']
+        candidates += ENV['PATH'].to_s.split(File::PATH_SEPARATOR).map { |x| File.join(x, name) }
+        candidates.compact.find { |x| File.executable?(x) and !File.directory?(x) }
+      end
+
+      def compile_timeline(timeline)
+        tracks = []
+        end_time = 0
+        (timeline['tracks'] || {}).each do |path, properties|
+          properties.each do |name, keys|
+            ids = TIMELINE_PROPERTIES[name] or raise ArgumentError, "unknown property `#{name}' for node `#{path}'"
+            keys = keys.map do |time, value, ease|
+              values = value.is_a?(Array) ? value : [value] * ids.size
+              raise ArgumentError, "expected #{ids.size} values for `#{name}' of node `#{path}'" if values.size != ids.size
+              end_time = [end_time, time].max
+              [Float(time), values.map { |x| Float(x) }, ease_value(ease)]
+            end.sort_by { |x| x[0] }
+            ids.each_with_index do |id, i|
+              tracks << [path, id, keys.map { |time, values, ease| [time, values[i], ease] }]
+            end
+          end
+        end
+        events = (timeline['events'] || []).map { |time, name| [Float(time), name.to_s] }.sort_by { |x| x[0] }
+        end_time = [end_time, *events.map { |x| x[0] }].max
+        str = lambda { |x| [x.bytesize].pack('V') + x.b }
+
+        data = 'MGTL' + [1, Float(timeline['duration'] || end_time), tracks.size].pack('VeV')
+        tracks.each do |path, id, keys|
+          data << str.call(path) << [id, keys.size].pack('CV')
+          keys.each { |time, value, ease| data << [time, value, ease].pack('eeC') }
+        end
+        data << [events.size].pack('V')
+        events.each { |time, name| data << [time].pack('e') << str.call(name) }
+        data
+      end
+
+      def ease_value(ease)
+        return 0 if ease.nil? or ease == 'linear'
+        if md = ease.to_s.match(/\A(in_out|in|out)_(\w+)\z/) and family = EASE_FAMILIES.index(md[2]) and family > 0
+          family * 4 + EASE_MODES[md[1]]
+        else
+          raise ArgumentError, "invalid easing curve `#{ease}'"
+        end
+      end
+
+      def write_index(index)
+        escape = lambda { |x| x.gsub('&', '&amp;').gsub('<', '&lt;').gsub('>', '&gt;') }
+        plist = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        plist << "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+        plist << "<plist version=\"1.0\">\n<dict>\n"
+        index.keys.sort.each do |frame|
+          plist << "\t<key>#{escape.call(frame)}</key>\n\t<string>#{escape.call(index[frame])}</string>\n"
+        end
+        plist << "</dict>\n</plist>\n"
+        path = File.join(OUTPUT_DIR, INDEX_FILE)
+        File.write(path, plist) unless File.exist?(path) and File.read(path) == plist
+      end
+    end
+  end
+end
+
+namespace 'assets' do
+  desc "Pack the images of #{MotionGame::Assets::ATLASES_DIR}/* into texture atlases"
+  task 'pack' do
+    MotionGame::Assets.pack
+  end
+
+  desc "Create compressed variants of the #{MotionGame::Assets::OUTPUT_DIR}/*.png textures"
+  task 'compress' => 'pack' do
+    MotionGame::Assets.compress
+  end
+
+  desc "Compile the #{MotionGame::Assets::TIMELINES_DIR}/*.json timelines"
+  task 'timelines' do
+    MotionGame::Assets.timelines
+  end
+end
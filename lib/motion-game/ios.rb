@@ -13,3 +13,7 @@ Motion::Project::App.setup do |app|
 
   app.info_plist['UISupportedInterfaceOrientations'] = ['UIInterfaceOrientationLandscapeRight', 'UIInterfaceOrientationLandscapeLeft']
 end
+
+require File.join(File.dirname(__FILE__), 'assets.rb')
+MotionGame::Assets.texture_formats = [:pvrtc]
+MotionGame::Assets.pack_before('build:simulator', 'build:device')
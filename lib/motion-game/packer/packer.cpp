@@ -0,0 +1,557 @@
+// mg-packer: packs PNG images into texture atlases readable by cocos2d-x
+// SpriteFrameCache (property list format 2).
+//
+//   mg-packer [options] <atlas-name> <output-dir> <input-dir>
+//
+// Every PNG file under <input-dir> becomes a frame named after its path
+// relative to <input-dir>, for example `bird_one.png' or `enemies/bat.png'.
+// The atlas is written as <atlas-name>.png and <atlas-name>.plist in
+// <output-dir>, or <atlas-name>-1.png, <atlas-name>-2.png, ... when the
+// frames do not fit in a single texture. For every frame, a line with the
+// frame name and the name of its property list file, separated by a tab, is
+// printed on the standard output.
+//
+// Options:
+//   --max-size N   maximum width and height of a texture (default 2048)
+//   --padding N    transparent pixels between frames (default 2)
+//   --extrude N    pixels to repeat around the edges of frames (default 1)
+//   --no-trim      keep the transparent borders of images
+//   --no-rotate    never rotate frames
+
+#include "png.h"
+#include <algorithm>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+struct mg_Rect {
+    int x, y, width, height;
+
+    mg_Rect() : x(0), y(0), width(0), height(0) {}
+    mg_Rect(int _x, int _y, int _w, int _h)
+	: x(_x), y(_y), width(_w), height(_h) {}
+
+    bool contains(const mg_Rect &r) const {
+	return r.x >= x && r.y >= y && r.x + r.width <= x + width
+	    && r.y + r.height <= y + height;
+    }
+
+    bool intersects(const mg_Rect &r) const {
+	return r.x < x + width && r.x + r.width > x && r.y < y + height
+	    && r.y + r.height > y;
+    }
+};
+
+struct mg_Frame {
+    std::string name;
+    mg_Image image;
+    mg_Rect trim;	// Opaque area of the image, in image coordinates.
+    mg_Rect slot;	// Packed area in the atlas, padding included.
+    bool rotated;
+    bool packed;
+};
+
+struct mg_Options {
+    int max_size;
+    int padding;
+    int extrude;
+    bool trim;
+    bool rotate;
+    bool square;
+};
+
+// MaxRects bin packing, choosing for every rectangle the free area which
+// leaves the shortest side (Best Short Side Fit).
+class mg_MaxRects {
+    public:
+	std::vector<mg_Rect> free_rects;
+
+    mg_MaxRects(int width, int height) {
+	free_rects.push_back(mg_Rect(0, 0, width, height));
+    }
+
+    bool insert(int width, int height, bool allow_rotate, mg_Rect &result,
+	    bool &rotated) {
+	int best_short = -1, best_long = -1;
+	for (auto &free : free_rects) {
+	    for (int pass = 0; pass < (allow_rotate ? 2 : 1); pass++) {
+		const int w = pass == 0 ? width : height;
+		const int h = pass == 0 ? height : width;
+		if (w > free.width || h > free.height) {
+		    continue;
+		}
+		const int dw = free.width - w, dh = free.height - h;
+		const int short_side = std::min(dw, dh);
+		const int long_side = std::max(dw, dh);
+		if (best_short < 0 || short_side < best_short
+			|| (short_side == best_short && long_side < best_long)) {
+		    best_short = short_side;
+		    best_long = long_side;
+		    result = mg_Rect(free.x, free.y, w, h);
+		    rotated = pass == 1;
+		}
+	    }
+	}
+	if (best_short < 0) {
+	    return false;
+	}
+	place(result);
+	return true;
+    }
+
+    private:
+
+    void place(const mg_Rect &used) {
+	std::vector<mg_Rect> split;
+	for (size_t i = 0; i < free_rects.size(); ) {
+	    const mg_Rect free = free_rects[i];
+	    if (!free.intersects(used)) {
+		i++;
+		continue;
+	    }
+	    if (used.x > free.x) {
+		split.push_back(mg_Rect(free.x, free.y, used.x - free.x,
+			    free.height));
+	    }
+	    if (used.x + used.width < free.x + free.width) {
+		split.push_back(mg_Rect(used.x + used.width, free.y,
+			    free.x + free.width - used.x - used.width,
+			    free.height));
+	    }
+	    if (used.y > free.y) {
+		split.push_back(mg_Rect(free.x, free.y, free.width,
+			    used.y - free.y));
+	    }
+	    if (used.y + used.height < free.y + free.height) {
+		split.push_back(mg_Rect(free.x, used.y + used.height,
+			    free.width,
+			    free.y + free.height - used.y - used.height));
+	    }
+	    free_rects[i] = free_rects.back();
+	    free_rects.pop_back();
+	}
+	free_rects.insert(free_rects.end(), split.begin(), split.end());
+
+	// Drop the free areas which are contained in another one.
+	for (size_t i = 0; i < free_rects.size(); i++) {
+	    for (size_t j = i + 1; j < free_rects.size(); ) {
+		if (free_rects[i].contains(free_rects[j])) {
+		    free_rects.erase(free_rects.begin() + j);
+		}
+		else if (free_rects[j].contains(free_rects[i])) {
+		    free_rects.erase(free_rects.begin() + i);
+		    j = i + 1;
+		}
+		else {
+		    j++;
+		}
+	    }
+	}
+    }
+};
+
+static void
+die(const std::string &message)
+{
+    fprintf(stderr, "mg-packer: %s\n", message.c_str());
+    exit(1);
+}
+
+static void
+collect_images(const std::string &root, const std::string &dir,
+	std::vector<std::string> &names)
+{
+    const std::string path = dir.empty() ? root : root + "/" + dir;
+    DIR *handle = opendir(path.c_str());
+    if (handle == NULL) {
+	die("can't open directory `" + path + "'");
+    }
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL) {
+	const std::string file = entry->d_name;
+	if (file[0] == '.') {
+	    continue;
+	}
+	const std::string name = dir.empty() ? file : dir + "/" + file;
+	struct stat st;
+	if (stat((root + "/" + name).c_str(), &st) != 0) {
+	    continue;
+	}
+	if (S_ISDIR(st.st_mode)) {
+	    collect_images(root, name, names);
+	}
+	else if (name.size() > 4
+		&& strcasecmp(name.c_str() + name.size() - 4, ".png") == 0) {
+	    names.push_back(name);
+	}
+    }
+    closedir(handle);
+}
+
+static mg_Rect
+opaque_area(const mg_Image &image)
+{
+    int min_x = image.width, min_y = image.height, max_x = -1, max_y = -1;
+    for (int y = 0; y < image.height; y++) {
+	for (int x = 0; x < image.width; x++) {
+	    if (image.at(x, y)[3] != 0) {
+		min_x = std::min(min_x, x);
+		max_x = std::max(max_x, x);
+		min_y = std::min(min_y, y);
+		max_y = std::max(max_y, y);
+	    }
+	}
+    }
+    if (max_x < 0) {
+	// Fully transparent, keep a single pixel.
+	return mg_Rect(0, 0, 1, 1);
+    }
+    return mg_Rect(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1);
+}
+
+// Packs as many of the given frames as possible into a texture of the given
+// size, returning the number of frames which fit, which are moved to the
+// beginning of the list. Frames must be sorted from the largest to the
+// smallest.
+static size_t
+pack(std::vector<mg_Frame *> &frames, int width, int height,
+	const mg_Options &options)
+{
+    mg_MaxRects bin(width, height);
+    const int border = options.extrude * 2 + options.padding;
+    size_t packed = 0;
+    for (auto frame : frames) {
+	mg_Rect slot;
+	bool rotated = false;
+	frame->packed = bin.insert(frame->trim.width + border,
+		frame->trim.height + border, options.rotate, slot, rotated);
+	if (frame->packed) {
+	    frame->slot = slot;
+	    frame->rotated = rotated;
+	    packed++;
+	}
+    }
+    // Keep the packed frames at the beginning of the list, in order.
+    std::stable_partition(frames.begin(), frames.end(),
+	    [](const mg_Frame *frame) { return frame->packed; });
+    return packed;
+}
+
+static void
+blit(mg_Image &atlas, const mg_Frame &frame, const mg_Options &options)
+{
+    const mg_Rect &trim = frame.trim;
+    const int e = options.extrude;
+    // Size of the frame in the atlas, rotated if needed.
+    const int w = frame.rotated ? trim.height : trim.width;
+    const int h = frame.rotated ? trim.width : trim.height;
+    for (int dy = -e; dy < h + e; dy++) {
+	for (int dx = -e; dx < w + e; dx++) {
+	    // Clamping the coordinates repeats the edges into the extrusion.
+	    const int x = std::min(std::max(dx, 0), w - 1);
+	    const int y = std::min(std::max(dy, 0), h - 1);
+	    // Rotated frames are turned 90 degrees clockwise, as expected by
+	    // cocos2d-x.
+	    const int sx = frame.rotated ? y : x;
+	    const int sy = frame.rotated ? trim.height - 1 - x : y;
+	    const uint8_t *src = frame.image.at(trim.x + sx, trim.y + sy);
+	    uint8_t *dst = atlas.at(frame.slot.x + e + dx,
+		    frame.slot.y + e + dy);
+	    memcpy(dst, src, 4);
+	}
+    }
+}
+
+static std::string
+format_rect(int x, int y, int w, int h)
+{
+    char buf[100];
+    snprintf(buf, sizeof buf, "{{%d,%d},{%d,%d}}", x, y, w, h);
+    return buf;
+}
+
+static std::string
+format_pair(double a, double b)
+{
+    char buf[100];
+    snprintf(buf, sizeof buf, "{%g,%g}", a, b);
+    return buf;
+}
+
+static std::string
+xml_escape(const std::string &str)
+{
+    std::string out;
+    for (char c : str) {
+	switch (c) {
+	  case '&': out += "&amp;"; break;
+	  case '<': out += "&lt;"; break;
+	  case '>': out += "&gt;"; break;
+	  default: out += c; break;
+	}
+    }
+    return out;
+}
+
+static void
+write_plist(const std::string &path, const std::string &texture_name,
+	int width, int height, const std::vector<mg_Frame *> &frames,
+	const mg_Options &options)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == NULL) {
+	die("can't open `" + path + "' for writing");
+    }
+    fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	    "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" "
+	    "\"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+	    "<plist version=\"1.0\">\n<dict>\n\t<key>frames</key>\n\t<dict>\n");
+    for (auto frame : frames) {
+	const mg_Rect &trim = frame->trim;
+	const int source_w = frame->image.width;
+	const int source_h = frame->image.height;
+	// Offset of the center of the opaque area from the center of the
+	// image, with the Y axis going up.
+	const double offset_x = trim.x + trim.width / 2.0 - source_w / 2.0;
+	const double offset_y = source_h / 2.0 - (trim.y + trim.height / 2.0);
+	fprintf(file, "\t\t<key>%s</key>\n\t\t<dict>\n",
+		xml_escape(frame->name).c_str());
+	fprintf(file, "\t\t\t<key>frame</key>\n\t\t\t<string>%s</string>\n",
+		format_rect(frame->slot.x + options.extrude,
+		    frame->slot.y + options.extrude, trim.width,
+		    trim.height).c_str());
+	fprintf(file, "\t\t\t<key>offset</key>\n\t\t\t<string>%s</string>\n",
+		format_pair(offset_x, offset_y).c_str());
+	fprintf(file, "\t\t\t<key>rotated</key>\n\t\t\t<%s/>\n",
+		frame->rotated ? "true" : "false");
+	fprintf(file, "\t\t\t<key>sourceColorRect</key>\n"
+		"\t\t\t<string>%s</string>\n",
+		format_rect(trim.x, trim.y, trim.width, trim.height).c_str());
+	fprintf(file, "\t\t\t<key>sourceSize</key>\n"
+		"\t\t\t<string>%s</string>\n",
+		format_pair(source_w, source_h).c_str());
+	fprintf(file, "\t\t</dict>\n");
+    }
+    fprintf(file, "\t</dict>\n\t<key>metadata</key>\n\t<dict>\n"
+	    "\t\t<key>format</key>\n\t\t<integer>2</integer>\n"
+	    "\t\t<key>realTextureFileName</key>\n\t\t<string>%s</string>\n"
+	    "\t\t<key>size</key>\n\t\t<string>%s</string>\n"
+	    "\t\t<key>textureFileName</key>\n\t\t<string>%s</string>\n"
+	    "\t</dict>\n</dict>\n</plist>\n",
+	    xml_escape(texture_name).c_str(),
+	    format_pair(width, height).c_str(),
+	    xml_escape(texture_name).c_str());
+    if (fclose(file) != 0) {
+	die("can't write `" + path + "'");
+    }
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: mg-packer [--max-size N] [--padding N] "
+	    "[--extrude N] [--no-trim] [--no-rotate] [--square] <atlas-name> "
+	    "<output-dir> <input-dir>\n"
+	    "       mg-packer --info <image.png>\n");
+    exit(1);
+}
+
+// Prints the size of an image and whether it is opaque, which tells the
+// compressed texture formats it can use.
+static int
+info(const std::string &path)
+{
+    mg_Image image;
+    std::string error;
+    if (!mg_png_read(path, image, error)) {
+	die(path + ": " + error);
+    }
+    bool opaque = true;
+    for (size_t i = 3; i < image.pixels.size() && opaque; i += 4) {
+	opaque = image.pixels[i] == 255;
+    }
+    printf("%d %d %s\n", image.width, image.height,
+	    opaque ? "opaque" : "alpha");
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    mg_Options options;
+    options.max_size = 2048;
+    options.padding = 2;
+    options.extrude = 1;
+    options.trim = true;
+    options.rotate = true;
+    options.square = false;
+
+    if (argc == 3 && strcmp(argv[1], "--info") == 0) {
+	return info(argv[2]);
+    }
+
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+	const std::string arg = argv[i];
+	if ((arg == "--max-size" || arg == "--padding" || arg == "--extrude")
+		&& i + 1 < argc) {
+	    const int val = atoi(argv[++i]);
+	    if (val < 0) {
+		usage();
+	    }
+	    (arg == "--max-size" ? options.max_size
+	     : arg == "--padding" ? options.padding : options.extrude) = val;
+	}
+	else if (arg == "--no-trim") {
+	    options.trim = false;
+	}
+	else if (arg == "--no-rotate") {
+	    options.rotate = false;
+	}
+	else if (arg == "--square") {
+	    // PVRTC textures must be square on iOS.
+	    options.square = true;
+	}
+	else if (arg.compare(0, 2, "--") == 0) {
+	    usage();
+	}
+	else {
+	    args.push_back(arg);
+	}
+    }
+    if (args.size() != 3) {
+	usage();
+    }
+    const std::string atlas_name = args[0];
+    const std::string output_dir = args[1];
+    const std::string input_dir = args[2];
+
+    std::vector<std::string> names;
+    collect_images(input_dir, "", names);
+    std::sort(names.begin(), names.end());
+
+    std::vector<mg_Frame> frames(names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+	mg_Frame &frame = frames[i];
+	frame.name = names[i];
+	std::string error;
+	if (!mg_png_read(input_dir + "/" + frame.name, frame.image, error)) {
+	    die(frame.name + ": " + error);
+	}
+	frame.trim = options.trim ? opaque_area(frame.image)
+	    : mg_Rect(0, 0, frame.image.width, frame.image.height);
+	frame.rotated = frame.packed = false;
+    }
+
+    std::vector<mg_Frame *> remaining;
+    for (auto &frame : frames) {
+	remaining.push_back(&frame);
+    }
+    std::sort(remaining.begin(), remaining.end(),
+	    [](const mg_Frame *a, const mg_Frame *b) {
+		const int a_max = std::max(a->trim.width, a->trim.height);
+		const int b_max = std::max(b->trim.width, b->trim.height);
+		if (a_max != b_max) {
+		    return a_max > b_max;
+		}
+		if (a->trim.width * a->trim.height
+			!= b->trim.width * b->trim.height) {
+		    return a->trim.width * a->trim.height
+			> b->trim.width * b->trim.height;
+		}
+		return a->name < b->name;
+	    });
+
+    // Power of two sizes, from the smallest to the largest area.
+    std::vector<std::pair<int, int>> sizes;
+    for (int w = 16; w <= options.max_size; w *= 2) {
+	for (int h = 16; h <= options.max_size; h *= 2) {
+	    if (options.square && w != h) {
+		continue;
+	    }
+	    sizes.push_back(std::make_pair(w, h));
+	}
+    }
+    std::stable_sort(sizes.begin(), sizes.end(),
+	    [](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+		if ((long)a.first * a.second != (long)b.first * b.second) {
+		    return (long)a.first * a.second
+			< (long)b.first * b.second;
+		}
+		return a.first > b.first;
+	    });
+    if (sizes.empty()) {
+	die("--max-size must be at least 16");
+    }
+
+    struct Page {
+	int width, height;
+	std::vector<mg_Frame *> frames;
+    };
+    std::vector<Page> pages;
+    const int border = options.extrude * 2 + options.padding;
+    while (!remaining.empty()) {
+	long area = 0;
+	for (auto frame : remaining) {
+	    area += (long)(frame->trim.width + border)
+		* (frame->trim.height + border);
+	}
+	Page page;
+	page.width = page.height = 0;
+	size_t packed = 0;
+	for (auto &size : sizes) {
+	    if ((long)size.first * size.second < area) {
+		continue;
+	    }
+	    packed = pack(remaining, size.first, size.second, options);
+	    if (packed == remaining.size()) {
+		page.width = size.first;
+		page.height = size.second;
+		break;
+	    }
+	}
+	if (packed < remaining.size()) {
+	    // Fill a texture of the maximum size and continue with another.
+	    page.width = page.height = options.max_size;
+	    packed = pack(remaining, page.width, page.height, options);
+	    if (packed == 0) {
+		die(remaining[0]->name + " does not fit in a "
+			+ std::to_string(options.max_size) + "x"
+			+ std::to_string(options.max_size) + " texture");
+	    }
+	}
+	page.frames.assign(remaining.begin(), remaining.begin() + packed);
+	remaining.erase(remaining.begin(), remaining.begin() + packed);
+	pages.push_back(page);
+    }
+
+    for (size_t i = 0; i < pages.size(); i++) {
+	Page &page = pages[i];
+	std::string base = atlas_name;
+	if (pages.size() > 1) {
+	    base += "-" + std::to_string(i + 1);
+	}
+	std::sort(page.frames.begin(), page.frames.end(),
+		[](const mg_Frame *a, const mg_Frame *b) {
+		    return a->name < b->name;
+		});
+
+	mg_Image atlas;
+	atlas.resize(page.width, page.height);
+	for (auto frame : page.frames) {
+	    blit(atlas, *frame, options);
+	}
+	std::string error;
+	if (!mg_png_write(output_dir + "/" + base + ".png", atlas, error)) {
+	    die(base + ".png: " + error);
+	}
+	write_plist(output_dir + "/" + base + ".plist", base + ".png",
+		page.width, page.height, page.frames, options);
+	for (auto frame : page.frames) {
+	    printf("%s\t%s.plist\n", frame->name.c_str(), base.c_str());
+	}
+    }
+    return 0;
+}
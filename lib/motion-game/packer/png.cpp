@@ -0,0 +1,332 @@
+#include "png.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+static const uint8_t png_signature[8] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+};
+
+static uint32_t
+read_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+	| ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void
+write_u32(std::vector<uint8_t> &buf, uint32_t val)
+{
+    buf.push_back(val >> 24);
+    buf.push_back(val >> 16);
+    buf.push_back(val >> 8);
+    buf.push_back(val);
+}
+
+static bool
+read_file(const std::string &path, std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+	return false;
+    }
+    uint8_t buf[16384];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, file)) > 0) {
+	data.insert(data.end(), buf, buf + n);
+    }
+    const bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+static int
+paeth(int a, int b, int c)
+{
+    const int p = a + b - c;
+    const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) {
+	return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+// Reverses the per-row filters in place. Each row starts with its filter
+// type byte, followed by stride bytes of data.
+static bool
+unfilter(std::vector<uint8_t> &data, int height, size_t stride, int bpp)
+{
+    std::vector<uint8_t> zero(stride, 0);
+    const uint8_t *prev = &zero[0];
+    for (int y = 0; y < height; y++) {
+	uint8_t *row = &data[y * (stride + 1)];
+	const uint8_t type = row[0];
+	uint8_t *cur = row + 1;
+	for (size_t i = 0; i < stride; i++) {
+	    const int a = i >= (size_t)bpp ? cur[i - bpp] : 0;
+	    const int b = prev[i];
+	    const int c = i >= (size_t)bpp ? prev[i - bpp] : 0;
+	    switch (type) {
+	      case 0:
+		break;
+	      case 1:
+		cur[i] += a;
+		break;
+	      case 2:
+		cur[i] += b;
+		break;
+	      case 3:
+		cur[i] += (a + b) / 2;
+		break;
+	      case 4:
+		cur[i] += paeth(a, b, c);
+		break;
+	      default:
+		return false;
+	    }
+	}
+	prev = cur;
+    }
+    return true;
+}
+
+bool
+mg_png_read(const std::string &path, mg_Image &image, std::string &error)
+{
+    std::vector<uint8_t> file;
+    if (!read_file(path, file)) {
+	error = "can't read file";
+	return false;
+    }
+    if (file.size() < 8 || memcmp(&file[0], png_signature, 8) != 0) {
+	error = "not a PNG file";
+	return false;
+    }
+
+    int width = 0, height = 0, depth = 0, color_type = 0, interlace = 0;
+    std::vector<uint8_t> idat, palette, trns;
+    size_t pos = 8;
+    while (pos + 12 <= file.size()) {
+	const uint32_t len = read_u32(&file[pos]);
+	if (len > file.size() - pos - 12) {
+	    error = "truncated chunk";
+	    return false;
+	}
+	const uint8_t *type = &file[pos + 4];
+	const uint8_t *data = &file[pos + 8];
+	if (memcmp(type, "IHDR", 4) == 0 && len >= 13) {
+	    width = read_u32(data);
+	    height = read_u32(data + 4);
+	    depth = data[8];
+	    color_type = data[9];
+	    interlace = data[12];
+	}
+	else if (memcmp(type, "PLTE", 4) == 0) {
+	    palette.assign(data, data + len);
+	}
+	else if (memcmp(type, "tRNS", 4) == 0) {
+	    trns.assign(data, data + len);
+	}
+	else if (memcmp(type, "IDAT", 4) == 0) {
+	    idat.insert(idat.end(), data, data + len);
+	}
+	else if (memcmp(type, "IEND", 4) == 0) {
+	    break;
+	}
+	pos += len + 12;
+    }
+
+    int channels = 0;
+    switch (color_type) {
+      case 0: channels = 1; break;
+      case 2: channels = 3; break;
+      case 3: channels = 1; break;
+      case 4: channels = 2; break;
+      case 6: channels = 4; break;
+    }
+    if (width <= 0 || height <= 0 || channels == 0
+	    || (depth != 1 && depth != 2 && depth != 4 && depth != 8
+		&& depth != 16)) {
+	error = "unsupported PNG header";
+	return false;
+    }
+    if (interlace != 0) {
+	error = "interlaced PNG files are not supported";
+	return false;
+    }
+
+    const size_t stride = ((size_t)width * channels * depth + 7) / 8;
+    std::vector<uint8_t> raw((stride + 1) * height);
+    uLongf raw_len = raw.size();
+    if (uncompress(&raw[0], &raw_len, idat.data(), idat.size()) != Z_OK
+	    || raw_len != raw.size()) {
+	error = "corrupted image data";
+	return false;
+    }
+    const int bpp = std::max(1, channels * depth / 8);
+    if (!unfilter(raw, height, stride, bpp)) {
+	error = "invalid row filter";
+	return false;
+    }
+
+    image.resize(width, height);
+    const int max_sample = (1 << depth) - 1;
+    for (int y = 0; y < height; y++) {
+	const uint8_t *row = &raw[y * (stride + 1) + 1];
+	for (int x = 0; x < width; x++) {
+	    // Raw samples, at their original depth.
+	    int samples[4] = { 0, 0, 0, 0 };
+	    for (int c = 0; c < channels; c++) {
+		const size_t index = (size_t)x * channels + c;
+		if (depth == 16) {
+		    samples[c] = (row[index * 2] << 8) | row[index * 2 + 1];
+		}
+		else if (depth == 8) {
+		    samples[c] = row[index];
+		}
+		else {
+		    const size_t bit = index * depth;
+		    samples[c] = (row[bit / 8] >> (8 - depth - bit % 8))
+			& max_sample;
+		}
+	    }
+
+	    uint8_t *px = image.at(x, y);
+#define SCALE(v) (depth == 16 ? (v) >> 8 : (v) * 255 / max_sample)
+	    switch (color_type) {
+	      case 0:
+		px[0] = px[1] = px[2] = SCALE(samples[0]);
+		px[3] = 255;
+		if (trns.size() >= 2
+			&& samples[0] == ((trns[0] << 8) | trns[1])) {
+		    px[3] = 0;
+		}
+		break;
+	      case 2:
+		px[0] = SCALE(samples[0]);
+		px[1] = SCALE(samples[1]);
+		px[2] = SCALE(samples[2]);
+		px[3] = 255;
+		if (trns.size() >= 6
+			&& samples[0] == ((trns[0] << 8) | trns[1])
+			&& samples[1] == ((trns[2] << 8) | trns[3])
+			&& samples[2] == ((trns[4] << 8) | trns[5])) {
+		    px[3] = 0;
+		}
+		break;
+	      case 3:
+		if ((size_t)samples[0] * 3 + 2 >= palette.size()) {
+		    error = "palette index out of range";
+		    return false;
+		}
+		px[0] = palette[samples[0] * 3];
+		px[1] = palette[samples[0] * 3 + 1];
+		px[2] = palette[samples[0] * 3 + 2];
+		px[3] = (size_t)samples[0] < trns.size() ? trns[samples[0]] : 255;
+		break;
+	      case 4:
+		px[0] = px[1] = px[2] = SCALE(samples[0]);
+		px[3] = SCALE(samples[1]);
+		break;
+	      case 6:
+		px[0] = SCALE(samples[0]);
+		px[1] = SCALE(samples[1]);
+		px[2] = SCALE(samples[2]);
+		px[3] = SCALE(samples[3]);
+		break;
+	    }
+#undef SCALE
+	}
+    }
+    return true;
+}
+
+static void
+write_chunk(std::vector<uint8_t> &out, const char *type,
+	const std::vector<uint8_t> &data)
+{
+    write_u32(out, data.size());
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    write_u32(out, crc32(0, &out[start], out.size() - start));
+}
+
+bool
+mg_png_write(const std::string &path, const mg_Image &image,
+	std::string &error)
+{
+    const size_t stride = (size_t)image.width * 4;
+
+    // Pick, for every row, the filter with the smallest sum of absolute
+    // differences, the usual heuristic which gives good compression.
+    std::vector<uint8_t> filtered;
+    filtered.reserve((stride + 1) * image.height);
+    std::vector<uint8_t> candidate(stride), best(stride);
+    for (int y = 0; y < image.height; y++) {
+	const uint8_t *cur = image.at(0, y);
+	const uint8_t *prev = y > 0 ? image.at(0, y - 1) : NULL;
+	long best_sum = -1;
+	uint8_t best_type = 0;
+	for (uint8_t type = 0; type <= 4; type++) {
+	    long sum = 0;
+	    for (size_t i = 0; i < stride; i++) {
+		const int a = i >= 4 ? cur[i - 4] : 0;
+		const int b = prev != NULL ? prev[i] : 0;
+		const int c = i >= 4 && prev != NULL ? prev[i - 4] : 0;
+		int predictor = 0;
+		switch (type) {
+		  case 1: predictor = a; break;
+		  case 2: predictor = b; break;
+		  case 3: predictor = (a + b) / 2; break;
+		  case 4: predictor = paeth(a, b, c); break;
+		}
+		candidate[i] = cur[i] - predictor;
+		sum += abs((int8_t)candidate[i]);
+	    }
+	    if (best_sum < 0 || sum < best_sum) {
+		best_sum = sum;
+		best_type = type;
+		best.swap(candidate);
+	    }
+	}
+	filtered.push_back(best_type);
+	filtered.insert(filtered.end(), best.begin(), best.end());
+    }
+
+    uLongf compressed_len = compressBound(filtered.size());
+    std::vector<uint8_t> compressed(compressed_len);
+    if (compress2(&compressed[0], &compressed_len, filtered.data(),
+		filtered.size(), 9) != Z_OK) {
+	error = "can't compress image data";
+	return false;
+    }
+    compressed.resize(compressed_len);
+
+    std::vector<uint8_t> out(png_signature, png_signature + 8);
+    std::vector<uint8_t> header;
+    write_u32(header, image.width);
+    write_u32(header, image.height);
+    header.push_back(8);	// Bit depth.
+    header.push_back(6);	// RGBA.
+    header.push_back(0);	// Deflate.
+    header.push_back(0);	// Adaptive filtering.
+    header.push_back(0);	// No interlace.
+    write_chunk(out, "IHDR", header);
+    write_chunk(out, "IDAT", compressed);
+    write_chunk(out, "IEND", std::vector<uint8_t>());
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+	error = "can't open file for writing";
+	return false;
+    }
+    const bool ok = fwrite(&out[0], 1, out.size(), file) == out.size();
+    if (fclose(file) != 0 || !ok) {
+	error = "can't write file";
+	return false;
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef __MG_PACKER_PNG_H_
+#define __MG_PACKER_PNG_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// An 8-bit RGBA image, rows stored from top to bottom.
+struct mg_Image {
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;
+
+    mg_Image() : width(0), height(0) {}
+
+    void resize(int w, int h) {
+	width = w;
+	height = h;
+	pixels.assign((size_t)w * h * 4, 0);
+    }
+
+    uint8_t *at(int x, int y) {
+	return &pixels[((size_t)y * width + x) * 4];
+    }
+
+    const uint8_t *at(int x, int y) const {
+	return &pixels[((size_t)y * width + x) * 4];
+    }
+};
+
+// Reads any non-interlaced PNG file into an RGBA image.
+bool mg_png_read(const std::string &path, mg_Image &image, std::string &error);
+
+// Writes an RGBA image into a PNG file.
+bool mg_png_write(const std::string &path, const mg_Image &image,
+	std::string &error);
+
+#endif // __MG_PACKER_PNG_H_
@@ -1 +1,2 @@
 require File.join(File.dirname(__FILE__), 'shortcuts.rb')
+require File.join(File.dirname(__FILE__), 'assets.rb')
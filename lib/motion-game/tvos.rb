@@ -10,3 +10,7 @@ Motion::Project::App.setup do |app|
   app.vendor_project File.join(File.dirname(__FILE__), '../../build/tvos'), :static, :force_load => true
   app.custom_init_funcs << 'Init_Fluency'
 end
+
+require File.join(File.dirname(__FILE__), 'assets.rb')
+MotionGame::Assets.texture_formats = [:pvrtc]
+MotionGame::Assets.pack_before('build:simulator', 'build:device')
@@ -3,11 +3,12 @@ module MG
     BIRD =  1 << 0
     WORLD = 1 << 1
 
+    # Points per second, 5 points per frame at 60 FPS.
+    SCROLL_SPEED = 300
+
     def initialize
       self.gravity = [0, -900]
 
-      @backgrounds = []
-
       add_skyline
       add_ground
       add_bird
@@ -37,31 +38,25 @@ module MG
     end
 
     def add_skyline
-      x = 0
-      @backgrounds << []
-      4.times do
-        skyline = Sprite.new('skyline.png')
-        skyline.position = [x, Director.shared.size.height / 2.0 + 50]
-        add skyline, 0
-        x += skyline.size.width - 5
-        @backgrounds.last << skyline
-      end
+      skyline = ScrollingLayer.new('skyline.png', SCROLL_SPEED)
+      skyline.spacing = -5
+      skyline.anchor_point = [0, 0.5]
+      skyline.position = [0, Director.shared.size.height / 2.0 + 50]
+      add skyline, 0
     end
 
     def add_ground
-      x = 0
-      @backgrounds << []
-      4.times do
-        ground = Sprite.new('ground.png')
-        ground.attach_physics_box
-        ground.dynamic = false
-        ground.category_mask = WORLD
-        ground.contact_mask = BIRD
-        ground.position = [x, 30]
-        add ground, 2
-        x += ground.size.width - 5
-        @backgrounds.last << ground
+      ground = ScrollingLayer.new('ground.png', SCROLL_SPEED)
+      ground.spacing = -5
+      ground.anchor_point = [0, 0.5]
+      ground.position = [0, 30]
+      ground.segments.each do |segment|
+        segment.attach_physics_box
+        segment.dynamic = false
+        segment.category_mask = WORLD
+        segment.contact_mask = BIRD
       end
+      add ground, 2
     end
 
     def add_bird
@@ -70,7 +65,8 @@ module MG
       @bird.category_mask = BIRD
       @bird.contact_mask = WORLD
       @bird.position = [100, Director.shared.size.height / 2]
-      @bird.animate(['bird_one.png', 'bird_two.png', 'bird_three.png'], 0.5, Repeat::FOREVER)
+      Animation.define(:bird_flap, ['bird_one.png', 'bird_two.png', 'bird_three.png'], 0.5) unless Animation.defined?(:bird_flap)
+      @bird.animate(:bird_flap, Repeat::FOREVER)
       add @bird
     end
 
@@ -89,33 +85,6 @@ module MG
     end
 
     def update(delta)
-      # Move background pieces.
-      @backgrounds.each do |sprite1, sprite2, sprite3, sprite4|
-        width = sprite1.size.width
-        pos1 = sprite1.position
-        pos2 = sprite2.position
-        pos3 = sprite3.position
-        pos4 = sprite4.position
-        movement = 5.0
-        pos1.x -= movement
-        pos2.x -= movement
-        pos3.x -= movement
-        pos4.x -= movement
-        if pos1.x <= -(width / 2.0)
-          pos1.x = pos4.x + width - 5
-        elsif pos2.x <= -(width / 2.0)
-          pos2.x = pos1.x + width - 5
-        elsif pos3.x <= -(width / 2.0)
-          pos3.x = pos2.x + width - 5
-        elsif pos4.x <= -(width / 2.0)
-          pos4.x = pos3.x + width - 5
-        end
-        sprite1.position = pos1
-        sprite2.position = pos2
-        sprite3.position = pos3
-        sprite4.position = pos4
-      end
-
       # Rotate bird.
       @bird.rotation = 360 - [[-90, @bird.velocity.y * 0.2 + 60].max, 30].min if @bird
 
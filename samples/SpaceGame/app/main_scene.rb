@@ -26,8 +26,8 @@ module MG
       @background = Parallax.new
       add @background, 0
 
-      @space_dust1 = Sprite.new('bg_front_spacedust.png')
-      @space_dust2 = Sprite.new('bg_front_spacedust.png')
+      space_dust = ScrollingLayer.new('bg_front_spacedust.png', 300)
+      space_dust.anchor_point = [0, 0.5]
       planetSunrise = Sprite.new('bg_planetsunrise.png')
       galaxy = Sprite.new('bg_galaxy.png')
       spatialAnomaly1 = Sprite.new('bg_spacialanomaly.png')
@@ -35,8 +35,7 @@ module MG
 
       dust_speed = [0.1, 0.1]
       bg_speed = [0.05, 0.05]
-      @background.add @space_dust1, 0, dust_speed, [0, visible_size.height / 2]
-      @background.add @space_dust2, 0, dust_speed, [@space_dust1.size.width, visible_size.height / 2]
+      @background.add space_dust, 0, dust_speed, [0, visible_size.height / 2]
       @background.add galaxy, -1, bg_speed, [0, visible_size.height * 0.7]
       @background.add planetSunrise, -1, bg_speed, [600, visible_size.height * 0]
       @background.add spatialAnomaly1, -1, bg_speed, [900, visible_size.height * 0.3]
@@ -81,22 +80,6 @@ module MG
     def update(delta)
       win_size = Director.shared.size
 
-      # Move background space dusts.
-      width = @space_dust1.size.width
-      pos1 = @space_dust1.position
-      pos2 = @space_dust2.position
-      movement = 5.0
-      pos1.x -= movement
-      pos2.x -= movement
-      if pos1.x <= -(width * 0.5)
-        pos1.x = pos2.x + width
-      end
-      if pos2.x <= -(width * 0.5)
-        pos2.x = pos1.x + width
-      end
-      @space_dust1.position = pos1
-      @space_dust2.position = pos2
-
       # Move ship according to accelerometer.
       max_y = win_size.height - (@ship.size.height / 2)
       min_y = @ship.size.height / 2
@@ -1,5 +1,9 @@
 #include "rubymotion.h"
 #include "motion-game.h"
+#include <base/ccCArray.h>
+#include <base/uthash.h>
+#include <algorithm>
+#include <map>
 
 VALUE rb_cAction = Qnil;
 VALUE rb_cMoveBy = Qnil;
@@ -28,24 +32,415 @@ VALUE rb_cRepeat = Qnil;
 VALUE rb_cRepeatForever = Qnil;
 
 /// @class Action < Object
+/// Actions animate nodes over time. An action can only run on a single
+/// node at a time, but actions turned into templates with {#template!} can
+/// be run on any number of nodes.
+
+// Actions marked with Action#template! are templates: they are never run
+// themselves, a clone is run instead every time they are run on a node or
+// nested in another action.
+#define ACTION_FLAG_TEMPLATE (1 << 16)
+
+static VALUE
+action_wrap(VALUE rcv, cocos2d::Action *action)
+{
+    return rb_cocos2d_object_new(action,
+	    rb_send(rcv, rb_selector("class"), 0, NULL));
+}
+
+static bool
+action_is_template(cocos2d::Action *action)
+{
+    return (action->getFlags() & ACTION_FLAG_TEMPLATE) != 0;
+}
+
+// Returns the action to run or nest for the given Action object, which is a
+// clone of it if it is a template.
+extern "C"
+cocos2d::Action *
+rb_ccaction_instance(VALUE obj)
+{
+    auto action = ACTION(obj);
+    return action_is_template(action) ? action->clone() : action;
+}
+
+#define ACTION_INTERVAL_INSTANCE(obj) \
+    ((cocos2d::ActionInterval *)rb_ccaction_instance(obj))
+#define FINITE_TIME_ACTION_INSTANCE(obj) \
+    ((cocos2d::FiniteTimeAction *)rb_ccaction_instance(obj))
+
+// Completion blocks are called from the action loop, or queued and called
+// in a batch right after it, before the scenes and nodes are updated, when
+// Action.defer_completions is set. Tagged completions are always queued, the
+// nodes of a tag are then passed to its handler in a single call.
+
+class mc_CompletionQueue : public cocos2d::Ref {
+    public:
+	struct Entry {
+	    mc_Block block;
+	    cocos2d::Node *node;
+	    VALUE tag;
+	};
+
+	std::vector<Entry> entries;
+	std::map<VALUE, mc_Block> handlers;
+	bool deferred;
+	bool scheduled;
+
+    static mc_CompletionQueue *instance(void) {
+	static mc_CompletionQueue *queue = NULL;
+	if (queue == NULL) {
+	    queue = new mc_CompletionQueue();
+	    queue->deferred = false;
+	    queue->scheduled = false;
+	}
+	return queue;
+    }
+
+    void push(const mc_Block &block, cocos2d::Node *node, VALUE tag) {
+	if (!scheduled) {
+	    // The ActionManager is updated first, with the system priority.
+	    cocos2d::Director::getInstance()->getScheduler()->scheduleUpdate(
+		    this, cocos2d::Scheduler::PRIORITY_SYSTEM + 1, false);
+	    scheduled = true;
+	}
+	if (node != NULL) {
+	    node->retain();
+	}
+	Entry entry;
+	entry.block = block;
+	entry.node = node;
+	entry.tag = tag;
+	entries.push_back(entry);
+    }
+
+    void complete(const mc_Block &block, cocos2d::Node *node, VALUE tag) {
+	if (tag != Qnil) {
+	    push(mc_Block(), node, tag);
+	}
+	if (!block.empty()) {
+	    if (deferred) {
+		push(block, node, Qnil);
+	    }
+	    else {
+		block.call(0, NULL);
+	    }
+	}
+    }
+
+    void update(float delta) {
+	if (entries.empty()) {
+	    return;
+	}
+	// Completions queued by the blocks are delivered at the next frame.
+	std::vector<Entry> batch;
+	batch.swap(entries);
+
+	std::vector<mc_Block> blocks;
+	std::vector<std::pair<VALUE, VALUE> > tags;
+	for (auto &entry : batch) {
+	    if (entry.tag == Qnil) {
+		blocks.push_back(entry.block);
+	    }
+	    else if (handlers.find(entry.tag) != handlers.end()) {
+		auto group = std::find_if(tags.begin(), tags.end(),
+			[&entry](const std::pair<VALUE, VALUE> &group) {
+			    return group.first == entry.tag;
+			});
+		if (group == tags.end()) {
+		    tags.push_back(std::make_pair(entry.tag, rb_ary_new()));
+		    group = tags.end() - 1;
+		}
+		rb_ary_push(group->second,
+			rb_cocos2d_object_new(entry.node, rb_cNode));
+	    }
+	    if (entry.node != NULL) {
+		entry.node->release();
+	    }
+	}
+
+	for (auto &block : blocks) {
+	    block.call(0, NULL);
+	}
+	for (auto &group : tags) {
+	    auto handler = handlers.find(group.first);
+	    if (handler != handlers.end()) {
+		auto block = handler->second;
+		block.call(1, &group.second);
+	    }
+	}
+    }
+};
+
+// Tags are compared by identity and kept without being retained, which only
+// works with symbols.
+static void
+action_check_tag(VALUE tag)
+{
+    if (!rb_obj_is_kind_of(tag, rb_cSymbol)) {
+	rb_raise(rb_eArgError, "expected Symbol tag");
+    }
+}
+
+// Returns an action which completes the action it follows in a sequence,
+// calling the given block and passing the node to the handler of the given
+// tag. Both are optional.
+extern "C"
+cocos2d::FiniteTimeAction *
+rb_ccaction_completion(VALUE block, VALUE tag)
+{
+    if (tag != Qnil) {
+	action_check_tag(tag);
+    }
+    mc_Block holder = block != Qnil ? mc_Block(block) : mc_Block();
+    return cocos2d::CallFuncN::create([holder, tag](cocos2d::Node *node) {
+	    mc_CompletionQueue::instance()->complete(holder, node, tag);
+	});
+}
+
+/// @group Completions
+
+/// @property .defer_completions?
+/// Whether the completion blocks of actions are deferred. They are called
+/// when actions are done by default, from the loop running the actions. When
+/// deferred, they are called in a batch once all the actions of the frame
+/// ran, before the scenes and nodes are updated, so that blocks can safely
+/// change the node tree.
+/// @return [Boolean] whether completion blocks are deferred, +false+ by
+///   default.
+
+static VALUE
+action_s_defer_completions(VALUE rcv, SEL sel)
+{
+    return mc_CompletionQueue::instance()->deferred ? Qtrue : Qfalse;
+}
+
+static VALUE
+action_s_defer_completions_set(VALUE rcv, SEL sel, VALUE val)
+{
+    mc_CompletionQueue::instance()->deferred = RTEST(val);
+    return val;
+}
+
+/// @method .on_complete(tag)
+/// Registers the handler of the completions tagged with +tag+, see
+/// {Node#run_action}. Tagged completions are always deferred, the handler is
+/// called once per frame with all the nodes whose tagged actions are done.
+///   MG::Action.on_complete(:landed) { |nodes| nodes.each { |x| x.color = :red } }
+///   enemies.each { |enemy| enemy.run_action(fall, :landed) }
+/// @param tag [Symbol] the tag.
+/// @yield [Array<Node>] the nodes whose actions are done. Passing no block
+///   removes the handler, the completions of the tag are then dropped.
+/// @return [Symbol] the tag.
+
+static VALUE
+action_s_on_complete(VALUE rcv, SEL sel, VALUE tag)
+{
+    action_check_tag(tag);
+    auto queue = mc_CompletionQueue::instance();
+    VALUE block = rb_current_block();
+    if (block != Qnil) {
+	queue->handlers[tag] = mc_Block(block);
+    }
+    else {
+	queue->handlers.erase(tag);
+    }
+    return tag;
+}
+
+/// @endgroup
+
 /// @method #reverse
-/// Reverses the action
-/// @return [self] the receiver.
+/// Creates an action which runs the receiver in reverse. Actions going to
+/// an absolute value, such as {MoveTo}, can't be reversed, and raise an
+/// ArgumentError. Tweens are reversed by swapping their start and end
+/// values.
+/// @return [Action] a new action.
 static VALUE
 action_reverse(VALUE rcv, SEL sel)
 {
-    ACTION(rcv)->reverse();
-    return rcv;
+    auto action = ACTION(rcv)->reverse();
+    if (action == NULL) {
+	rb_raise(rb_eArgError, "action can't be reversed");
+    }
+    return action_wrap(rcv, action);
 }
 
-/// @class Action < Object
 /// @method #clone
-/// Clones the action
-/// @return [self] the receiver.
+/// Creates a copy of the action, which is not a template and can run on a
+/// different node than the receiver.
+/// @return [Action] a new action.
 static VALUE
 action_clone(VALUE rcv, SEL sel)
 {
-    ACTION(rcv)->clone();
+    return action_wrap(rcv, ACTION(rcv)->clone());
+}
+
+/// @method #template!
+/// Turns the receiver into a template. A template never runs itself:
+/// {Node#run_action} and {#run_on} run a copy of it, cloned natively, and
+/// {Sequence}, {Spawn}, {Repeat}, {RepeatForever} and {Speed} nest a copy of
+/// it. A template can therefore be built once and run on many nodes at the
+/// same time.
+///   explode = MG::Spawn.new([MG::ScaleBy.new(2, 0.3), MG::FadeOut.new(0.3)]).template!
+///   enemies.each { |enemy| enemy.run(explode) }
+/// @return [self] the receiver.
+static VALUE
+action_make_template(VALUE rcv, SEL sel)
+{
+    auto action = ACTION(rcv);
+    if (action->getTarget() != NULL && !action->isDone()) {
+	rb_raise(rb_eRuntimeError, "can't turn a running action into a template");
+    }
+    action->setFlags(action->getFlags() | ACTION_FLAG_TEMPLATE);
+    return rcv;
+}
+
+/// @method #template?
+/// @return [Boolean] whether the action is a template.
+static VALUE
+action_template(VALUE rcv, SEL sel)
+{
+    return action_is_template(ACTION(rcv)) ? Qtrue : Qfalse;
+}
+
+// The completion of Action.run_on, shared by the actions run on the nodes.
+// An action is over when it is done, or when it is released without being
+// done because it was stopped or its node was removed. The block is called
+// once all of them are over; it is always queued in the latter case, as
+// actions are released from the action loop or from node destructors.
+
+class mc_RunOnGroup {
+    public:
+	mc_Block block;
+	int remaining;
+
+    mc_RunOnGroup(const mc_Block &_block, int count) {
+	block = _block;
+	remaining = count;
+    }
+
+    void over(bool done) {
+	if (--remaining == 0) {
+	    auto queue = mc_CompletionQueue::instance();
+	    if (done) {
+		queue->complete(block, NULL, Qnil);
+	    }
+	    else {
+		queue->push(block, NULL, Qnil);
+	    }
+	}
+    }
+};
+
+class mc_RunOnToken {
+    public:
+	std::shared_ptr<mc_RunOnGroup> group;
+	bool over;
+
+    mc_RunOnToken(const std::shared_ptr<mc_RunOnGroup> &_group) {
+	group = _group;
+	over = false;
+    }
+
+    ~mc_RunOnToken() {
+	if (!over) {
+	    group->over(false);
+	}
+    }
+
+    void done(void) {
+	if (!over) {
+	    over = true;
+	    group->over(true);
+	}
+    }
+};
+
+// Runs a clone of the action on each node, each one delayed by the stagger
+// times the index of the node, and calls the block once when all of them
+// are over.
+static void
+action_run_on_nodes(cocos2d::Action *action, VALUE nodes, VALUE options,
+	VALUE block)
+{
+    VALUE stagger = rb_options_get(rb_options_to_ary(options), "stagger");
+    const float stagger_f = stagger != Qnil ? NUM2DBL(stagger) : 0;
+    const int count = RARRAY_LEN(nodes);
+
+    auto finite_action = dynamic_cast<cocos2d::FiniteTimeAction *>(action);
+    if (finite_action == NULL && (stagger_f > 0 || block != Qnil)) {
+	rb_raise(rb_eArgError,
+		"can't stagger or wait for an action without duration");
+    }
+
+    std::shared_ptr<mc_RunOnGroup> group;
+    if (block != Qnil) {
+	if (count == 0) {
+	    mc_CompletionQueue::instance()->complete(mc_Block(block), NULL,
+		    Qnil);
+	    return;
+	}
+	group.reset(new mc_RunOnGroup(mc_Block(block), count));
+    }
+
+    for (int i = 0; i < count; i++) {
+	auto node = NODE(RARRAY_AT(nodes, i));
+	if (finite_action == NULL) {
+	    node->runAction(action->clone());
+	    continue;
+	}
+	cocos2d::Vector<cocos2d::FiniteTimeAction *> actions;
+	if (stagger_f > 0 && i > 0) {
+	    actions.pushBack(rb_ccdelay_time_create(stagger_f * i));
+	}
+	actions.pushBack(finite_action->clone());
+	if (group) {
+	    std::shared_ptr<mc_RunOnToken> token(new mc_RunOnToken(group));
+	    actions.pushBack(cocos2d::CallFunc::create([token]() {
+			token->done();
+		    }));
+	}
+	node->runAction(actions.size() == 1
+		? actions.at(0) : cocos2d::Sequence::create(actions));
+    }
+}
+
+/// @method .run_on(nodes, action, options=nil)
+/// Runs a copy of the given action on each of the given nodes, in a single
+/// call.
+///   MG::Action.run_on(buttons, slide_in, stagger: 0.05) { menu.enabled = true }
+/// @param nodes [Array<Node>] the nodes to run the action on.
+/// @param action [Action] the action, which is not run itself.
+/// @param options [Hash] the options.
+/// @option options [Float] :stagger a delay in seconds between the start of
+///   the action on a node and on the next one, the first node starting
+///   immediately.
+/// @yield once, when the action is done on all the nodes. Actions which are
+///   stopped, or whose node is removed, count as done, the block is then
+///   called at the next frame.
+/// @return [Action] the given action.
+static VALUE
+action_s_run_on(VALUE rcv, SEL sel, int argc, VALUE *argv)
+{
+    VALUE nodes = Qnil, action = Qnil, options = Qnil;
+    rb_scan_args(argc, argv, "21", &nodes, &action, &options);
+    action_run_on_nodes(ACTION(action), nodes, options, rb_current_block());
+    return action;
+}
+
+/// @method #run_on(nodes, options=nil)
+/// Runs a copy of the receiver on each of the given nodes, see {.run_on}.
+/// @param nodes [Array<Node>] the nodes to run the action on.
+/// @param options [Hash] the options, as accepted by {.run_on}.
+/// @yield once, when the action is done on all the nodes.
+/// @return [self] the receiver.
+static VALUE
+action_run_on(VALUE rcv, SEL sel, int argc, VALUE *argv)
+{
+    VALUE nodes = Qnil, options = Qnil;
+    rb_scan_args(argc, argv, "11", &nodes, &options);
+    action_run_on_nodes(ACTION(rcv), nodes, options, rb_current_block());
     return rcv;
 }
 
@@ -58,6 +453,336 @@ action_done(VALUE rcv, SEL sel)
     return ACTION(rcv)->isDone() ? Qtrue : Qfalse;
 }
 
+// Pools recycle the actions created by the constructors and the Sprite
+// methods. An action of a pool is only referenced by the pool once it is
+// done and no Action object or other action uses it, it is then initialized
+// again in place instead of allocating a new one.
+
+template <class T>
+class mc_PooledAction : public T {
+    public:
+	using T::initWithDuration;
+};
+
+static size_t action_pool_max = 128;
+
+class mc_ActionPoolBase {
+    public:
+	const char *name;
+	unsigned long hits;
+	unsigned long misses;
+
+    static std::vector<mc_ActionPoolBase *> &all(void) {
+	static std::vector<mc_ActionPoolBase *> pools;
+	return pools;
+    }
+
+    virtual size_t size(void) const = 0;
+    virtual void trim(size_t max) = 0;
+};
+
+template <class T>
+class mc_ActionPool : public mc_ActionPoolBase {
+    public:
+	std::vector<mc_PooledAction<T> *> actions;
+	size_t cursor;
+
+    mc_ActionPool(const char *_name) {
+	name = _name;
+	hits = misses = 0;
+	cursor = 0;
+	all().push_back(this);
+    }
+
+    // Returns an action to initialize.
+    mc_PooledAction<T> *acquire(void) {
+	// Only a few actions are checked, so that a pool of running actions
+	// stays cheap.
+	const size_t count = actions.size();
+	for (size_t i = 0; i < count && i < 8; i++) {
+	    auto action = actions[cursor];
+	    cursor = (cursor + 1) % count;
+	    if (action->getReferenceCount() == 1) {
+		hits++;
+		action->setTag(cocos2d::Action::INVALID_TAG);
+		action->setFlags(0);
+		return action;
+	    }
+	}
+	misses++;
+	auto action = new mc_PooledAction<T>();
+	if (count < action_pool_max) {
+	    // The pool owns the reference.
+	    actions.push_back(action);
+	}
+	else {
+	    action->autorelease();
+	}
+	return action;
+    }
+
+    virtual size_t size(void) const override {
+	return actions.size();
+    }
+
+    virtual void trim(size_t max) override {
+	// Running actions are kept alive by their node.
+	while (actions.size() > max) {
+	    actions.back()->release();
+	    actions.pop_back();
+	}
+	cursor = 0;
+    }
+};
+
+static mc_ActionPool<cocos2d::MoveBy> move_by_pool("MoveBy");
+static mc_ActionPool<cocos2d::MoveTo> move_to_pool("MoveTo");
+static mc_ActionPool<cocos2d::RotateBy> rotate_by_pool("RotateBy");
+static mc_ActionPool<cocos2d::RotateTo> rotate_to_pool("RotateTo");
+static mc_ActionPool<cocos2d::ScaleBy> scale_by_pool("ScaleBy");
+static mc_ActionPool<cocos2d::ScaleTo> scale_to_pool("ScaleTo");
+static mc_ActionPool<cocos2d::FadeTo> fade_to_pool("FadeTo");
+static mc_ActionPool<cocos2d::FadeIn> fade_in_pool("FadeIn");
+static mc_ActionPool<cocos2d::FadeOut> fade_out_pool("FadeOut");
+static mc_ActionPool<cocos2d::Blink> blink_pool("Blink");
+static mc_ActionPool<cocos2d::DelayTime> delay_time_pool("DelayTime");
+
+extern "C"
+cocos2d::MoveBy *
+rb_ccmove_by_create(float duration, const cocos2d::Vec2 &delta)
+{
+    auto action = move_by_pool.acquire();
+    action->initWithDuration(duration, delta);
+    return action;
+}
+
+extern "C"
+cocos2d::MoveTo *
+rb_ccmove_to_create(float duration, const cocos2d::Vec2 &position)
+{
+    auto action = move_to_pool.acquire();
+    action->initWithDuration(duration, position);
+    return action;
+}
+
+extern "C"
+cocos2d::RotateBy *
+rb_ccrotate_by_create(float duration, float delta_angle)
+{
+    auto action = rotate_by_pool.acquire();
+    action->initWithDuration(duration, delta_angle);
+    return action;
+}
+
+extern "C"
+cocos2d::RotateTo *
+rb_ccrotate_to_create(float duration, float angle)
+{
+    auto action = rotate_to_pool.acquire();
+    action->initWithDuration(duration, angle, angle);
+    return action;
+}
+
+extern "C"
+cocos2d::ScaleBy *
+rb_ccscale_by_create(float duration, float scale)
+{
+    auto action = scale_by_pool.acquire();
+    action->initWithDuration(duration, scale);
+    return action;
+}
+
+extern "C"
+cocos2d::ScaleTo *
+rb_ccscale_to_create(float duration, float scale)
+{
+    auto action = scale_to_pool.acquire();
+    action->initWithDuration(duration, scale);
+    return action;
+}
+
+extern "C"
+cocos2d::FadeTo *
+rb_ccfade_to_create(float duration, GLubyte opacity)
+{
+    auto action = fade_to_pool.acquire();
+    action->initWithDuration(duration, opacity);
+    return action;
+}
+
+extern "C"
+cocos2d::FadeIn *
+rb_ccfade_in_create(float duration)
+{
+    auto action = fade_in_pool.acquire();
+    action->initWithDuration(duration, 255);
+    return action;
+}
+
+extern "C"
+cocos2d::FadeOut *
+rb_ccfade_out_create(float duration)
+{
+    auto action = fade_out_pool.acquire();
+    action->initWithDuration(duration, 0);
+    return action;
+}
+
+extern "C"
+cocos2d::Blink *
+rb_ccblink_create(float duration, int blinks)
+{
+    auto action = blink_pool.acquire();
+    action->initWithDuration(duration, blinks);
+    return action;
+}
+
+extern "C"
+cocos2d::DelayTime *
+rb_ccdelay_time_create(float duration)
+{
+    auto action = delay_time_pool.acquire();
+    action->initWithDuration(duration);
+    return action;
+}
+
+// The element cocos2d::ActionManager keeps for each target, which is only
+// defined in CCActionManager.cpp.
+
+typedef struct _hashElement {
+    struct _ccArray *actions;
+    cocos2d::Node *target;
+    int actionIndex;
+    cocos2d::Action *currentAction;
+    bool currentActionSalvaged;
+    bool paused;
+    UT_hash_handle hh;
+} tHashElement;
+
+// An action manager which steps the actions of each target in the time of
+// the node, scaled by Node#time_scale and the ones of its ancestors. Only
+// the update loop differs from cocos2d::ActionManager.
+
+class mc_ActionManager : public cocos2d::ActionManager {
+    public:
+    virtual void update(float delta) override {
+	for (tHashElement *element = _targets; element != NULL; ) {
+	    _currentTarget = element;
+	    _currentTargetSalvaged = false;
+	    const float time_scale = element->paused
+		? 0 : rb_ccnode_time_scale(element->target);
+	    // Actions added while stepping are stepped in the same frame.
+	    for (element->actionIndex = 0; time_scale > 0
+		    && element->actionIndex < element->actions->num;
+		    element->actionIndex++) {
+		auto action = static_cast<cocos2d::Action *>(
+			element->actions->arr[element->actionIndex]);
+		element->currentAction = action;
+		if (action == NULL) {
+		    continue;
+		}
+		element->currentActionSalvaged = false;
+		action->step(delta * time_scale);
+		if (element->currentActionSalvaged) {
+		    // Removed while stepping, and retained until now.
+		    action->release();
+		}
+		else if (action->isDone()) {
+		    action->stop();
+		    element->currentAction = NULL;
+		    removeAction(action);
+		}
+		element->currentAction = NULL;
+	    }
+	    if (time_scale > 0) {
+		rb_ccnode_changed(element->target);
+	    }
+
+	    element = (tHashElement *)element->hh.next;
+	    if (_currentTargetSalvaged && _currentTarget->actions->num == 0) {
+		deleteHashElement(_currentTarget);
+	    }
+	    else if (_currentTarget->target->getReferenceCount() == 1) {
+		// Only the action manager references the target.
+		deleteHashElement(_currentTarget);
+	    }
+	}
+	_currentTarget = NULL;
+    }
+};
+
+// Replaces the action manager of the director. Nodes keep the action manager
+// they were created with, so the previous one is kept running for the nodes
+// created before, which are stepped without time scale.
+
+extern "C"
+void
+rb_ccaction_manager_install(void)
+{
+    auto director = cocos2d::Director::getInstance();
+    // The scheduler does not retain the previous action manager, which
+    // would be released by the director.
+    director->getActionManager()->retain();
+    auto manager = new mc_ActionManager();
+    director->setActionManager(manager);
+    manager->release();
+    director->getScheduler()->scheduleUpdate(manager,
+	    cocos2d::Scheduler::PRIORITY_SYSTEM, false);
+}
+
+/// @group Pooling
+
+/// @property .pool_size
+/// The number of actions each pool can hold. Actions are pooled per type,
+/// for the {MoveBy}, {MoveTo}, {RotateBy}, {RotateTo}, {ScaleBy},
+/// {ScaleTo}, {FadeTo}, {FadeIn}, {FadeOut}, {Blink} and {DelayTime}
+/// actions and the {Sprite} methods creating them. Setting 0 disables
+/// pooling.
+/// @return [Integer] the size of the pools, 128 by default.
+
+static VALUE
+action_s_pool_size(VALUE rcv, SEL sel)
+{
+    return LONG2NUM(action_pool_max);
+}
+
+static VALUE
+action_s_pool_size_set(VALUE rcv, SEL sel, VALUE val)
+{
+    const long max = NUM2LONG(val);
+    if (max < 0) {
+	rb_raise(rb_eArgError, "invalid pool size %ld", max);
+    }
+    action_pool_max = max;
+    for (auto pool : mc_ActionPoolBase::all()) {
+	pool->trim(action_pool_max);
+    }
+    return val;
+}
+
+/// @method .pool_stats
+/// Reports how actions are recycled.
+/// @return [Array<Array>] an array with, for each type of action, an array
+///   of its name, the number of actions in the pool, the number of actions
+///   recycled from the pool and the number of actions allocated.
+
+static VALUE
+action_s_pool_stats(VALUE rcv, SEL sel)
+{
+    VALUE stats = rb_ary_new();
+    for (auto pool : mc_ActionPoolBase::all()) {
+	VALUE row = rb_ary_new();
+	rb_ary_push(row, RSTRING_NEW(pool->name));
+	rb_ary_push(row, LONG2NUM(pool->size()));
+	rb_ary_push(row, LONG2NUM(pool->hits));
+	rb_ary_push(row, LONG2NUM(pool->misses));
+	rb_ary_push(stats, row);
+    }
+    return stats;
+}
+
+/// @endgroup
+
 /// @class MoveBy < Action
 /// @group Constructors
 /// @method #initialize(delta_location, interval)
@@ -70,7 +795,7 @@ action_done(VALUE rcv, SEL sel)
 static VALUE
 move_by_new(VALUE rcv, SEL sel, VALUE delta_location, VALUE interval)
 {
-    auto action = cocos2d::MoveBy::create(NUM2DBL(interval), rb_any_to_ccvec2(delta_location));
+    auto action = rb_ccmove_by_create(NUM2DBL(interval), rb_any_to_ccvec2(delta_location));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -84,7 +809,7 @@ move_by_new(VALUE rcv, SEL sel, VALUE delta_location, VALUE interval)
 static VALUE
 move_to_new(VALUE rcv, SEL sel, VALUE location, VALUE interval)
 {
-    auto action = cocos2d::MoveTo::create(NUM2DBL(interval), rb_any_to_ccvec2(location));
+    auto action = rb_ccmove_to_create(NUM2DBL(interval), rb_any_to_ccvec2(location));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -134,7 +859,7 @@ jump_to_new(VALUE rcv, SEL sel, VALUE location, VALUE height, VALUE jumps, VALUE
 static VALUE
 rotate_by_new(VALUE rcv, SEL sel, VALUE delta_angle, VALUE interval)
 {
-    auto action = cocos2d::RotateBy::create(NUM2DBL(interval), NUM2DBL(delta_angle));
+    auto action = rb_ccrotate_by_create(NUM2DBL(interval), NUM2DBL(delta_angle));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -149,7 +874,7 @@ rotate_by_new(VALUE rcv, SEL sel, VALUE delta_angle, VALUE interval)
 static VALUE
 rotate_to_new(VALUE rcv, SEL sel, VALUE angle, VALUE interval)
 {
-    auto action = cocos2d::RotateTo::create(NUM2DBL(interval), NUM2DBL(angle));
+    auto action = rb_ccrotate_to_create(NUM2DBL(interval), NUM2DBL(angle));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -163,7 +888,7 @@ rotate_to_new(VALUE rcv, SEL sel, VALUE angle, VALUE interval)
 static VALUE
 scale_by_new(VALUE rcv, SEL sel, VALUE scale, VALUE interval)
 {
-    auto action = cocos2d::ScaleBy::create(NUM2DBL(interval), NUM2DBL(scale));
+    auto action = rb_ccscale_by_create(NUM2DBL(interval), NUM2DBL(scale));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -177,7 +902,7 @@ scale_by_new(VALUE rcv, SEL sel, VALUE scale, VALUE interval)
 static VALUE
 scale_to_new(VALUE rcv, SEL sel, VALUE scale, VALUE interval)
 {
-    auto action = cocos2d::ScaleTo::create(NUM2DBL(interval), NUM2DBL(scale));
+    auto action = rb_ccscale_to_create(NUM2DBL(interval), NUM2DBL(scale));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -257,7 +982,7 @@ tint_to_new(VALUE rcv, SEL sel, VALUE red, VALUE green, VALUE blue, VALUE interv
 static VALUE
 fade_to_new(VALUE rcv, SEL sel, VALUE opacity, VALUE interval)
 {
-    auto action = cocos2d::FadeTo::create(NUM2DBL(interval), NUM2BYTE(opacity));
+    auto action = rb_ccfade_to_create(NUM2DBL(interval), NUM2BYTE(opacity));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -270,7 +995,7 @@ fade_to_new(VALUE rcv, SEL sel, VALUE opacity, VALUE interval)
 static VALUE
 fade_in_new(VALUE rcv, SEL sel, VALUE interval)
 {
-    auto action = cocos2d::FadeIn::create(NUM2DBL(interval));
+    auto action = rb_ccfade_in_create(NUM2DBL(interval));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -283,7 +1008,7 @@ fade_in_new(VALUE rcv, SEL sel, VALUE interval)
 static VALUE
 fade_out_new(VALUE rcv, SEL sel, VALUE interval)
 {
-    auto action = cocos2d::FadeOut::create(NUM2DBL(interval));
+    auto action = rb_ccfade_out_create(NUM2DBL(interval));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -297,7 +1022,7 @@ fade_out_new(VALUE rcv, SEL sel, VALUE interval)
 static VALUE
 blink_new(VALUE rcv, SEL sel, VALUE blinks, VALUE interval)
 {
-    auto action = cocos2d::Blink::create(NUM2DBL(interval), NUM2INT(blinks));
+    auto action = rb_ccblink_create(NUM2DBL(interval), NUM2INT(blinks));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -314,7 +1039,7 @@ sequence_new(VALUE rcv, SEL sel, VALUE actions)
     cocos2d::Vector<cocos2d::FiniteTimeAction *> actionsVector;
 
     for (int i = 0, count = RARRAY_LEN(actions); i < count; i++) {
-	actionsVector.pushBack(FINITE_TIME_ACTION(RARRAY_AT(actions, i)));
+	actionsVector.pushBack(FINITE_TIME_ACTION_INSTANCE(RARRAY_AT(actions, i)));
     }
 
     auto action = cocos2d::Sequence::create(actionsVector);
@@ -333,7 +1058,7 @@ spawn_new(VALUE rcv, SEL sel, VALUE actions)
     cocos2d::Vector<cocos2d::FiniteTimeAction *> actionsVector;
 
     for (int i = 0, count = RARRAY_LEN(actions); i < count; i++) {
-	actionsVector.pushBack(FINITE_TIME_ACTION(RARRAY_AT(actions, i)));
+	actionsVector.pushBack(FINITE_TIME_ACTION_INSTANCE(RARRAY_AT(actions, i)));
     }
 
     auto action = cocos2d::Spawn::create(actionsVector);
@@ -362,7 +1087,7 @@ follow_new(VALUE rcv, SEL sel, VALUE followed_node)
 static VALUE
 delay_time_new(VALUE rcv, SEL sel, VALUE interval)
 {
-    auto action = cocos2d::DelayTime::create(NUM2DBL(interval));
+    auto action = rb_ccdelay_time_create(NUM2DBL(interval));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -378,7 +1103,7 @@ delay_time_new(VALUE rcv, SEL sel, VALUE interval)
 static VALUE
 speed_new(VALUE rcv, SEL sel, VALUE target_action, VALUE speed)
 {
-    auto action = cocos2d::Speed::create(ACTION_INTERVAL(target_action), NUM2DBL(speed));
+    auto action = cocos2d::Speed::create(ACTION_INTERVAL_INSTANCE(target_action), NUM2DBL(speed));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -392,7 +1117,7 @@ speed_new(VALUE rcv, SEL sel, VALUE target_action, VALUE speed)
 static VALUE
 repeat_new(VALUE rcv, SEL sel, VALUE target_action, VALUE times)
 {
-    auto action = cocos2d::Repeat::create(ACTION_INTERVAL(target_action), NUM2INT(times));
+    auto action = cocos2d::Repeat::create(ACTION_INTERVAL_INSTANCE(target_action), NUM2INT(times));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
@@ -408,66 +1133,165 @@ repeat_new(VALUE rcv, SEL sel, VALUE target_action, VALUE times)
 static VALUE
 repeat_forever_new(VALUE rcv, SEL sel, VALUE target_action)
 {
-    auto action = cocos2d::RepeatForever::create(ACTION_INTERVAL(target_action));
+    auto action = cocos2d::RepeatForever::create(ACTION_INTERVAL_INSTANCE(target_action));
     return rb_cocos2d_object_new(action, rb_cAction);
 }
 
+static cocos2d::SpriteFrame *
+animation_frame(VALUE name)
+{
+    auto handle = rb_ccsprite_frame_handle(name);
+    if (handle != NULL) {
+	return handle;
+    }
+    std::string frame_name = RSTRING_PTR(StringValue(name));
+    auto frame = rb_ccsprite_frame(frame_name.c_str());
+    if (frame == NULL) {
+	auto texture = cocos2d::Director::getInstance()->getTextureCache()
+	    ->addImage(frame_name);
+	if (texture != NULL) {
+	    cocos2d::Rect rect = cocos2d::Rect::ZERO;
+	    rect.size = texture->getContentSize();
+	    frame = cocos2d::SpriteFrame::createWithTexture(texture, rect);
+	}
+    }
+    if (frame == NULL) {
+	rb_raise(rb_eRuntimeError, "Failed to create sprite frame.");
+    }
+    return frame;
+}
+
+extern "C"
+cocos2d::Animation *
+rb_ccanimation_create(VALUE frame_names, VALUE delay)
+{
+    cocos2d::Vector<cocos2d::SpriteFrame *> frames;
+    for (int i = 0, count = RARRAY_LEN(frame_names); i < count; i++) {
+	frames.pushBack(animation_frame(RARRAY_AT(frame_names, i)));
+    }
+    for (auto frame : frames) {
+	rb_texture_cache_used(frame->getTexture());
+    }
+    return cocos2d::Animation::createWithSpriteFrames(frames, NUM2DBL(delay));
+}
+
+// Creates the action used by Animate.new and Sprite#animate, either from a
+// list of frame names or from the name of an animation registered with
+// Animation.define, which does not need any frame or texture lookup.
+
+extern "C"
+cocos2d::ActionInterval *
+rb_ccanimate_create(int argc, VALUE *argv)
+{
+    cocos2d::Animation *animation = NULL;
+    VALUE loops = Qnil;
+
+    if (argc > 0 && rb_obj_is_kind_of(argv[0], rb_cSymbol)) {
+	VALUE name = Qnil;
+	rb_scan_args(argc, argv, "11", &name, &loops);
+	animation = cocos2d::AnimationCache::getInstance()->getAnimation(
+		rb_sym2name(name));
+	if (animation == NULL) {
+	    rb_raise(rb_eArgError, "animation `%s' is not defined",
+		    rb_sym2name(name));
+	}
+    }
+    else {
+	VALUE frame_names = Qnil, delay = Qnil;
+	rb_scan_args(argc, argv, "21", &frame_names, &delay, &loops);
+	animation = rb_ccanimation_create(frame_names, delay);
+    }
+
+    int loops_i = 1;
+    if (loops != Qnil) {
+	loops_i = NUM2LONG(loops);
+    }
+
+    cocos2d::ActionInterval *action = cocos2d::Animate::create(animation);
+    if (loops_i < 0) {
+	action = cocos2d::RepeatForever::create(action);
+    }
+    else if (loops_i != 1) {
+	action = cocos2d::Repeat::create(action, loops_i);
+    }
+    return action;
+}
+
 /// @class Animate < Action
 /// @group Constructors
 /// @method #initialize(frame_names, delay, loops=1)
 /// Creates an animation action where the sprite display frame will be changed to
 /// the given frames in +frame_names+ based on the given +delay+ and
 /// repeated +loops+ times.
-/// @param frame_names [Array<String>] an array of sprite frames to load and
-///   use for the animation, which can be either the names of standalone image
-///   files in the application's resource directory or the names of sprite
-///   frames loaded from a spritesheet using {Sprite.load}.
+/// @param frame_names [Array<String, SpriteFrame>] an array of sprite
+///   frames to load and use for the animation, which can be either the names
+///   of standalone image files in the application's resource directory, the
+///   names of sprite frames loaded from a spritesheet using {Sprite.load}, or
+///   {SpriteFrame} handles.
 /// @param delay [Float] the delay in seconds between each frame animation.
 /// @param loops [Integer] the number of times the animation should loop.
 ///   If {Repeat::FOREVER} (or negative value directly) was given, the animation will loop forever.
 /// @return [Animate] the action.
+/// @method #initialize(animation_name, loops=1)
+/// Creates an animation action from an animation registered with
+/// {Animation.define}.
+/// @param animation_name [Symbol] the name of the animation.
+/// @param loops [Integer] the number of times the animation should loop.
+///   If {Repeat::FOREVER} (or negative value directly) was given, the animation will loop forever.
+/// @return [Animate] the action.
 static VALUE
 animate_new(VALUE rcv, SEL sel, int argc, VALUE *argv)
 {
-    VALUE frame_names = Qnil, delay = Qnil, loops = Qnil;
+    return rb_cocos2d_object_new(rb_ccanimate_create(argc, argv), rb_cAction);
+}
 
-    rb_scan_args(argc, argv, "21", &frame_names, &delay, &loops);
+/// @class Animation < Object
+/// Animations are sequences of sprite frames registered once under a name,
+/// then played as many times as needed with {Sprite#animate} or {Animate}
+/// without building the frames again.
 
-    cocos2d::Vector<cocos2d::SpriteFrame *> frames;
-    auto texture_cache = cocos2d::Director::getInstance()->getTextureCache();
-    for (int i = 0, count = RARRAY_LEN(frame_names); i < count; i++) {
-	VALUE name = RARRAY_AT(frame_names, i);
-	std::string frame_name = RSTRING_PTR(StringValue(name));
-	auto texture = texture_cache->addImage(frame_name);
-	cocos2d::SpriteFrame *frame = NULL;
-	if (texture != NULL) {
-	    cocos2d::Rect rect = cocos2d::Rect::ZERO;
-	    rect.size = texture->getContentSize();
-	    frame = cocos2d::SpriteFrame::createWithTexture(texture,
-		    rect);
-	}
-	else {
-	    frame = cocos2d::SpriteFrameCache::getInstance()->getSpriteFrameByName(frame_name);
-	}
-	if (frame == NULL) {
-	    rb_raise(rb_eRuntimeError, "Failed to create sprite frame.");
-	}
-	frames.pushBack(frame);
-    }
+static VALUE rb_cAnimation = Qnil;
 
-    int loops_i = 1;
-    if (loops != Qnil) {
-	loops_i = NUM2LONG(loops);
+static const char *
+animation_name(VALUE name)
+{
+    if (!rb_obj_is_kind_of(name, rb_cSymbol)) {
+	rb_raise(rb_eArgError, "expected Symbol animation name");
     }
+    return rb_sym2name(name);
+}
 
-    auto animation = cocos2d::Animation::createWithSpriteFrames(frames,
-	    NUM2DBL(delay), loops_i);
-    cocos2d::ActionInterval *action = cocos2d::Animate::create(animation);
-    if (loops_i < 0) {
-	action = cocos2d::RepeatForever::create(action);
-    }
+/// @method .define(name, frame_names, delay)
+/// Registers an animation.
+///   MG::Animation.define(:bird_flap, ['bird_one.png', 'bird_two.png'], 0.2)
+///   bird.animate(:bird_flap, MG::Repeat::FOREVER)
+/// @param name [Symbol] the name of the animation. Defining an animation
+///   with an existing name replaces it.
+/// @param frame_names [Array<String, SpriteFrame>] an array of sprite
+///   frames, which can be either the names of standalone image files in the
+///   application's resource directory, the names of sprite frames loaded from
+///   a spritesheet using {Sprite.load}, or {SpriteFrame} handles.
+/// @param delay [Float] the delay in seconds between each frame.
+/// @return [Symbol] the name of the animation.
 
-    return rb_cocos2d_object_new(action, rb_cAction);
+static VALUE
+animation_define(VALUE rcv, SEL sel, VALUE name, VALUE frame_names,
+	VALUE delay)
+{
+    cocos2d::AnimationCache::getInstance()->addAnimation(
+	    rb_ccanimation_create(frame_names, delay), animation_name(name));
+    return name;
+}
+
+/// @method .defined?(name)
+/// @param name [Symbol] the name of an animation.
+/// @return [Boolean] whether an animation was registered with +name+.
+
+static VALUE
+animation_defined(VALUE rcv, SEL sel, VALUE name)
+{
+    return cocos2d::AnimationCache::getInstance()->getAnimation(
+	    animation_name(name)) != NULL ? Qtrue : Qfalse;
 }
 
 extern "C"
@@ -481,6 +1305,16 @@ Init_Action(void)
     rb_define_method(rb_cAction, "reverse", action_reverse, 0);
     rb_define_method(rb_cAction, "clone", action_clone, 0);
     rb_define_method(rb_cAction, "done?", action_done, 0);
+    rb_define_method(rb_cAction, "template!", action_make_template, 0);
+    rb_define_method(rb_cAction, "template?", action_template, 0);
+    rb_define_method(rb_cAction, "run_on", action_run_on, -1);
+    rb_define_singleton_method(rb_cAction, "run_on", action_s_run_on, -1);
+    rb_define_singleton_method(rb_cAction, "defer_completions?", action_s_defer_completions, 0);
+    rb_define_singleton_method(rb_cAction, "defer_completions=", action_s_defer_completions_set, 1);
+    rb_define_singleton_method(rb_cAction, "on_complete", action_s_on_complete, 1);
+    rb_define_singleton_method(rb_cAction, "pool_size", action_s_pool_size, 0);
+    rb_define_singleton_method(rb_cAction, "pool_size=", action_s_pool_size_set, 1);
+    rb_define_singleton_method(rb_cAction, "pool_stats", action_s_pool_stats, 0);
 
     rb_cMoveBy = rb_define_class_under(rb_mMC, "MoveBy", rb_cAction);
     rb_define_constructor(rb_cMoveBy, move_by_new, 2);
@@ -554,6 +1388,10 @@ Init_Action(void)
 
     rb_cAnimate = rb_define_class_under(rb_mMC, "Animate", rb_cAction);
     rb_define_constructor(rb_cAnimate, animate_new, -1);
+
+    rb_cAnimation = rb_define_class_under(rb_mMC, "Animation", rb_cObject);
+    rb_define_singleton_method(rb_cAnimation, "define", animation_define, 3);
+    rb_define_singleton_method(rb_cAnimation, "defined?", animation_defined, 1);
 }
 
 // TODO: Add actions
@@ -0,0 +1,621 @@
+#include "rubymotion.h"
+#include "motion-game.h"
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+static VALUE rb_cAnimatorController = Qnil;
+static VALUE rb_cAnimator = Qnil;
+
+// State, event and parameter names are compared by identity and kept without
+// being retained, which only works with symbols.
+static void
+animator_check_name(VALUE name)
+{
+    if (!rb_obj_is_kind_of(name, rb_cSymbol)) {
+	rb_raise(rb_eArgError, "expected Symbol name");
+    }
+}
+
+class mc_AnimatorController : public cocos2d::Ref {
+    public:
+	struct State {
+	    VALUE name;
+	    cocos2d::Animation *animation;
+	    std::vector<cocos2d::SpriteFrame *> frames;
+	    float delay;
+	    float speed;
+	    VALUE speed_param;
+	    bool loop;
+	    // Frame index => event names.
+	    std::multimap<int, VALUE> events;
+	};
+
+	enum Operator {
+	    OP_TRIGGER, OP_GT, OP_LT, OP_GE, OP_LE, OP_EQ, OP_NE, OP_END
+	};
+
+	struct Transition {
+	    int from;		// -1 for any state
+	    int to;
+	    VALUE param;
+	    Operator op;
+	    float value;
+	};
+
+	std::vector<State> states;
+	std::vector<Transition> transitions;
+
+    virtual ~mc_AnimatorController() {
+	for (auto &state : states) {
+	    state.animation->release();
+	}
+    }
+
+    int state_index(VALUE name) const {
+	for (size_t i = 0; i < states.size(); i++) {
+	    if (states[i].name == name) {
+		return i;
+	    }
+	}
+	return -1;
+    }
+
+    int find_state(VALUE name) const {
+	animator_check_name(name);
+	const int index = state_index(name);
+	if (index < 0) {
+	    rb_raise(rb_eArgError, "undefined animator state `%s'",
+		    rb_sym2name(name));
+	}
+	return index;
+    }
+};
+
+#define ANIMATOR_CONTROLLER(obj) \
+    _COCOS_WRAP_GET(obj, mc_AnimatorController)
+
+class mc_Animator : public cocos2d::Action {
+    public:
+	mc_AnimatorController *controller;
+	std::map<VALUE, float> params;
+	mc_Block events_block;
+	int state;
+	int frame;
+	float elapsed;
+	bool ended;
+
+    static mc_Animator *create(mc_AnimatorController *controller,
+	    int state, mc_Block events_block) {
+	auto animator = new mc_Animator();
+	animator->controller = controller;
+	controller->retain();
+	animator->events_block = events_block;
+	animator->state = state;
+	animator->frame = 0;
+	animator->elapsed = 0;
+	animator->ended = false;
+	animator->autorelease();
+	return animator;
+    }
+
+    virtual ~mc_Animator() {
+	controller->release();
+    }
+
+    float param(VALUE name) const {
+	auto iter = params.find(name);
+	return iter != params.end() ? iter->second : 0;
+    }
+
+    void enter(int new_state, std::vector<VALUE> &events) {
+	state = new_state;
+	frame = 0;
+	elapsed = 0;
+	ended = false;
+	show(events);
+    }
+
+    void show(std::vector<VALUE> &events) {
+	auto &current = controller->states[state];
+	if (current.frames.empty()) {
+	    return;
+	}
+	static_cast<cocos2d::Sprite *>(_target)->setSpriteFrame(
+		current.frames[frame]);
+	auto range = current.events.equal_range(frame);
+	for (auto iter = range.first; iter != range.second; ++iter) {
+	    events.push_back(iter->second);
+	}
+    }
+
+    bool condition(const mc_AnimatorController::Transition &transition,
+	    bool cycle_ended) {
+	if (transition.op == mc_AnimatorController::OP_END) {
+	    return cycle_ended;
+	}
+	const float value = param(transition.param);
+	switch (transition.op) {
+	  case mc_AnimatorController::OP_TRIGGER:
+	    if (value != 0) {
+		// Triggers are consumed by the transition.
+		params[transition.param] = 0;
+		return true;
+	    }
+	    return false;
+	  case mc_AnimatorController::OP_GT:
+	    return value > transition.value;
+	  case mc_AnimatorController::OP_LT:
+	    return value < transition.value;
+	  case mc_AnimatorController::OP_GE:
+	    return value >= transition.value;
+	  case mc_AnimatorController::OP_LE:
+	    return value <= transition.value;
+	  case mc_AnimatorController::OP_EQ:
+	    return value == transition.value;
+	  case mc_AnimatorController::OP_NE:
+	    return value != transition.value;
+	  default:
+	    return false;
+	}
+    }
+
+    // Animators can be run on sprites only.
+    virtual void startWithTarget(cocos2d::Node *target) override {
+	if (dynamic_cast<cocos2d::Sprite *>(target) == NULL) {
+	    rb_raise(rb_eArgError, "an animator can only run on a Sprite");
+	}
+	cocos2d::Action::startWithTarget(target);
+	std::vector<VALUE> events;
+	enter(state, events);
+	fire(events);
+    }
+
+    virtual bool isDone(void) const override {
+	return false;
+    }
+
+    virtual void step(float delta) override {
+	if (_target == NULL || controller->states.empty()) {
+	    return;
+	}
+	std::vector<VALUE> events;
+	bool cycle_ended = false;
+
+	auto *current = &controller->states[state];
+	const int count = current->frames.size();
+	if (frame >= count) {
+	    // The state was defined again with less frames.
+	    frame = 0;
+	}
+	float speed = current->speed;
+	if (current->speed_param != Qnil) {
+	    speed *= std::max(param(current->speed_param), 0.0f);
+	}
+	elapsed += delta * speed;
+	while (!ended && count > 0 && elapsed >= current->delay) {
+	    elapsed -= current->delay;
+	    if (frame + 1 < count) {
+		frame++;
+	    }
+	    else if (current->loop) {
+		frame = 0;
+		cycle_ended = true;
+	    }
+	    else {
+		ended = cycle_ended = true;
+		break;
+	    }
+	    show(events);
+	}
+	if (ended) {
+	    cycle_ended = true;
+	}
+
+	for (auto &transition : controller->transitions) {
+	    if ((transition.from == state
+			|| (transition.from < 0 && transition.to != state))
+		    && condition(transition, cycle_ended)) {
+		enter(transition.to, events);
+		break;
+	    }
+	}
+	fire(events);
+    }
+
+    void fire(const std::vector<VALUE> &events) {
+	if (events.empty() || events_block.empty()) {
+	    return;
+	}
+	// The block may stop the animator.
+	retain();
+	auto block = events_block;
+	for (auto event : events) {
+	    VALUE arg = event;
+	    block.call(1, &arg);
+	}
+	release();
+    }
+
+    virtual mc_Animator *clone() const override {
+	auto animator = create(controller, state, events_block);
+	animator->params = params;
+	return animator;
+    }
+
+    virtual mc_Animator *reverse() const override {
+	return clone();
+    }
+};
+
+#define ANIMATOR(obj) _COCOS_WRAP_GET(obj, mc_Animator)
+
+/// @class AnimatorController < Object
+/// An animator controller describes the animations of a kind of sprite as
+/// a state machine: each state plays a list of frames, and transitions
+/// switch between states depending on parameters set on the {Animator} of
+/// each sprite. A controller is defined once and shared by all the sprites
+/// using it, which also share its frames.
+///
+///   controller = MG::AnimatorController.new
+///   controller.state(:idle, ['idle_1.png', 'idle_2.png'], 0.3)
+///   controller.state(:run, :hero_run, nil, speed: :speed)
+///   controller.state(:jump, ['jump_1.png', 'jump_2.png'], 0.1, loop: false)
+///   controller.transition(:idle, :run, :speed, :>, 0.1)
+///   controller.transition(:run, :idle, :speed, :<=, 0.1)
+///   controller.transition(:any, :jump, :jump)
+///   controller.transition(:jump, :idle)
+///   controller.event(:run, 2, :footstep)
+
+/// @group Constructors
+
+/// @method #initialize
+/// Creates an empty controller.
+/// @return [AnimatorController] the controller.
+
+static VALUE
+animator_controller_new(VALUE rcv, SEL sel)
+{
+    auto controller = new mc_AnimatorController();
+    controller->autorelease();
+    return rb_cocos2d_object_new(controller, rcv);
+}
+
+/// @endgroup
+
+/// @group States
+
+/// @method #state(name, frames, delay, options=nil)
+/// Defines a state. The first state defined is the initial state.
+/// @param name [Symbol] the name of the state. Defining a state with an
+///   existing name replaces it.
+/// @param frames [Array<String, SpriteFrame>, Symbol] the sprite frames of
+///   the state, as accepted by {Animation.define}, or the name of an
+///   animation registered with {Animation.define}.
+/// @param delay [Float] the delay in seconds between each frame, ignored
+///   for an animation name.
+/// @param options [Hash] the options.
+/// @option options [Float, Symbol] :speed the speed of the state, 1 by
+///   default, or the name of a parameter used as the speed.
+/// @option options [Boolean] :loop whether the frames loop, +true+ by
+///   default. The last frame of a state which does not loop stays
+///   displayed.
+/// @return [self] the receiver.
+
+static VALUE
+animator_controller_state(VALUE rcv, SEL sel, int argc, VALUE *argv)
+{
+    VALUE name = Qnil, frames = Qnil, delay = Qnil, options = Qnil;
+    rb_scan_args(argc, argv, "31", &name, &frames, &delay, &options);
+    animator_check_name(name);
+
+    cocos2d::Animation *animation = NULL;
+    if (rb_obj_is_kind_of(frames, rb_cSymbol)) {
+	animation = cocos2d::AnimationCache::getInstance()->getAnimation(
+		rb_sym2name(frames));
+	if (animation == NULL) {
+	    rb_raise(rb_eArgError, "animation `%s' is not defined",
+		    rb_sym2name(frames));
+	}
+    }
+    else {
+	animation = rb_ccanimation_create(frames, delay);
+    }
+
+    mc_AnimatorController::State state;
+    state.name = name;
+    state.animation = animation;
+    animation->retain();
+    for (auto frame : animation->getFrames()) {
+	state.frames.push_back(frame->getSpriteFrame());
+    }
+    state.delay = std::max(animation->getDelayPerUnit(), 0.001f);
+    state.speed = 1;
+    state.speed_param = Qnil;
+    state.loop = true;
+
+    VALUE pairs = rb_options_to_ary(options);
+    VALUE speed = rb_options_get(pairs, "speed");
+    if (rb_obj_is_kind_of(speed, rb_cSymbol)) {
+	state.speed_param = speed;
+    }
+    else if (speed != Qnil) {
+	state.speed = NUM2DBL(speed);
+    }
+    VALUE loop = rb_options_get(pairs, "loop");
+    if (loop != Qnil) {
+	state.loop = RTEST(loop);
+    }
+
+    auto controller = ANIMATOR_CONTROLLER(rcv);
+    const int index = controller->state_index(name);
+    if (index >= 0) {
+	state.events = controller->states[index].events;
+	controller->states[index].animation->release();
+	controller->states[index] = state;
+    }
+    else {
+	controller->states.push_back(state);
+    }
+    return rcv;
+}
+
+/// @method #states
+/// @return [Array<Symbol>] the names of the states.
+
+static VALUE
+animator_controller_states(VALUE rcv, SEL sel)
+{
+    VALUE ary = rb_ary_new();
+    for (auto &state : ANIMATOR_CONTROLLER(rcv)->states) {
+	rb_ary_push(ary, state.name);
+    }
+    return ary;
+}
+
+/// @method #event(state, frame, name)
+/// Adds an event, passed to the block of the animators when the frame of
+/// the state is displayed.
+/// @param state [Symbol] the name of the state.
+/// @param frame [Integer] the index of the frame in the state, from 0.
+/// @param name [Symbol] the name of the event.
+/// @return [self] the receiver.
+
+static VALUE
+animator_controller_event(VALUE rcv, SEL sel, VALUE state, VALUE frame,
+	VALUE name)
+{
+    animator_check_name(name);
+    auto controller = ANIMATOR_CONTROLLER(rcv);
+    controller->states[controller->find_state(state)].events.insert(
+	    std::make_pair((int)NUM2LONG(frame), name));
+    return rcv;
+}
+
+/// @endgroup
+
+/// @group Transitions
+
+/// @method #transition(from, to, param=nil, operator=nil, value=nil)
+/// Adds a transition between states. Transitions are checked at each frame
+/// in the order they were added, the first one whose condition is met is
+/// taken.
+/// @param from [Symbol] the name of the state the transition starts from,
+///   or +:any+ for all the other states.
+/// @param to [Symbol] the name of the state the transition goes to.
+/// @param param [Symbol] the name of the parameter of the condition. Without
+///   parameter, the transition is taken when the frames of +from+ were all
+///   displayed.
+/// @param operator [Symbol] +:>+, +:<+, +:>=+, +:<=+, +:==+ or +:!=+,
+///   comparing the parameter to +value+. Without operator, the parameter is a
+///   trigger: the transition is taken when it is set, and it is then reset.
+/// @param value [Float] the value compared to the parameter.
+/// @return [self] the receiver.
+
+static VALUE
+animator_controller_transition(VALUE rcv, SEL sel, int argc, VALUE *argv)
+{
+    VALUE from = Qnil, to = Qnil, param = Qnil, op = Qnil, value = Qnil;
+    rb_scan_args(argc, argv, "23", &from, &to, &param, &op, &value);
+
+    if (param != Qnil) {
+	animator_check_name(param);
+    }
+    if (op != Qnil) {
+	animator_check_name(op);
+    }
+    auto controller = ANIMATOR_CONTROLLER(rcv);
+    mc_AnimatorController::Transition transition;
+    transition.from = from == rb_name2sym("any")
+	? -1 : controller->find_state(from);
+    transition.to = controller->find_state(to);
+    transition.param = param;
+    transition.value = value != Qnil ? NUM2DBL(value) : 0;
+    if (param == Qnil) {
+	transition.op = mc_AnimatorController::OP_END;
+    }
+    else if (op == Qnil) {
+	transition.op = mc_AnimatorController::OP_TRIGGER;
+    }
+    else {
+	static const struct {
+	    const char *name;
+	    mc_AnimatorController::Operator op;
+	} ops[] = {
+	    { ">", mc_AnimatorController::OP_GT },
+	    { "<", mc_AnimatorController::OP_LT },
+	    { ">=", mc_AnimatorController::OP_GE },
+	    { "<=", mc_AnimatorController::OP_LE },
+	    { "==", mc_AnimatorController::OP_EQ },
+	    { "!=", mc_AnimatorController::OP_NE }
+	};
+	const char *op_name = rb_sym2name(op);
+	size_t i = 0;
+	for (; i < sizeof(ops) / sizeof(ops[0]); i++) {
+	    if (strcmp(op_name, ops[i].name) == 0) {
+		transition.op = ops[i].op;
+		break;
+	    }
+	}
+	if (i == sizeof(ops) / sizeof(ops[0])) {
+	    rb_raise(rb_eArgError, "invalid operator `%s'", op_name);
+	}
+    }
+    controller->transitions.push_back(transition);
+    return rcv;
+}
+
+/// @endgroup
+
+/// @class Animator < Action
+/// An animator plays the states of an {AnimatorController} on a sprite. It
+/// is evaluated natively at each frame, Ruby code only runs for the events
+/// of the controller.
+///
+///   animator = MG::Animator.new(hero, controller) do |event|
+///     MG::Audio.play('step.wav') if event == :footstep
+///   end
+///   animator[:speed] = 3.2
+///   animator[:jump] = true
+
+/// @group Constructors
+
+/// @method #initialize(sprite, controller, state=nil)
+/// Creates an animator and starts it on the given sprite.
+/// @param sprite [Sprite] the sprite to animate.
+/// @param controller [AnimatorController] the controller.
+/// @param state [Symbol] the initial state, the first state of the
+///   controller by default.
+/// @yield [Symbol] the name of an event of the controller, when it occurs.
+/// @return [Animator] the animator.
+
+static VALUE
+animator_new(VALUE rcv, SEL sel, int argc, VALUE *argv)
+{
+    VALUE sprite = Qnil, controller = Qnil, state = Qnil;
+    rb_scan_args(argc, argv, "21", &sprite, &controller, &state);
+
+    auto target = dynamic_cast<cocos2d::Sprite *>(NODE(sprite));
+    if (target == NULL) {
+	rb_raise(rb_eArgError, "expected a Sprite");
+    }
+    auto animator_controller = ANIMATOR_CONTROLLER(controller);
+    if (animator_controller->states.empty()) {
+	rb_raise(rb_eArgError, "the animator controller has no state");
+    }
+    VALUE block = rb_current_block();
+    auto animator = mc_Animator::create(animator_controller,
+	    state != Qnil ? animator_controller->find_state(state) : 0,
+	    block != Qnil ? mc_Block(block) : mc_Block());
+    target->runAction(animator);
+    return rb_cocos2d_object_new(animator, rcv);
+}
+
+/// @endgroup
+
+/// @group Parameters
+
+/// @method #[](name)
+/// @param name [Symbol] the name of a parameter.
+/// @return [Float] the value of the parameter, 0 by default.
+
+static VALUE
+animator_param_get(VALUE rcv, SEL sel, VALUE name)
+{
+    animator_check_name(name);
+    return DBL2NUM(ANIMATOR(rcv)->param(name));
+}
+
+/// @method #[]=(name, value)
+/// Sets a parameter, checked by the transitions at the next frame.
+/// @param name [Symbol] the name of a parameter.
+/// @param value [Float, Boolean] the value of the parameter, +true+ and
+///   +false+ being 1 and 0.
+/// @return [Float, Boolean] the value.
+
+static VALUE
+animator_param_set(VALUE rcv, SEL sel, VALUE name, VALUE value)
+{
+    animator_check_name(name);
+    float value_f = 0;
+    if (value == Qtrue) {
+	value_f = 1;
+    }
+    else if (value != Qfalse && value != Qnil) {
+	value_f = NUM2DBL(value);
+    }
+    ANIMATOR(rcv)->params[name] = value_f;
+    return value;
+}
+
+/// @endgroup
+
+/// @property #state
+/// The current state. Setting a state switches to it immediately, without
+/// checking the transitions.
+/// @return [Symbol] the name of the state.
+
+static VALUE
+animator_state(VALUE rcv, SEL sel)
+{
+    auto animator = ANIMATOR(rcv);
+    return animator->controller->states[animator->state].name;
+}
+
+static VALUE
+animator_state_set(VALUE rcv, SEL sel, VALUE name)
+{
+    auto animator = ANIMATOR(rcv);
+    const int state = animator->controller->find_state(name);
+    if (animator->getTarget() == NULL) {
+	animator->state = state;
+    }
+    else {
+	std::vector<VALUE> events;
+	animator->enter(state, events);
+	animator->fire(events);
+    }
+    return name;
+}
+
+/// @method #stop
+/// Stops the animator, the current frame stays displayed.
+/// @return [self] the receiver.
+
+static VALUE
+animator_stop(VALUE rcv, SEL sel)
+{
+    auto animator = ANIMATOR(rcv);
+    if (animator->getTarget() != NULL) {
+	animator->getTarget()->stopAction(animator);
+    }
+    return rcv;
+}
+
+extern "C"
+void
+Init_Animator(void)
+{
+    rb_cAnimatorController = rb_define_class_under(rb_mMC,
+	    "AnimatorController", rb_cObject);
+    rb_register_cocos2d_object_finalizer(rb_cAnimatorController);
+
+    rb_define_constructor(rb_cAnimatorController, animator_controller_new, 0);
+    rb_define_method(rb_cAnimatorController, "state",
+	    animator_controller_state, -1);
+    rb_define_method(rb_cAnimatorController, "states",
+	    animator_controller_states, 0);
+    rb_define_method(rb_cAnimatorController, "event",
+	    animator_controller_event, 3);
+    rb_define_method(rb_cAnimatorController, "transition",
+	    animator_controller_transition, -1);
+
+    rb_cAnimator = rb_define_class_under(rb_mMC, "Animator", rb_cAction);
+
+    rb_define_constructor(rb_cAnimator, animator_new, -1);
+    rb_define_method(rb_cAnimator, "[]", animator_param_get, 1);
+    rb_define_method(rb_cAnimator, "[]=", animator_param_set, 2);
+    rb_define_method(rb_cAnimator, "state", animator_state, 0);
+    rb_define_method(rb_cAnimator, "state=", animator_state_set, 1);
+    rb_define_method(rb_cAnimator, "stop", animator_stop, 0);
+}
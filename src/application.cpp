@@ -33,6 +33,9 @@ class mc_Application : private cocos2d::Application {
 	// So, in advance, it have to call GetObjectClass() in here.
 	VM_JNI_ENV()->GetObjectClass((jobject)obj);
 #endif
+	// Before any node is created, nodes use the action manager of the
+	// director at the time they are created.
+	rb_ccaction_manager_install();
 	rb_send(obj, start_sel, 0, NULL);
 	return true;
     }
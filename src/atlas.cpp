@@ -0,0 +1,613 @@
+#include "rubymotion.h"
+#include "motion-game.h"
+#include <algorithm>
+#include <map>
+#include <unordered_set>
+
+/// @class DynamicAtlas < Object
+/// The dynamic atlas copies standalone images into shared texture pages at
+/// runtime, so that sprites created from different image files use the same
+/// texture and can be drawn together. It is meant for images which cannot be
+/// packed with +rake assets:pack+, such as downloaded or generated content.
+///
+/// Once enabled, {Sprite#initialize} adds the image files it loads to the
+/// atlas automatically. Images larger than {max_image_size} keep their own
+/// texture.
+
+static VALUE rb_cDynamicAtlas = Qnil;
+
+class mc_DynamicAtlas {
+    public:
+	struct Segment {
+	    int x, y, width;
+	};
+
+	struct Page {
+	    cocos2d::Texture2D *texture;
+	    // A copy of the pixels, where the GL context can be lost, to
+	    // restore the texture.
+	    cocos2d::Image *image;
+	    std::vector<Segment> skyline;
+	    long used_area;
+	    bool closed;
+	};
+
+	struct Entry {
+	    std::string path;
+	    cocos2d::SpriteFrame *frame;
+	    Page *page;
+	    cocos2d::Rect rect;
+	    bool evicted;
+	    std::unordered_set<cocos2d::Sprite *> sprites;
+	};
+
+	std::vector<Page *> pages;
+	std::map<std::string, Entry> entries;
+	bool enabled;
+	int page_size;
+	int max_image_size;
+	int padding;
+
+    mc_DynamicAtlas() {
+	enabled = false;
+	page_size = 2048;
+	max_image_size = 512;
+	padding = 2;
+    }
+
+    static mc_DynamicAtlas *shared(void) {
+	static mc_DynamicAtlas *atlas = NULL;
+	if (atlas == NULL) {
+	    atlas = new mc_DynamicAtlas();
+	}
+	return atlas;
+    }
+
+    Page *new_page(void) {
+	const size_t len = (size_t)page_size * page_size * 4;
+	std::vector<unsigned char> pixels(len, 0);
+	auto image = new cocos2d::Image();
+	image->initWithRawData(pixels.data(), len, page_size, page_size, 8,
+		true);
+	auto texture = new cocos2d::Texture2D();
+	texture->initWithImage(image);
+
+	Page *page = new Page();
+	page->texture = texture;
+#if CC_ENABLE_CACHE_TEXTURE_DATA
+	// The texture manager reloads the image when the context is recreated,
+	// and upload() keeps it up to date.
+	cocos2d::VolatileTextureMgr::addImage(texture, image);
+	page->image = image;
+#else
+	image->release();
+	page->image = NULL;
+#endif
+	page->skyline.push_back({ 0, 0, page_size });
+	page->used_area = 0;
+	page->closed = false;
+	pages.push_back(page);
+	return page;
+    }
+
+    // Skyline bottom-left allocation: the rectangle is placed where its top
+    // edge would be the lowest, on top of the skyline segments it covers.
+    bool allocate(Page *page, int width, int height, int &x, int &y) {
+	auto &skyline = page->skyline;
+	int best = -1, best_top = 0, best_y = 0;
+	for (size_t i = 0; i < skyline.size(); i++) {
+	    if (skyline[i].x + width > page_size) {
+		break;
+	    }
+	    int top = 0, covered = 0;
+	    for (size_t j = i; j < skyline.size() && covered < width; j++) {
+		top = std::max(top, skyline[j].y);
+		covered += skyline[j].width;
+	    }
+	    if (top + height > page_size) {
+		continue;
+	    }
+	    if (best < 0 || top + height < best_top) {
+		best = i;
+		best_top = top + height;
+		best_y = top;
+	    }
+	}
+	if (best < 0) {
+	    return false;
+	}
+	x = skyline[best].x;
+	y = best_y;
+
+	// Replace the covered segments with the new one.
+	Segment segment = { x, y + height, width };
+	size_t i = best;
+	while (i < skyline.size() && skyline[i].x < x + width) {
+	    const int end = skyline[i].x + skyline[i].width;
+	    if (end > x + width) {
+		skyline[i].width = end - (x + width);
+		skyline[i].x = x + width;
+		break;
+	    }
+	    skyline.erase(skyline.begin() + i);
+	}
+	skyline.insert(skyline.begin() + best, segment);
+
+	// Merge neighbors at the same height.
+	for (size_t j = 0; j + 1 < skyline.size(); ) {
+	    if (skyline[j].y == skyline[j + 1].y) {
+		skyline[j].width += skyline[j + 1].width;
+		skyline.erase(skyline.begin() + j + 1);
+	    }
+	    else {
+		j++;
+	    }
+	}
+	page->used_area += (long)width * height;
+	return true;
+    }
+
+    // Copies the image into a page, returning false if it is not eligible.
+    bool upload(Entry &entry, cocos2d::Image *image) {
+	const int width = image->getWidth(), height = image->getHeight();
+	const auto format = image->getRenderFormat();
+	if (width > max_image_size || height > max_image_size
+		|| image->isCompressed()
+		|| (format != cocos2d::Texture2D::PixelFormat::RGBA8888
+		    && format != cocos2d::Texture2D::PixelFormat::RGB888)) {
+	    return false;
+	}
+
+	// Page textures use premultiplied alpha, as most images do.
+	std::vector<unsigned char> rgba((size_t)width * height * 4);
+	const unsigned char *data = image->getData();
+	const bool has_alpha =
+	    format == cocos2d::Texture2D::PixelFormat::RGBA8888;
+	const bool premultiply = has_alpha && !image->hasPremultipliedAlpha();
+	for (size_t i = 0, count = (size_t)width * height; i < count; i++) {
+	    const unsigned char *src = data + i * (has_alpha ? 4 : 3);
+	    unsigned char *dst = &rgba[i * 4];
+	    const unsigned char alpha = has_alpha ? src[3] : 255;
+	    for (int c = 0; c < 3; c++) {
+		dst[c] = premultiply ? src[c] * alpha / 255 : src[c];
+	    }
+	    dst[3] = alpha;
+	}
+
+	Page *page = NULL;
+	int x = 0, y = 0;
+	for (auto candidate : pages) {
+	    if (!candidate->closed && allocate(candidate, width + padding,
+			height + padding, x, y)) {
+		page = candidate;
+		break;
+	    }
+	}
+	if (page == NULL) {
+	    page = new_page();
+	    if (!allocate(page, width + padding, height + padding, x, y)) {
+		return false;
+	    }
+	}
+
+	cocos2d::GL::bindTexture2D(page->texture->getName());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA,
+		GL_UNSIGNED_BYTE, rgba.data());
+	if (page->image != NULL) {
+	    unsigned char *pixels = page->image->getData();
+	    for (int row = 0; row < height; row++) {
+		memcpy(pixels + ((size_t)(y + row) * page_size + x) * 4,
+			&rgba[(size_t)row * width * 4], (size_t)width * 4);
+	    }
+	}
+
+	entry.page = page;
+	entry.rect = cocos2d::Rect(x, y, width, height);
+	return true;
+    }
+
+    cocos2d::SpriteFrame *add(const std::string &name) {
+	auto iter = entries.find(name);
+	if (iter != entries.end()) {
+	    Entry &entry = iter->second;
+	    if (entry.evicted) {
+		entry.evicted = false;
+		cocos2d::SpriteFrameCache::getInstance()->addSpriteFrame(
+			entry.frame, name);
+	    }
+	    return entry.frame;
+	}
+
+	// Images with a pixel format rule or a compressed variant get their
+	// own texture.
+	if (rb_cctexture_format_for(name.c_str())
+		!= cocos2d::Texture2D::PixelFormat::AUTO
+		|| rb_cctexture_has_variant(name.c_str())) {
+	    return NULL;
+	}
+
+	Entry entry;
+	entry.path = cocos2d::FileUtils::getInstance()->fullPathForFilename(
+		name);
+	entry.evicted = false;
+	entry.page = NULL;
+	auto image = new cocos2d::Image();
+	const bool ok = !entry.path.empty()
+	    && image->initWithImageFile(entry.path) && upload(entry, image);
+	image->release();
+	if (!ok) {
+	    return NULL;
+	}
+	entry.frame = cocos2d::SpriteFrame::createWithTexture(
+		entry.page->texture, entry.rect, false, cocos2d::Vec2::ZERO,
+		entry.rect.size);
+	entry.frame->retain();
+	// Registering the frame makes the next lookups by name skip the atlas.
+	cocos2d::SpriteFrameCache::getInstance()->addSpriteFrame(entry.frame,
+		name);
+	entries[name] = entry;
+	return entry.frame;
+    }
+
+    // Remembers which sprites display a frame of the atlas, so that they can
+    // be updated when compacting moves the frame. Sprites are not retained,
+    // their node info forgets them when they are destroyed.
+    void track(cocos2d::Sprite *sprite, const std::string &name) {
+	auto iter = entries.find(name);
+	if (iter == entries.end()
+		|| !sprite->isFrameDisplayed(iter->second.frame)) {
+	    return;
+	}
+	auto info = mc_NodeInfo::fetch(sprite);
+	if (info->atlas_sprite != NULL) {
+	    untrack(sprite, info->atlas_name);
+	}
+	info->atlas_sprite = sprite;
+	info->atlas_name = name;
+	iter->second.sprites.insert(sprite);
+    }
+
+    void untrack(cocos2d::Sprite *sprite, const std::string &name) {
+	auto iter = entries.find(name);
+	if (iter != entries.end()) {
+	    iter->second.sprites.erase(sprite);
+	}
+    }
+
+    // Forgets the sprites which display another frame now.
+    void sweep(Entry &entry) {
+	auto &sprites = entry.sprites;
+	for (auto iter = sprites.begin(); iter != sprites.end(); ) {
+	    auto sprite = *iter;
+	    if (!sprite->isFrameDisplayed(entry.frame)) {
+		auto info = mc_NodeInfo::get(sprite);
+		if (info != NULL) {
+		    info->atlas_sprite = NULL;
+		}
+		iter = sprites.erase(iter);
+	    }
+	    else {
+		++iter;
+	    }
+	}
+    }
+
+    bool evict(const std::string &name) {
+	auto iter = entries.find(name);
+	if (iter == entries.end() || iter->second.evicted) {
+	    return false;
+	}
+	iter->second.evicted = true;
+	cocos2d::SpriteFrameCache::getInstance()->removeSpriteFrameByName(name);
+	return true;
+    }
+
+    // Whether a sprite displaying the frame is in a sprite batch, which
+    // requires the texture of its sprites to stay the same.
+    static bool batched(const Entry &entry) {
+	for (auto sprite : entry.sprites) {
+	    if (sprite->getBatchNode() != NULL) {
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    // Copies the frames which are still needed into new pages, dropping the
+    // evicted ones and the space they used. Frames and tracked sprites are
+    // updated in place. Frames displayed by sprites in a sprite batch keep
+    // their page.
+    void compact(void) {
+	std::vector<Entry *> live;
+	for (auto iter = entries.begin(); iter != entries.end(); ) {
+	    Entry &entry = iter->second;
+	    sweep(entry);
+	    if (entry.evicted && entry.sprites.empty()
+		    && entry.frame->getReferenceCount() == 1) {
+		entry.frame->release();
+		iter = entries.erase(iter);
+	    }
+	    else {
+		live.push_back(&entry);
+		++iter;
+	    }
+	}
+	std::sort(live.begin(), live.end(), [](Entry *a, Entry *b) {
+		return a->rect.size.height > b->rect.size.height;
+	    });
+
+	std::vector<Page *> old_pages;
+	old_pages.swap(pages);
+	for (auto page : old_pages) {
+	    page->closed = true;
+	}
+	std::vector<Page *> kept_pages;
+	for (auto entry : live) {
+	    auto old_page = entry->page;
+	    auto old_rect = entry->frame->getRect();
+	    bool ok = false;
+	    if (!batched(*entry)) {
+		auto image = new cocos2d::Image();
+		ok = image->initWithImageFile(entry->path)
+		    && upload(*entry, image);
+		image->release();
+	    }
+	    if (!ok) {
+		// The file is gone or the frame can't move, keep the old page
+		// for this frame.
+		if (std::find(kept_pages.begin(), kept_pages.end(), old_page)
+			== kept_pages.end()) {
+		    kept_pages.push_back(old_page);
+		}
+		entry->page = old_page;
+		continue;
+	    }
+	    entry->frame->setTexture(entry->page->texture);
+	    entry->frame->setRectInPixels(entry->rect);
+	    for (auto sprite : entry->sprites) {
+		if (sprite->getTexture() == old_page->texture
+			&& sprite->getTextureRect().equals(old_rect)) {
+		    sprite->setSpriteFrame(entry->frame);
+		}
+	    }
+	}
+	for (auto page : old_pages) {
+	    if (std::find(kept_pages.begin(), kept_pages.end(), page)
+		    != kept_pages.end()) {
+		pages.push_back(page);
+	    }
+	    else {
+		page->texture->release();
+		CC_SAFE_RELEASE(page->image);
+		delete page;
+	    }
+	}
+    }
+
+    double usage(void) {
+	if (pages.empty()) {
+	    return 0;
+	}
+	long used = 0;
+	for (auto page : pages) {
+	    used += page->used_area;
+	}
+	return (double)used / ((double)page_size * page_size * pages.size());
+    }
+};
+
+extern "C"
+cocos2d::SpriteFrame *
+rb_dynamic_atlas_frame(const char *name)
+{
+    auto atlas = mc_DynamicAtlas::shared();
+    return atlas->enabled ? atlas->add(name) : NULL;
+}
+
+// Whether the frame is one of the atlas, which stays true as long as it is
+// retained by something else than the atlas.
+extern "C"
+bool
+rb_dynamic_atlas_contains(cocos2d::SpriteFrame *frame)
+{
+    auto atlas = mc_DynamicAtlas::shared();
+    for (auto page : atlas->pages) {
+	if (page->texture == frame->getTexture()) {
+	    return true;
+	}
+    }
+    return false;
+}
+
+// Finds the image file of a frame copied into a page, returning the
+// position of the given pixel in that file.
+extern "C"
+bool
+rb_dynamic_atlas_source(cocos2d::Texture2D *texture, std::string &path,
+	int &x, int &y)
+{
+    for (auto &iter : mc_DynamicAtlas::shared()->entries) {
+	auto &entry = iter.second;
+	if (entry.page != NULL && entry.page->texture == texture
+		&& entry.rect.containsPoint(cocos2d::Vec2(x, y))) {
+	    path = entry.path;
+	    x -= entry.rect.origin.x;
+	    y -= entry.rect.origin.y;
+	    return true;
+	}
+    }
+    return false;
+}
+
+extern "C"
+void
+rb_dynamic_atlas_track(cocos2d::Sprite *sprite, const char *name)
+{
+    auto atlas = mc_DynamicAtlas::shared();
+    if (!atlas->entries.empty()) {
+	atlas->track(sprite, name);
+    }
+}
+
+extern "C"
+void
+rb_dynamic_atlas_untrack(cocos2d::Sprite *sprite, const char *name)
+{
+    mc_DynamicAtlas::shared()->untrack(sprite, name);
+}
+
+/// @group Settings
+
+/// @property .enabled?
+/// @return [Boolean] whether {Sprite#initialize} adds the image files it
+///   loads to the atlas. The default is +false+.
+
+static VALUE
+atlas_enabled(VALUE rcv, SEL sel)
+{
+    return mc_DynamicAtlas::shared()->enabled ? Qtrue : Qfalse;
+}
+
+static VALUE
+atlas_enabled_set(VALUE rcv, SEL sel, VALUE val)
+{
+    mc_DynamicAtlas::shared()->enabled = RTEST(val);
+    return val;
+}
+
+/// @property .page_size
+/// @return [Integer] the width and height of the atlas pages, in pixels.
+///   The default is +2048+. Changing it only affects new pages.
+
+static VALUE
+atlas_page_size(VALUE rcv, SEL sel)
+{
+    return LONG2NUM(mc_DynamicAtlas::shared()->page_size);
+}
+
+static VALUE
+atlas_page_size_set(VALUE rcv, SEL sel, VALUE val)
+{
+    auto atlas = mc_DynamicAtlas::shared();
+    const long size = NUM2LONG(val);
+    if (size < atlas->max_image_size + atlas->padding) {
+	rb_raise(rb_eArgError, "page size must be larger than max_image_size");
+    }
+    atlas->page_size = size;
+    return val;
+}
+
+/// @property .max_image_size
+/// @return [Integer] the maximum width and height, in pixels, of the images
+///   copied into the atlas. The default is +512+.
+
+static VALUE
+atlas_max_image_size(VALUE rcv, SEL sel)
+{
+    return LONG2NUM(mc_DynamicAtlas::shared()->max_image_size);
+}
+
+static VALUE
+atlas_max_image_size_set(VALUE rcv, SEL sel, VALUE val)
+{
+    auto atlas = mc_DynamicAtlas::shared();
+    const long size = NUM2LONG(val);
+    if (size + atlas->padding > atlas->page_size) {
+	rb_raise(rb_eArgError, "max image size must be smaller than page_size");
+    }
+    atlas->max_image_size = size;
+    return val;
+}
+
+/// @endgroup
+
+/// @group Managing Images
+
+/// @method .add(file_name)
+/// Copies an image file into the atlas, and registers a sprite frame with
+/// the same name, which {Sprite#initialize} will use. This works even if
+/// the atlas is not {enabled?}.
+/// @param file_name [String] the name of an image file.
+/// @return [Boolean] whether the image is in the atlas. Images which are too
+///   large or compressed are not added.
+
+static VALUE
+atlas_add(VALUE rcv, SEL sel, VALUE name)
+{
+    return mc_DynamicAtlas::shared()->add(RSTRING_PTR(StringValue(name)))
+	!= NULL ? Qtrue : Qfalse;
+}
+
+/// @method .evict(file_name)
+/// Removes an image from the atlas. Sprites which display it are not
+/// affected, and its space is reclaimed by {compact} once no sprite uses it
+/// anymore.
+/// @param file_name [String] the name of an image file added to the atlas.
+/// @return [Boolean] whether the image was in the atlas.
+
+static VALUE
+atlas_evict(VALUE rcv, SEL sel, VALUE name)
+{
+    return mc_DynamicAtlas::shared()->evict(RSTRING_PTR(StringValue(name)))
+	? Qtrue : Qfalse;
+}
+
+/// @method .compact
+/// Packs the images still in use into new pages, reclaiming the space of
+/// the evicted ones. Images are read again from their files, and the sprites
+/// created with {Sprite#initialize} are updated to use the new pages.
+/// Images displayed by sprites in a {SpriteBatch} stay in their page.
+/// @return [nil]
+
+static VALUE
+atlas_compact(VALUE rcv, SEL sel)
+{
+    mc_DynamicAtlas::shared()->compact();
+    return Qnil;
+}
+
+/// @endgroup
+
+/// @group Statistics
+
+/// @property-readonly .pages
+/// @return [Integer] the number of pages of the atlas.
+
+static VALUE
+atlas_pages(VALUE rcv, SEL sel)
+{
+    return LONG2NUM(mc_DynamicAtlas::shared()->pages.size());
+}
+
+/// @property-readonly .usage
+/// @return [Float] the fraction of the pages area used by images, evicted
+///   ones included, from +0.0+ to +1.0+.
+
+static VALUE
+atlas_usage(VALUE rcv, SEL sel)
+{
+    return DBL2NUM(mc_DynamicAtlas::shared()->usage());
+}
+
+/// @endgroup
+
+extern "C"
+void
+Init_DynamicAtlas(void)
+{
+    rb_cDynamicAtlas = rb_define_class_under(rb_mMC, "DynamicAtlas",
+	    rb_cObject);
+
+    rb_define_singleton_method(rb_cDynamicAtlas, "enabled?", atlas_enabled, 0);
+    rb_define_singleton_method(rb_cDynamicAtlas, "enabled=", atlas_enabled_set, 1);
+    rb_define_singleton_method(rb_cDynamicAtlas, "page_size", atlas_page_size, 0);
+    rb_define_singleton_method(rb_cDynamicAtlas, "page_size=", atlas_page_size_set, 1);
+    rb_define_singleton_method(rb_cDynamicAtlas, "max_image_size", atlas_max_image_size, 0);
+    rb_define_singleton_method(rb_cDynamicAtlas, "max_image_size=", atlas_max_image_size_set, 1);
+    rb_define_singleton_method(rb_cDynamicAtlas, "add", atlas_add, 1);
+    rb_define_singleton_method(rb_cDynamicAtlas, "evict", atlas_evict, 1);
+    rb_define_singleton_method(rb_cDynamicAtlas, "compact", atlas_compact, 0);
+    rb_define_singleton_method(rb_cDynamicAtlas, "pages", atlas_pages, 0);
+    rb_define_singleton_method(rb_cDynamicAtlas, "usage", atlas_usage, 0);
+}
@@ -0,0 +1,463 @@
+#include "rubymotion.h"
+#include "motion-game.h"
+#include <algorithm>
+#include <cmath>
+
+/// @class Camera < Object
+/// The camera of a {Scene}, which decides the part of the world that is
+/// visible on the screen.
+///
+///   camera = scene.camera
+///   camera.target = player
+///   camera.smoothing = 8
+///   camera.dead_zone = [80, 40]
+///   camera.bounds = [0, 0, 4096, 1024]
+///
+/// Unlike the {Follow} action, which snaps rigidly to its target by moving a
+/// layer, the camera moves the point of view of the scene: its transform is
+/// applied once when the scene is rendered, and the nodes keep their world
+/// positions. The camera is evaluated natively every frame, after the
+/// {Scene#update} callbacks, and {Scene#culling=} uses its visible
+/// rectangle.
+///
+/// A scene has a single camera, created the first time {Scene#camera} is
+/// called. The camera is centered on the middle of the screen by default.
+///
+/// Every node of the scene is seen through the camera, including layers used
+/// as a heads-up display, which scroll and zoom with the world like the
+/// other nodes.
+
+static VALUE rb_cCamera = Qnil;
+
+// Drives the default camera of a cocos2d scene. It is a child of the cocos2d
+// scene so that it is owned by the scene, and paused and resumed with it.
+
+class mc_Camera : public cocos2d::Node {
+    public:
+	cocos2d::Node *target;
+	cocos2d::Vec2 offset;
+	cocos2d::Vec2 center;
+	float smoothing;
+	cocos2d::Size dead_zone;
+	cocos2d::Rect bounds;
+	bool has_bounds;
+	float zoom;
+	float shake_intensity;
+	float shake_duration;
+	float shake_elapsed;
+
+    static const int TAG = 0x6d63616d; // 'mcam'
+
+    static mc_Camera *create(void) {
+	auto camera = new mc_Camera();
+	camera->init();
+	camera->setTag(TAG);
+	camera->target = NULL;
+	camera->center = cocos2d::Director::getInstance()->getWinSize() / 2;
+	camera->smoothing = 0;
+	camera->has_bounds = false;
+	camera->zoom = 1;
+	camera->shake_intensity = 0;
+	camera->shake_duration = 0;
+	camera->shake_elapsed = 0;
+	camera->autorelease();
+	return camera;
+    }
+
+    virtual ~mc_Camera() {
+	setTarget(NULL);
+    }
+
+    static mc_Camera *get(cocos2d::Scene *scene) {
+	auto camera = (mc_Camera *)scene->getChildByTag(TAG);
+	if (camera == NULL) {
+	    camera = create();
+	    scene->addChild(camera);
+	    // After the scene's update callbacks, which have priority 0.
+	    camera->scheduleUpdateWithPriority(1);
+	}
+	return camera;
+    }
+
+    void setTarget(cocos2d::Node *node) {
+	if (node != NULL) {
+	    node->retain();
+	}
+	if (target != NULL) {
+	    target->release();
+	}
+	target = node;
+    }
+
+    cocos2d::Scene *cocos2dScene(void) {
+	return (cocos2d::Scene *)getParent();
+    }
+
+    // The size of the world visible on the screen, at the current zoom.
+    cocos2d::Size viewSize(void) {
+	return cocos2d::Director::getInstance()->getVisibleSize() / zoom;
+    }
+
+    void clamp(void) {
+	if (!has_bounds) {
+	    return;
+	}
+	auto size = viewSize();
+	if (bounds.size.width <= size.width) {
+	    center.x = bounds.getMidX();
+	}
+	else {
+	    center.x = std::min(std::max(center.x,
+			bounds.getMinX() + size.width / 2),
+		    bounds.getMaxX() - size.width / 2);
+	}
+	if (bounds.size.height <= size.height) {
+	    center.y = bounds.getMidY();
+	}
+	else {
+	    center.y = std::min(std::max(center.y,
+			bounds.getMinY() + size.height / 2),
+		    bounds.getMaxY() - size.height / 2);
+	}
+    }
+
+    void follow(float delta) {
+	if (target == NULL || target->getParent() == NULL) {
+	    return;
+	}
+	auto goal = target->getParent()->convertToWorldSpace(
+		target->getPosition()) + offset;
+
+	// The camera only moves when the target leaves the dead zone, and
+	// then only by the distance needed to bring it back to the edge.
+	auto desired = center;
+	const float half_width = dead_zone.width / 2;
+	const float half_height = dead_zone.height / 2;
+	if (goal.x > center.x + half_width) {
+	    desired.x = goal.x - half_width;
+	}
+	else if (goal.x < center.x - half_width) {
+	    desired.x = goal.x + half_width;
+	}
+	if (goal.y > center.y + half_height) {
+	    desired.y = goal.y - half_height;
+	}
+	else if (goal.y < center.y - half_height) {
+	    desired.y = goal.y + half_height;
+	}
+
+	// Exponential smoothing, independent of the frame rate.
+	if (smoothing > 0) {
+	    center += (desired - center) * (1 - expf(-smoothing * delta));
+	}
+	else {
+	    center = desired;
+	}
+    }
+
+    void apply(const cocos2d::Vec2 &shake) {
+	auto camera = cocos2dScene()->getDefaultCamera();
+	if (camera == NULL) {
+	    return;
+	}
+	// Zooming moves the camera along the z axis, so the clipping planes
+	// of the default projection are moved with it.
+	auto director = cocos2d::Director::getInstance();
+	const auto size = director->getWinSize();
+	const float z = director->getZEye() / zoom;
+	camera->initPerspective(60, size.width / size.height,
+		std::min(10.0f, z / 2), z + size.height / 2);
+	camera->setPosition3D(cocos2d::Vec3(center.x + shake.x,
+		    center.y + shake.y, z));
+    }
+
+    virtual void update(float delta) override {
+	follow(delta);
+	clamp();
+
+	cocos2d::Vec2 shake;
+	if (shake_elapsed < shake_duration) {
+	    shake_elapsed = std::min(shake_elapsed + delta, shake_duration);
+	    const float amount = shake_intensity
+		* (1 - shake_elapsed / shake_duration);
+	    shake.x = CCRANDOM_MINUS1_1() * amount;
+	    shake.y = CCRANDOM_MINUS1_1() * amount;
+	}
+	apply(shake);
+    }
+};
+
+#define CAMERA(obj) _COCOS_WRAP_GET(obj, mc_Camera)
+
+/// @group Following
+
+/// @property #target
+/// @return [Node, nil] the node followed by the camera, or +nil+.
+
+static VALUE
+camera_target(VALUE rcv, SEL sel)
+{
+    auto target = CAMERA(rcv)->target;
+    return target != NULL ? rb_cocos2d_object_new(target, rb_cNode) : Qnil;
+}
+
+static VALUE
+camera_target_set(VALUE rcv, SEL sel, VALUE val)
+{
+    CAMERA(rcv)->setTarget(val != Qnil ? NODE(val) : NULL);
+    return val;
+}
+
+/// @property #offset
+/// @return [Point] the offset from the target to the point the camera is
+///   centered on, for example to show more of the level in front of the
+///   player. The default value is +[0, 0]+.
+
+static VALUE
+camera_offset(VALUE rcv, SEL sel)
+{
+    return rb_ccvec2_to_obj(CAMERA(rcv)->offset);
+}
+
+static VALUE
+camera_offset_set(VALUE rcv, SEL sel, VALUE val)
+{
+    CAMERA(rcv)->offset = rb_any_to_ccvec2(val);
+    return val;
+}
+
+/// @property #smoothing
+/// @return [Float] how fast the camera catches up with its target. The
+///   camera covers the fraction +1 - exp(-smoothing * delta)+ of the
+///   remaining distance every frame, so larger values follow more tightly,
+///   independently of the frame rate. The default value, +0+, snaps to the
+///   target.
+
+static VALUE
+camera_smoothing(VALUE rcv, SEL sel)
+{
+    return DBL2NUM(CAMERA(rcv)->smoothing);
+}
+
+static VALUE
+camera_smoothing_set(VALUE rcv, SEL sel, VALUE val)
+{
+    CAMERA(rcv)->smoothing = std::max((float)NUM2DBL(val), 0.0f);
+    return val;
+}
+
+/// @property #dead_zone
+/// @return [Size] the size of the area around the center of the camera in
+///   which the target can move without moving the camera. The default value
+///   is +[0, 0]+.
+
+static VALUE
+camera_dead_zone(VALUE rcv, SEL sel)
+{
+    return rb_ccsize_to_obj(CAMERA(rcv)->dead_zone);
+}
+
+static VALUE
+camera_dead_zone_set(VALUE rcv, SEL sel, VALUE val)
+{
+    CAMERA(rcv)->dead_zone = rb_any_to_ccsize(val);
+    return val;
+}
+
+/// @endgroup
+
+/// @property #bounds
+/// @return [Array, nil] the rectangle of the world the camera is kept in,
+///   as an +[x, y, width, height]+ array, or +nil+ if the camera is not
+///   bounded. If the visible area is larger than the bounds, the camera is
+///   centered on them.
+
+static VALUE
+camera_bounds(VALUE rcv, SEL sel)
+{
+    auto camera = CAMERA(rcv);
+    if (!camera->has_bounds) {
+	return Qnil;
+    }
+    VALUE ary = rb_ary_new();
+    rb_ary_push(ary, DBL2NUM(camera->bounds.origin.x));
+    rb_ary_push(ary, DBL2NUM(camera->bounds.origin.y));
+    rb_ary_push(ary, DBL2NUM(camera->bounds.size.width));
+    rb_ary_push(ary, DBL2NUM(camera->bounds.size.height));
+    return ary;
+}
+
+static VALUE
+camera_bounds_set(VALUE rcv, SEL sel, VALUE val)
+{
+    auto camera = CAMERA(rcv);
+    if (val == Qnil) {
+	camera->has_bounds = false;
+	return val;
+    }
+    if (!rb_obj_is_kind_of(val, rb_cArray) || RARRAY_LEN(val) != 4) {
+	rb_raise(rb_eArgError, "expected Array of 4 elements");
+    }
+    camera->bounds = cocos2d::Rect(NUM2DBL(RARRAY_AT(val, 0)),
+	    NUM2DBL(RARRAY_AT(val, 1)), NUM2DBL(RARRAY_AT(val, 2)),
+	    NUM2DBL(RARRAY_AT(val, 3)));
+    camera->has_bounds = true;
+    return val;
+}
+
+/// @property #zoom
+/// @return [Float] the zoom factor of the camera, values larger than +1+
+///   zoom in. The default value is +1+.
+
+static VALUE
+camera_zoom(VALUE rcv, SEL sel)
+{
+    return DBL2NUM(CAMERA(rcv)->zoom);
+}
+
+static VALUE
+camera_zoom_set(VALUE rcv, SEL sel, VALUE val)
+{
+    const float zoom = NUM2DBL(val);
+    if (zoom <= 0) {
+	rb_raise(rb_eArgError, "zoom must be positive");
+    }
+    CAMERA(rcv)->zoom = zoom;
+    return val;
+}
+
+/// @property #position
+/// @return [Point] the point of the world the camera is centered on,
+///   without the shake. Setting it moves the camera immediately, the target
+///   is then followed from there.
+
+static VALUE
+camera_position(VALUE rcv, SEL sel)
+{
+    return rb_ccvec2_to_obj(CAMERA(rcv)->center);
+}
+
+static VALUE
+camera_position_set(VALUE rcv, SEL sel, VALUE val)
+{
+    auto camera = CAMERA(rcv);
+    camera->center = rb_any_to_ccvec2(val);
+    camera->clamp();
+    camera->apply(cocos2d::Vec2::ZERO);
+    return val;
+}
+
+/// @method #shake(intensity, duration)
+/// Shakes the camera. The shake does not affect {#position} and fades out
+/// linearly. A new shake replaces the current one.
+/// @param intensity [Float] the maximum offset of the camera, in points.
+/// @param duration [Float] the duration of the shake, in seconds.
+/// @return [Camera] the receiver.
+
+static VALUE
+camera_shake(VALUE rcv, SEL sel, VALUE intensity, VALUE duration)
+{
+    auto camera = CAMERA(rcv);
+    camera->shake_intensity = NUM2DBL(intensity);
+    camera->shake_duration = NUM2DBL(duration);
+    camera->shake_elapsed = 0;
+    return rcv;
+}
+
+/// @group Spatial Queries
+
+/// @property-readonly #visible_rect
+/// @return [Array] the rectangle of the world visible on the screen, as an
+///   +[x, y, width, height]+ array.
+
+static VALUE
+camera_visible_rect(VALUE rcv, SEL sel)
+{
+    auto rect = rb_ccscene_visible_rect(CAMERA(rcv)->cocos2dScene());
+    VALUE ary = rb_ary_new();
+    rb_ary_push(ary, DBL2NUM(rect.origin.x));
+    rb_ary_push(ary, DBL2NUM(rect.origin.y));
+    rb_ary_push(ary, DBL2NUM(rect.size.width));
+    rb_ary_push(ary, DBL2NUM(rect.size.height));
+    return ary;
+}
+
+/// @method #visible?(node)
+/// @param node [Node] a node of the scene.
+/// @return [Boolean] whether the bounding box of the given node intersects
+///   with the visible rectangle.
+
+static VALUE
+camera_visible(VALUE rcv, SEL sel, VALUE node)
+{
+    auto ccnode = NODE(node);
+    auto rect = rb_ccscene_visible_rect(CAMERA(rcv)->cocos2dScene());
+    auto box = cocos2d::RectApplyAffineTransform(
+	    cocos2d::Rect(cocos2d::Vec2::ZERO, ccnode->getContentSize()),
+	    ccnode->getNodeToWorldAffineTransform());
+    return rect.intersectsRect(box) ? Qtrue : Qfalse;
+}
+
+/// @method #convert_to_world(point)
+/// Converts a point on the screen, for example the location of a touch, to
+/// a point of the world.
+/// @param point [Point] a point in screen coordinates.
+/// @return [Point] the point in world coordinates.
+
+static VALUE
+camera_convert_to_world(VALUE rcv, SEL sel, VALUE point)
+{
+    auto rect = rb_ccscene_visible_rect(CAMERA(rcv)->cocos2dScene());
+    auto director = cocos2d::Director::getInstance();
+    auto origin = director->getVisibleOrigin();
+    auto size = director->getVisibleSize();
+    auto screen = rb_any_to_ccvec2(point);
+    return rb_ccvec2_to_obj(cocos2d::Vec2(
+		rect.origin.x + (screen.x - origin.x) * rect.size.width
+		    / size.width,
+		rect.origin.y + (screen.y - origin.y) * rect.size.height
+		    / size.height));
+}
+
+/// @endgroup
+
+/// @class Scene < Node
+/// @property-readonly #camera
+/// @return [Camera] the camera of the scene.
+
+static VALUE
+scene_camera(VALUE rcv, SEL sel)
+{
+    return rb_cocos2d_object_new(mc_Camera::get(rb_any_to_scene(rcv)),
+	    rb_cCamera);
+}
+
+extern "C"
+void
+Init_Camera(void)
+{
+    rb_cCamera = rb_define_class_under(rb_mMC, "Camera", rb_cObject);
+    rb_register_cocos2d_object_finalizer(rb_cCamera);
+
+    rb_define_method(rb_cScene, "camera", scene_camera, 0);
+
+    rb_define_method(rb_cCamera, "target", camera_target, 0);
+    rb_define_method(rb_cCamera, "target=", camera_target_set, 1);
+    rb_define_method(rb_cCamera, "offset", camera_offset, 0);
+    rb_define_method(rb_cCamera, "offset=", camera_offset_set, 1);
+    rb_define_method(rb_cCamera, "smoothing", camera_smoothing, 0);
+    rb_define_method(rb_cCamera, "smoothing=", camera_smoothing_set, 1);
+    rb_define_method(rb_cCamera, "dead_zone", camera_dead_zone, 0);
+    rb_define_method(rb_cCamera, "dead_zone=", camera_dead_zone_set, 1);
+    rb_define_method(rb_cCamera, "bounds", camera_bounds, 0);
+    rb_define_method(rb_cCamera, "bounds=", camera_bounds_set, 1);
+    rb_define_method(rb_cCamera, "zoom", camera_zoom, 0);
+    rb_define_method(rb_cCamera, "zoom=", camera_zoom_set, 1);
+    rb_define_method(rb_cCamera, "position", camera_position, 0);
+    rb_define_method(rb_cCamera, "position=", camera_position_set, 1);
+    rb_define_method(rb_cCamera, "shake", camera_shake, 2);
+    rb_define_method(rb_cCamera, "visible_rect", camera_visible_rect, 0);
+    rb_define_method(rb_cCamera, "visible?", camera_visible, 1);
+    rb_define_method(rb_cCamera, "convert_to_world", camera_convert_to_world,
+	    1);
+}
@@ -0,0 +1,371 @@
+#include "rubymotion.h"
+#include "motion-game.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+// Pixel-perfect collisions for sprites whose collision shape is :alpha.
+//
+// A sprite frame is turned into a 1-bit mask of its opaque pixels, built
+// from the image file of its texture and cached by file and rectangle. The
+// masks of two sprites are compared 64 pixels at a time: directly when
+// their pixels have the same size and orientation in the world, otherwise
+// by sampling both masks over the intersection of their bounding boxes.
+
+#define ALPHA_THRESHOLD 128
+#define MAX_SAMPLES 1024
+
+struct mc_AlphaMask {
+    int width, height;
+    int words_per_row;
+    // Rows from the bottom of the frame, with an extra zero word at the end
+    // of each row so that unaligned reads never go past it.
+    std::vector<uint64_t> bits;
+
+    const uint64_t *row(int y) const {
+	return &bits[(size_t)y * words_per_row];
+    }
+
+    bool test(int x, int y) const {
+	return (row(y)[x >> 6] >> (x & 63)) & 1;
+    }
+
+    // 64 bits of a row starting at bit x, which must be within the row.
+    uint64_t word(int y, int x) const {
+	const uint64_t *r = row(y);
+	const int shift = x & 63;
+	const uint64_t low = r[x >> 6] >> shift;
+	return shift == 0 ? low : low | (r[(x >> 6) + 1] << (64 - shift));
+    }
+};
+
+static std::unordered_map<std::string, mc_AlphaMask *> alpha_masks;
+
+// The last decoded image, since the frames of a spritesheet are usually
+// needed one after the other. It is released on the next frame, once the
+// masks needed by the current one are built.
+static cocos2d::Image *alpha_image = NULL;
+static std::string alpha_image_path;
+static bool alpha_image_release_scheduled = false;
+
+static cocos2d::Image *
+alpha_mask_image(const std::string &path)
+{
+    if (alpha_image == NULL || alpha_image_path != path) {
+	CC_SAFE_RELEASE_NULL(alpha_image);
+	alpha_image = new cocos2d::Image();
+	if (!alpha_image->initWithImageFile(path)
+		|| alpha_image->isCompressed()) {
+	    CC_SAFE_RELEASE_NULL(alpha_image);
+	    return NULL;
+	}
+	alpha_image_path = path;
+	if (!alpha_image_release_scheduled) {
+	    alpha_image_release_scheduled = true;
+	    cocos2d::Director::getInstance()->getScheduler()
+		->performFunctionInCocosThread([]() {
+		    CC_SAFE_RELEASE_NULL(alpha_image);
+		    alpha_image_release_scheduled = false;
+		});
+	}
+    }
+    return alpha_image;
+}
+
+static const mc_AlphaMask *
+sprite_alpha_mask(cocos2d::Sprite *sprite)
+{
+    auto texture = sprite->getTexture();
+    if (texture == NULL) {
+	return NULL;
+    }
+    const cocos2d::Rect rect =
+	CC_RECT_POINTS_TO_PIXELS(sprite->getTextureRect());
+    const bool rotated = sprite->isTextureRectRotated();
+    const int x0 = lroundf(rect.origin.x), y0 = lroundf(rect.origin.y);
+    const int width = lroundf(rect.size.width);
+    const int height = lroundf(rect.size.height);
+    if (width <= 0 || height <= 0) {
+	return NULL;
+    }
+
+    std::string path;
+    int src_x = x0, src_y = y0;
+    if (!rb_cctexture_source(texture, path, src_x, src_y)) {
+	return NULL;
+    }
+    char key_suffix[64];
+    snprintf(key_suffix, sizeof key_suffix, "@%d,%d,%d,%d%s", src_x, src_y,
+	    width, height, rotated ? "r" : "");
+    const std::string key = path + key_suffix;
+    auto iter = alpha_masks.find(key);
+    if (iter != alpha_masks.end()) {
+	return iter->second;
+    }
+
+    auto image = alpha_mask_image(path);
+    if (image == NULL) {
+	return NULL;
+    }
+    int channels = 0, alpha = 0;
+    switch (image->getRenderFormat()) {
+      case cocos2d::Texture2D::PixelFormat::RGBA8888:
+	channels = 4;
+	alpha = 3;
+	break;
+      case cocos2d::Texture2D::PixelFormat::AI88:
+	channels = 2;
+	alpha = 1;
+	break;
+      case cocos2d::Texture2D::PixelFormat::A8:
+	channels = 1;
+	alpha = 0;
+	break;
+      default:
+	// No alpha channel, every pixel is opaque.
+	break;
+    }
+    const int image_width = image->getWidth();
+    const int image_height = image->getHeight();
+    if (src_x < 0 || src_y < 0
+	    || src_x + (rotated ? height : width) > image_width
+	    || src_y + (rotated ? width : height) > image_height) {
+	return NULL;
+    }
+
+    auto mask = new mc_AlphaMask();
+    mask->width = width;
+    mask->height = height;
+    mask->words_per_row = (width + 63) / 64 + 1;
+    mask->bits.assign((size_t)mask->words_per_row * height, 0);
+    const unsigned char *data = image->getData();
+    for (int my = 0; my < height; my++) {
+	uint64_t *row = &mask->bits[(size_t)my * mask->words_per_row];
+	for (int mx = 0; mx < width; mx++) {
+	    bool opaque = true;
+	    if (channels > 0) {
+		// Image rows go from the top. Rotated frames are stored
+		// turned by 90 degrees clockwise.
+		const int tx = rotated ? src_x + my : src_x + mx;
+		const int ty = rotated ? src_y + mx : src_y + height - 1 - my;
+		opaque = data[((size_t)ty * image_width + tx) * channels
+		    + alpha] >= ALPHA_THRESHOLD;
+	    }
+	    if (opaque) {
+		row[mx >> 6] |= (uint64_t)1 << (mx & 63);
+	    }
+	}
+    }
+    alpha_masks[key] = mask;
+    return mask;
+}
+
+extern "C"
+bool
+rb_ccsprite_alpha_mask_available(cocos2d::Sprite *sprite)
+{
+    return sprite_alpha_mask(sprite) != NULL;
+}
+
+// A shape in world coordinates: the cell (x, y) of a width by height grid is
+// centered on origin + x * ex + y * ey. Without a mask every cell is solid.
+
+struct mc_Shape {
+    const mc_AlphaMask *mask;
+    int width, height;
+    cocos2d::Vec2 origin, ex, ey;
+    // Inverse of the [ex ey] matrix.
+    float inv[4];
+
+    void init(cocos2d::Node *node) {
+	cocos2d::Vec2 local_origin, local_ex, local_ey;
+	auto sprite = dynamic_cast<cocos2d::Sprite *>(node);
+	mask = sprite != NULL && rb_ccsprite_alpha_shape(sprite)
+	    ? sprite_alpha_mask(sprite) : NULL;
+	if (mask != NULL) {
+	    // The mask covers the quad of the sprite, which is smaller than
+	    // its content size when the frame is trimmed.
+	    const cocos2d::Size size = sprite->getTextureRect().size;
+	    width = mask->width;
+	    height = mask->height;
+	    const float px = size.width / width, py = size.height / height;
+	    const cocos2d::Vec2 offset = sprite->getOffsetPosition();
+	    const bool fx = sprite->isFlippedX(), fy = sprite->isFlippedY();
+	    local_ex = cocos2d::Vec2(fx ? -px : px, 0);
+	    local_ey = cocos2d::Vec2(0, fy ? -py : py);
+	    local_origin = cocos2d::Vec2(
+		    offset.x + (fx ? size.width - px / 2 : px / 2),
+		    offset.y + (fy ? size.height - py / 2 : py / 2));
+	}
+	else {
+	    // The content box, with cells of one point.
+	    const cocos2d::Size size = node->getContentSize();
+	    width = std::max(1, (int)ceilf(size.width));
+	    height = std::max(1, (int)ceilf(size.height));
+	    local_ex = cocos2d::Vec2(size.width / width, 0);
+	    local_ey = cocos2d::Vec2(0, size.height / height);
+	    local_origin = (local_ex + local_ey) / 2;
+	}
+
+	const cocos2d::AffineTransform t =
+	    node->getNodeToWorldAffineTransform();
+	origin = cocos2d::PointApplyAffineTransform(local_origin, t);
+	ex = cocos2d::Vec2(t.a * local_ex.x + t.c * local_ex.y,
+		t.b * local_ex.x + t.d * local_ex.y);
+	ey = cocos2d::Vec2(t.a * local_ey.x + t.c * local_ey.y,
+		t.b * local_ey.x + t.d * local_ey.y);
+	const float det = ex.x * ey.y - ey.x * ex.y;
+	if (det == 0) {
+	    inv[0] = inv[1] = inv[2] = inv[3] = 0;
+	}
+	else {
+	    inv[0] = ey.y / det;
+	    inv[1] = -ey.x / det;
+	    inv[2] = -ex.y / det;
+	    inv[3] = ex.x / det;
+	}
+    }
+
+    bool empty(void) const {
+	return inv[0] == 0 && inv[1] == 0 && inv[2] == 0 && inv[3] == 0;
+    }
+
+    // Grid coordinates of a world point.
+    cocos2d::Vec2 cell(const cocos2d::Vec2 &p) const {
+	const cocos2d::Vec2 d = p - origin;
+	return cocos2d::Vec2(inv[0] * d.x + inv[1] * d.y,
+		inv[2] * d.x + inv[3] * d.y);
+    }
+
+    cocos2d::Vec2 cell_delta(const cocos2d::Vec2 &d) const {
+	return cocos2d::Vec2(inv[0] * d.x + inv[1] * d.y,
+		inv[2] * d.x + inv[3] * d.y);
+    }
+
+    bool test(float fx, float fy) const {
+	const int x = (int)floorf(fx + 0.5f), y = (int)floorf(fy + 0.5f);
+	if (x < 0 || y < 0 || x >= width || y >= height) {
+	    return false;
+	}
+	return mask == NULL || mask->test(x, y);
+    }
+
+    cocos2d::Rect bounds(void) const {
+	cocos2d::Vec2 corners[4] = {
+	    origin - (ex + ey) / 2,
+	    origin - (ex + ey) / 2 + ex * width,
+	    origin - (ex + ey) / 2 + ey * height,
+	    origin - (ex + ey) / 2 + ex * width + ey * height
+	};
+	float min_x = corners[0].x, max_x = corners[0].x;
+	float min_y = corners[0].y, max_y = corners[0].y;
+	for (int i = 1; i < 4; i++) {
+	    min_x = std::min(min_x, corners[i].x);
+	    max_x = std::max(max_x, corners[i].x);
+	    min_y = std::min(min_y, corners[i].y);
+	    max_y = std::max(max_y, corners[i].y);
+	}
+	return cocos2d::Rect(min_x, min_y, max_x - min_x, max_y - min_y);
+    }
+};
+
+static bool
+same_vector(const cocos2d::Vec2 &a, const cocos2d::Vec2 &b)
+{
+    const float epsilon = 1e-3f * std::max(a.length(), b.length());
+    return fabsf(a.x - b.x) <= epsilon && fabsf(a.y - b.y) <= epsilon;
+}
+
+// Both masks have the same pixel size and orientation, so the pixels of b
+// are the pixels of a shifted by a whole number of cells.
+static bool
+masks_intersect_aligned(const mc_Shape &a, const mc_Shape &b)
+{
+    const cocos2d::Vec2 d = a.cell(b.origin);
+    const int dx = (int)floorf(d.x + 0.5f), dy = (int)floorf(d.y + 0.5f);
+    const int x0 = std::max(0, dx), x1 = std::min(a.width, b.width + dx);
+    const int y0 = std::max(0, dy), y1 = std::min(a.height, b.height + dy);
+    for (int y = y0; y < y1; y++) {
+	for (int x = x0; x < x1; x += 64) {
+	    uint64_t bits = a.mask->word(y, x) & b.mask->word(y - dy, x - dx);
+	    if (x1 - x < 64) {
+		bits &= ((uint64_t)1 << (x1 - x)) - 1;
+	    }
+	    if (bits != 0) {
+		return true;
+	    }
+	}
+    }
+    return false;
+}
+
+// Samples both shapes over the intersection of their bounds, one row of
+// cells at a time, and compares the rows 64 cells at a time.
+static bool
+shapes_intersect_sampled(const mc_Shape &a, const mc_Shape &b)
+{
+    const cocos2d::Rect area = a.bounds().intersection(b.bounds());
+    if (area.size.width <= 0 || area.size.height <= 0) {
+	return false;
+    }
+    float step = std::min(std::min(a.ex.length(), a.ey.length()),
+	    std::min(b.ex.length(), b.ey.length()));
+    step = std::max(step, std::max(area.size.width, area.size.height)
+	    / MAX_SAMPLES);
+    const int cols = std::max(1, (int)ceilf(area.size.width / step));
+    const int rows = std::max(1, (int)ceilf(area.size.height / step));
+    const int words = (cols + 63) / 64;
+    std::vector<uint64_t> row_a(words), row_b(words);
+
+    const cocos2d::Vec2 step_x(step, 0);
+    const cocos2d::Vec2 da = a.cell_delta(step_x), db = b.cell_delta(step_x);
+    for (int j = 0; j < rows; j++) {
+	const cocos2d::Vec2 start = area.origin
+	    + cocos2d::Vec2(step / 2, (j + 0.5f) * step);
+	cocos2d::Vec2 ca = a.cell(start), cb = b.cell(start);
+	std::fill(row_a.begin(), row_a.end(), 0);
+	std::fill(row_b.begin(), row_b.end(), 0);
+	for (int i = 0; i < cols; i++) {
+	    const uint64_t bit = (uint64_t)1 << (i & 63);
+	    if (a.test(ca.x, ca.y)) {
+		row_a[i >> 6] |= bit;
+	    }
+	    if (b.test(cb.x, cb.y)) {
+		row_b[i >> 6] |= bit;
+	    }
+	    ca += da;
+	    cb += db;
+	}
+	for (int w = 0; w < words; w++) {
+	    if (row_a[w] & row_b[w]) {
+		return true;
+	    }
+	}
+    }
+    return false;
+}
+
+// Refines Node#intersects? once the bounding boxes intersect.
+extern "C"
+bool
+rb_ccnode_shapes_intersect(cocos2d::Node *node1, cocos2d::Node *node2)
+{
+    auto sprite1 = dynamic_cast<cocos2d::Sprite *>(node1);
+    auto sprite2 = dynamic_cast<cocos2d::Sprite *>(node2);
+    if ((sprite1 == NULL || !rb_ccsprite_alpha_shape(sprite1))
+	    && (sprite2 == NULL || !rb_ccsprite_alpha_shape(sprite2))) {
+	return true;
+    }
+
+    mc_Shape a, b;
+    a.init(node1);
+    b.init(node2);
+    if (a.empty() || b.empty()) {
+	return false;
+    }
+    if (a.mask != NULL && b.mask != NULL && same_vector(a.ex, b.ex)
+	    && same_vector(a.ey, b.ey)) {
+	return masks_intersect_aligned(a, b);
+    }
+    return shapes_intersect_sampled(a, b);
+}
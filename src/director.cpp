@@ -34,6 +34,7 @@ static VALUE
 director_run(VALUE rcv, SEL sel, VALUE obj)
 {
     director_using_scene[0] = rb_retain(obj);
+    rb_scene_update_physics_speed(obj);
     DIRECTOR(rcv)->runWithScene(rb_any_to_scene(obj));
     return rcv;
 }
@@ -49,6 +50,7 @@ director_replace(VALUE rcv, SEL sel, VALUE obj)
 {
     rb_release(director_using_scene[0]);
     director_using_scene[0] = rb_retain(obj);
+    rb_scene_update_physics_speed(obj);
     DIRECTOR(rcv)->replaceScene(rb_any_to_scene(obj));
     return rcv;
 }
@@ -63,6 +65,7 @@ static VALUE
 director_push(VALUE rcv, SEL sel, VALUE obj)
 {
     director_using_scene.push_back(rb_retain(obj));
+    rb_scene_update_physics_speed(obj);
     DIRECTOR(rcv)->pushScene(rb_any_to_scene(obj));
     return rcv;
 }
@@ -203,6 +206,34 @@ director_content_scale_factor_set(VALUE rcv, SEL sel, VALUE scale)
     return scale;
 }
 
+/// @property #time_scale
+/// The speed at which time passes in the application, for slow motion
+/// effects. Actions, particles, scheduled blocks, the {Scene#update} loop
+/// and the physics world all follow it. See also {Node#time_scale}.
+/// @return [Float] the time scale, 1.0 by default.
+
+static VALUE
+director_time_scale(VALUE rcv, SEL sel)
+{
+    return DBL2NUM(DIRECTOR(rcv)->getScheduler()->getTimeScale());
+}
+
+static VALUE
+director_time_scale_set(VALUE rcv, SEL sel, VALUE val)
+{
+    const float scale = NUM2DBL(val);
+    if (scale < 0) {
+	rb_raise(rb_eArgError, "time scale must not be negative");
+    }
+    DIRECTOR(rcv)->getScheduler()->setTimeScale(scale);
+    for (auto scene : director_using_scene) {
+	if (scene != 0) {
+	    rb_scene_update_physics_speed(scene);
+	}
+    }
+    return val;
+}
+
 /// @property-readonly #glview
 /// @return [GLView] a GLView instance.
 
@@ -253,6 +284,8 @@ Init_Director(void)
     rb_define_method(rb_cDirector, "show_stats?", director_show_stats, 0);
     rb_define_method(rb_cDirector, "content_scale_factor", director_content_scale_factor, 0);
     rb_define_method(rb_cDirector, "content_scale_factor=", director_content_scale_factor_set, 1);
+    rb_define_method(rb_cDirector, "time_scale", director_time_scale, 0);
+    rb_define_method(rb_cDirector, "time_scale=", director_time_scale_set, 1);
     rb_define_method(rb_cDirector, "glview", director_glview, 0);
 
     // Internal.
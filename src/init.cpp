@@ -155,6 +155,15 @@ Init_Fluency(void)
     INIT_MODULE(Types)
     INIT_MODULE(UI)
     INIT_MODULE(FileUtils)
+    INIT_MODULE(Prefab)
+    INIT_MODULE(Loader)
+    INIT_MODULE(DynamicAtlas)
+    INIT_MODULE(TextureCache)
+    INIT_MODULE(Tween)
+    INIT_MODULE(Timeline)
+    INIT_MODULE(FollowPath)
+    INIT_MODULE(Animator)
+    INIT_MODULE(Camera)
 
 #undef INIT_MODULE
 #undef ADD_FRAME
@@ -1,6 +1,8 @@
 #include "rubymotion.h"
 #include "motion-game.h"
 #include <dlfcn.h>
+#include <unordered_map>
+#include <unordered_set>
 
 /// @class Scene < Node
 /// This class represents a scene, an independent screen or stage of the
@@ -25,16 +27,290 @@ enum mc_Scene_EventType {
     ON_CANCEL
 };
 
+// A quadtree of world-space bounding boxes, used for viewport culling. Entries
+// are updated in place when their node changed, and retain their node.
+// Entries of nodes which left the scene without being removed explicitly are
+// dropped by a sweep which checks a few entries every frame, so the tree is
+// maintained incrementally across frames instead of being rebuilt or
+// scanned.
+
+class mc_Quadtree {
+    struct Item {
+	cocos2d::Node *node;
+	cocos2d::Rect rect;
+    };
+
+    struct Cell {
+	cocos2d::Rect bounds;
+	int depth;
+	std::vector<Item> items;
+	Cell *children[4];
+
+	Cell(const cocos2d::Rect &_bounds, int _depth) {
+	    bounds = _bounds;
+	    depth = _depth;
+	    children[0] = children[1] = children[2] = children[3] = NULL;
+	}
+
+	~Cell() {
+	    for (int i = 0; i < 4; i++) {
+		delete children[i];
+	    }
+	}
+    };
+
+    struct Entry {
+	cocos2d::Rect rect;
+	Cell *cell;
+	size_t index;
+    };
+
+    static const int max_items = 8;
+    static const int max_depth = 10;
+
+    Cell root;
+    std::unordered_map<cocos2d::Node *, Entry> entries;
+    std::vector<cocos2d::Node *> nodes;
+    size_t sweep_pos;
+
+    static bool contains(const cocos2d::Rect &outer, const cocos2d::Rect &inner) {
+	return inner.getMinX() >= outer.getMinX()
+	    && inner.getMaxX() <= outer.getMaxX()
+	    && inner.getMinY() >= outer.getMinY()
+	    && inner.getMaxY() <= outer.getMaxY();
+    }
+
+    void subdivide(Cell *cell) {
+	float width = cell->bounds.size.width / 2;
+	float height = cell->bounds.size.height / 2;
+	float x = cell->bounds.origin.x;
+	float y = cell->bounds.origin.y;
+	cell->children[0] = new Cell(cocos2d::Rect(x, y, width, height), cell->depth + 1);
+	cell->children[1] = new Cell(cocos2d::Rect(x + width, y, width, height), cell->depth + 1);
+	cell->children[2] = new Cell(cocos2d::Rect(x, y + height, width, height), cell->depth + 1);
+	cell->children[3] = new Cell(cocos2d::Rect(x + width, y + height, width, height), cell->depth + 1);
+
+	std::vector<Item> items;
+	items.swap(cell->items);
+	for (auto &item : items) {
+	    Cell *child = child_containing(cell, item.rect);
+	    if (child == NULL) {
+		child = cell;
+	    }
+	    child->items.push_back(item);
+	    entries[item.node].cell = child;
+	}
+    }
+
+    Cell *child_containing(Cell *cell, const cocos2d::Rect &rect) {
+	for (int i = 0; i < 4; i++) {
+	    if (contains(cell->children[i]->bounds, rect)) {
+		return cell->children[i];
+	    }
+	}
+	return NULL;
+    }
+
+    Cell *insert(cocos2d::Node *node, const cocos2d::Rect &rect) {
+	Cell *cell = &root;
+	while (true) {
+	    if (cell->children[0] == NULL) {
+		if ((int)cell->items.size() < max_items || cell->depth >= max_depth) {
+		    break;
+		}
+		subdivide(cell);
+	    }
+	    Cell *child = child_containing(cell, rect);
+	    if (child == NULL) {
+		break;
+	    }
+	    cell = child;
+	}
+	Item item;
+	item.node = node;
+	item.rect = rect;
+	cell->items.push_back(item);
+	return cell;
+    }
+
+    void remove(Cell *cell, cocos2d::Node *node) {
+	for (auto iter = cell->items.begin(); iter != cell->items.end(); ++iter) {
+	    if (iter->node == node) {
+		*iter = cell->items.back();
+		cell->items.pop_back();
+		return;
+	    }
+	}
+    }
+
+    template <typename F> void query(Cell *cell, const cocos2d::Rect &rect, F &func) {
+	// Items that do not fit in the root bounds are kept in the root cell.
+	if (cell != &root && !cell->bounds.intersectsRect(rect)) {
+	    return;
+	}
+	for (auto &item : cell->items) {
+	    if (item.rect.intersectsRect(rect)) {
+		func(item.node);
+	    }
+	}
+	if (cell->children[0] != NULL) {
+	    for (int i = 0; i < 4; i++) {
+		query(cell->children[i], rect, func);
+	    }
+	}
+    }
+
+  public:
+    mc_Quadtree(const cocos2d::Rect &bounds) : root(bounds, 0) {
+	sweep_pos = 0;
+    }
+
+    ~mc_Quadtree() {
+	for (auto node : nodes) {
+	    node->release();
+	}
+    }
+
+    const cocos2d::Rect &bounds(void) const {
+	return root.bounds;
+    }
+
+    const std::vector<cocos2d::Node *> &all(void) const {
+	return nodes;
+    }
+
+    bool contains(cocos2d::Node *node) const {
+	return entries.find(node) != entries.end();
+    }
+
+    void update(cocos2d::Node *node, const cocos2d::Rect &rect) {
+	auto iter = entries.find(node);
+	if (iter != entries.end()) {
+	    if (iter->second.rect.equals(rect)) {
+		return;
+	    }
+	    remove(iter->second.cell, node);
+	    iter->second.rect = rect;
+	    iter->second.cell = insert(node, rect);
+	    return;
+	}
+	Entry entry;
+	entry.rect = rect;
+	entry.index = nodes.size();
+	entry.cell = NULL;
+	node->retain();
+	nodes.push_back(node);
+	entries[node] = entry;
+	Cell *cell = insert(node, rect);
+	entries[node].cell = cell;
+    }
+
+    void remove(cocos2d::Node *node) {
+	auto iter = entries.find(node);
+	if (iter == entries.end()) {
+	    return;
+	}
+	remove(iter->second.cell, node);
+	const size_t index = iter->second.index;
+	entries.erase(iter);
+	if (index + 1 != nodes.size()) {
+	    nodes[index] = nodes.back();
+	    entries[nodes[index]].index = index;
+	}
+	nodes.pop_back();
+	node->release();
+    }
+
+    // Checks up to count entries, in a round-robin fashion, and drops the
+    // ones for which the given predicate is true.
+    template <typename F> void sweep(size_t count, F stale) {
+	for (size_t i = 0; i < count && !nodes.empty(); i++) {
+	    if (sweep_pos >= nodes.size()) {
+		sweep_pos = 0;
+	    }
+	    auto node = nodes[sweep_pos];
+	    if (stale(node)) {
+		remove(node);
+	    }
+	    else {
+		sweep_pos++;
+	    }
+	}
+    }
+
+    template <typename F> void query(const cocos2d::Rect &rect, F func) {
+	query(&root, rect, func);
+    }
+};
+
+// The rectangle of the world (in the coordinates of the cocos2d scene) that
+// is currently visible through the default camera.
+extern "C"
+cocos2d::Rect
+rb_ccscene_visible_rect(cocos2d::Scene *scene)
+{
+    auto director = cocos2d::Director::getInstance();
+    auto origin = director->getVisibleOrigin();
+    auto size = director->getVisibleSize();
+    auto win_size = director->getWinSize();
+    float zoom = 1;
+    cocos2d::Vec2 offset;
+    auto camera = scene->getDefaultCamera();
+    if (camera != NULL) {
+	auto position = camera->getPosition3D();
+	if (position.z > 0) {
+	    zoom = director->getZEye() / position.z;
+	}
+	offset.x = position.x - win_size.width / 2;
+	offset.y = position.y - win_size.height / 2;
+    }
+    float width = size.width / zoom;
+    float height = size.height / zoom;
+    float center_x = origin.x + size.width / 2 + offset.x;
+    float center_y = origin.y + size.height / 2 + offset.y;
+    return cocos2d::Rect(center_x - width / 2, center_y - height / 2,
+	    width, height);
+}
+
+// Culling keeps the visible flag of the off-screen subtrees cleared across
+// frames, so that the visit of the scene skips them without walking them.
+// Only the nodes reported by rb_scene_node_changed(), and the nodes of moving
+// physics bodies, have their bounds refreshed. The nodes on screen are found
+// with the quadtree and compared with the ones of the previous frame: the
+// subtrees which left the screen are hidden, the ones which entered it are
+// shown again.
+
+class mc_Scene;
+static std::unordered_set<cocos2d::Node *> culled_nodes;
+static std::unordered_map<cocos2d::Node *, mc_Scene *> culling_scenes;
+
 class mc_Scene : public cocos2d::LayerColor {
     public:
 	cocos2d::Scene *scene;
 	VALUE obj;
 	SEL update_sel;
     cocos2d::EventListenerTouchOneByOne *touch_listener;
+	mc_Quadtree *quadtree;
+	unsigned long culled_count;
+	unsigned long visited_count;
+	bool needs_refresh;
+	unsigned long frame;
+	// Retained until their bounds are refreshed.
+	std::unordered_set<cocos2d::Node *> dirty_nodes;
+	// The frame in which the nodes were last on screen, and the nodes on
+	// screen during the current and the previous frames, retained.
+	std::unordered_map<cocos2d::Node *, unsigned long> visible_frames;
+	std::vector<cocos2d::Node *> visible_nodes;
+	std::vector<cocos2d::Node *> previous_visible_nodes;
+	std::vector<cocos2d::Node *> refreshed_nodes;
 
     mc_Scene() {
 	obj = Qnil;
 	touch_listener = NULL;
+	quadtree = NULL;
+	culled_count = visited_count = 0;
+	needs_refresh = false;
+	frame = 0;
 #if CC_TARGET_OS_IPHONE || CC_TARGET_OS_APPLETV
 	update_sel = rb_selector("update:");
 #else
@@ -49,16 +325,235 @@ class mc_Scene : public cocos2d::LayerColor {
     }
 
     virtual void update(float delta) {
+	delta *= rb_ccnode_time_scale(this);
 	LayerColor::update(delta);
 	VALUE arg = DBL2NUM(delta);
 	rb_send(obj, update_sel, 1, &arg);
     }
 
+    virtual ~mc_Scene() {
+	if (quadtree != NULL) {
+	    stopCulling();
+	}
+    }
+
     void setBackgroundColor(cocos2d::Color3B color) {
 	setColor(color);
 	updateColor();
     }
 
+    cocos2d::Rect visibleRect(void) {
+	return rb_ccscene_visible_rect(scene);
+    }
+
+    void setCulling(bool flag) {
+	if (flag && quadtree == NULL) {
+	    quadtree = new mc_Quadtree(cocos2d::Rect(-65536, -65536, 131072, 131072));
+	    culling_scenes[this] = this;
+	    needs_refresh = true;
+	}
+	else if (!flag && quadtree != NULL) {
+	    stopCulling();
+	}
+    }
+
+    void stopCulling(void) {
+	for (auto node : quadtree->all()) {
+	    uncull(node);
+	}
+	for (auto node : dirty_nodes) {
+	    node->release();
+	}
+	dirty_nodes.clear();
+	for (auto node : visible_nodes) {
+	    node->release();
+	}
+	visible_nodes.clear();
+	for (auto node : previous_visible_nodes) {
+	    node->release();
+	}
+	previous_visible_nodes.clear();
+	visible_frames.clear();
+	refreshed_nodes.clear();
+	delete quadtree;
+	quadtree = NULL;
+	culling_scenes.erase(this);
+	culled_count = visited_count = 0;
+    }
+
+    // Whether the transform or the content size of the node changed since
+    // it was last visited.
+    static bool transformUpdated(cocos2d::Node *node) {
+	return node->*(&mc_Scene::_transformUpdated);
+    }
+
+    // The visible flag is set directly, as setVisible() would mark the
+    // transforms as dirty.
+    static void setVisibleFlag(cocos2d::Node *node, bool flag) {
+	node->*(&mc_Scene::_visible) = flag;
+    }
+
+    void uncull(cocos2d::Node *node) {
+	if (culled_nodes.erase(node) > 0) {
+	    setVisibleFlag(node, true);
+	    culled_count--;
+	}
+    }
+
+    // Hides an off-screen node. Its descendants are hidden as well when they
+    // leave the screen, so that they stay hidden if the node comes back.
+    void cull(cocos2d::Node *node) {
+	if (!node->isVisible() || !node->isRunning()
+		|| !quadtree->contains(node)) {
+	    return;
+	}
+	if (culled_nodes.insert(node).second) {
+	    culled_count++;
+	}
+	setVisibleFlag(node, false);
+    }
+
+    void markDirty(cocos2d::Node *node) {
+	if (dirty_nodes.insert(node).second) {
+	    node->retain();
+	}
+    }
+
+    // Computes the world bounding boxes of the node and its descendants.
+    // Nodes without a content size (draw nodes, particles, containers) may
+    // draw anywhere, so they cover the whole tree and are never culled.
+    void refreshBounds(cocos2d::Node *node,
+	    const cocos2d::AffineTransform &parent_transform) {
+	auto transform = cocos2d::AffineTransformConcat(
+		node->getNodeToParentAffineTransform(), parent_transform);
+	auto size = node->getContentSize();
+	quadtree->update(node, size.width > 0 && size.height > 0
+		? cocos2d::RectApplyAffineTransform(
+		    cocos2d::Rect(0, 0, size.width, size.height), transform)
+		: quadtree->bounds());
+	refreshed_nodes.push_back(node);
+	for (auto child : node->getChildren()) {
+	    refreshBounds(child, transform);
+	}
+    }
+
+    // Forgets a node and its descendants, before they are removed.
+    void detach(cocos2d::Node *node) {
+	uncull(node);
+	quadtree->remove(node);
+	visible_frames.erase(node);
+	for (auto child : node->getChildren()) {
+	    detach(child);
+	}
+    }
+
+    bool isDescendant(cocos2d::Node *node) {
+	for (node = node->getParent(); node != NULL; node = node->getParent()) {
+	    if (node == this) {
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    void markVisible(cocos2d::Node *node) {
+	while (node != NULL && node != this) {
+	    auto &last_frame = visible_frames[node];
+	    if (last_frame == frame) {
+		break;
+	    }
+	    last_frame = frame;
+	    node->retain();
+	    visible_nodes.push_back(node);
+	    uncull(node);
+	    node = node->getParent();
+	}
+    }
+
+    void refresh(void) {
+	if (needs_refresh || transformUpdated(this)) {
+	    needs_refresh = false;
+	    for (auto node : dirty_nodes) {
+		node->release();
+	    }
+	    dirty_nodes.clear();
+	    auto transform = getNodeToWorldAffineTransform();
+	    for (auto child : getChildren()) {
+		refreshBounds(child, transform);
+	    }
+	    return;
+	}
+
+	// Physics bodies move their nodes directly.
+	auto world = scene->getPhysicsWorld();
+	if (world != NULL) {
+	    for (auto body : world->getAllBodies()) {
+		if (body->getNode() != NULL && body->isDynamic()
+			&& !body->isResting()) {
+		    markDirty(body->getNode());
+		}
+	    }
+	}
+
+	std::unordered_set<cocos2d::Node *> nodes;
+	nodes.swap(dirty_nodes);
+	for (auto node : nodes) {
+	    if (node->isRunning() && isDescendant(node)) {
+		refreshBounds(node,
+			node->getParent()->getNodeToWorldAffineTransform());
+	    }
+	    node->release();
+	}
+    }
+
+    virtual void visit(cocos2d::Renderer *renderer,
+	    const cocos2d::Mat4 &parent_transform,
+	    uint32_t parent_flags) override {
+	if (quadtree == NULL || !isVisible()) {
+	    cocos2d::LayerColor::visit(renderer, parent_transform, parent_flags);
+	    return;
+	}
+
+	frame++;
+	refresh();
+	quadtree->query(visibleRect(), [this](cocos2d::Node *node) {
+		if (node->isRunning()) {
+		    markVisible(node);
+		}
+	    });
+
+	// Hide the nodes which were on screen in the previous frame, or were
+	// refreshed, and are not anymore.
+	for (auto node : previous_visible_nodes) {
+	    auto iter = visible_frames.find(node);
+	    if (iter != visible_frames.end() && iter->second != frame) {
+		visible_frames.erase(iter);
+		cull(node);
+	    }
+	    node->release();
+	}
+	previous_visible_nodes.clear();
+	previous_visible_nodes.swap(visible_nodes);
+	for (auto node : refreshed_nodes) {
+	    if (visible_frames.find(node) == visible_frames.end()) {
+		cull(node);
+	    }
+	}
+	refreshed_nodes.clear();
+
+	quadtree->sweep(32, [this](cocos2d::Node *node) {
+		if (node->isRunning() && isDescendant(node)) {
+		    return false;
+		}
+		uncull(node);
+		visible_frames.erase(node);
+		return true;
+	    });
+	visited_count = previous_visible_nodes.size();
+
+	cocos2d::LayerColor::visit(renderer, parent_transform, parent_flags);
+    }
+
 #if CC_TARGET_OS_IPHONE && TARGET_IPHONE_SIMULATOR
     virtual void onEnter() {
 	cocos2d::LayerColor::onEnter();
@@ -69,6 +564,71 @@ class mc_Scene : public cocos2d::LayerColor {
 
 #define SCENE(obj) _COCOS_WRAP_GET(obj, mc_Scene)
 
+static mc_Scene *
+culling_scene_of(cocos2d::Node *node)
+{
+    for (node = node->getParent(); node != NULL; node = node->getParent()) {
+	auto iter = culling_scenes.find(node);
+	if (iter != culling_scenes.end()) {
+	    return iter->second;
+	}
+    }
+    return NULL;
+}
+
+// Called when the transform, the size or the children of a node changed, so
+// that its bounds are refreshed before the next frame.
+extern "C"
+void
+rb_scene_node_changed(cocos2d::Node *node)
+{
+    if (!culling_scenes.empty()) {
+	auto scene = culling_scene_of(node);
+	if (scene != NULL) {
+	    scene->markDirty(node);
+	}
+    }
+}
+
+// Called before a node is removed from its parent.
+extern "C"
+void
+rb_scene_node_removed(cocos2d::Node *node)
+{
+    if (!culling_scenes.empty()) {
+	auto scene = culling_scene_of(node);
+	if (scene != NULL) {
+	    scene->detach(node);
+	}
+    }
+}
+
+// Whether the visible flag of the node is only cleared by culling.
+extern "C"
+bool
+rb_scene_node_culled(cocos2d::Node *node)
+{
+    return !culled_nodes.empty() && culled_nodes.find(node) != culled_nodes.end();
+}
+
+// Sets the visible flag of a culled node again, before the application
+// changes it.
+extern "C"
+void
+rb_scene_node_uncull(cocos2d::Node *node)
+{
+    if (rb_scene_node_culled(node)) {
+	auto scene = culling_scene_of(node);
+	if (scene != NULL) {
+	    scene->uncull(node);
+	}
+	else {
+	    culled_nodes.erase(node);
+	    mc_Scene::setVisibleFlag(node, true);
+	}
+    }
+}
+
 extern "C"
 cocos2d::Scene *
 rb_any_to_scene(VALUE obj)
@@ -79,6 +639,23 @@ rb_any_to_scene(VALUE obj)
     rb_raise(rb_eArgError, "expected Scene object");
 }
 
+// The physics world is stepped by the director with the unscaled frame time,
+// its speed follows the time scales of the director and the scene instead.
+extern "C"
+void
+rb_scene_update_physics_speed(VALUE obj)
+{
+    if (!rb_obj_is_kind_of(obj, rb_cScene)) {
+	return;
+    }
+    auto layer = SCENE(obj);
+    auto world = layer->scene->getPhysicsWorld();
+    if (world != NULL) {
+	world->setSpeed(cocos2d::Director::getInstance()->getScheduler()
+		->getTimeScale() * rb_ccnode_time_scale(layer));
+    }
+}
+
 static VALUE
 scene_alloc(VALUE rcv, SEL sel)
 {
@@ -347,6 +924,61 @@ scene_debug_physics_set(VALUE rcv, SEL sel, VALUE arg)
     return arg;
 }
 
+/// @group Culling
+
+/// @method #culling=(value)
+/// Set whether nodes outside of the visible area should be skipped when
+/// rendering. When enabled, the scene maintains a quadtree of the bounding
+/// boxes of its descendants, and every frame the subtrees that do not
+/// intersect with the visible rectangle (determined by {Director#origin},
+/// {Director#size} and the position and zoom of the {#camera}) are neither
+/// visited nor drawn. Nodes without a size, such as {Draw} or {Particle}
+/// objects, are never culled. The default value is false.
+///
+/// Bounds are refreshed when nodes are changed with the {Node} and {Sprite}
+/// setters, added or removed, run actions or are moved by the physics world.
+/// Nodes added natively by other classes, such as the children of widgets,
+/// are only tracked once one of their ancestors changed.
+/// @param value [Boolean] true if off-screen nodes should be culled.
+
+static VALUE
+scene_culling_set(VALUE rcv, SEL sel, VALUE val)
+{
+    SCENE(rcv)->setCulling(RTEST(val));
+    return val;
+}
+
+/// @method #culling?
+/// @return [Boolean] whether off-screen nodes are culled.
+
+static VALUE
+scene_culling(VALUE rcv, SEL sel)
+{
+    return SCENE(rcv)->quadtree != NULL ? Qtrue : Qfalse;
+}
+
+/// @property-readonly #culled_count
+/// @return [Integer] the number of off-screen nodes that are hidden by
+///   culling.
+
+static VALUE
+scene_culled_count(VALUE rcv, SEL sel)
+{
+    return LONG2NUM(SCENE(rcv)->culled_count);
+}
+
+/// @property-readonly #visited_count
+/// @return [Integer] the number of nodes on screen during the last frame,
+///   with their ancestors, when culling is enabled.
+
+static VALUE
+scene_visited_count(VALUE rcv, SEL sel)
+{
+    return LONG2NUM(SCENE(rcv)->visited_count);
+}
+
+/// @endgroup
+
 /// @method #background_color=(color)
 /// Set background color for scene.
 /// @param color [Color] background color for scene.
@@ -380,6 +1012,10 @@ Init_Layer(void)
     rb_define_method(rb_cScene, "gravity=", scene_gravity_set, 1);
     rb_define_method(rb_cScene, "debug_physics?", scene_debug_physics, 0);
     rb_define_method(rb_cScene, "debug_physics=", scene_debug_physics_set, 1);
+    rb_define_method(rb_cScene, "culling=", scene_culling_set, 1);
+    rb_define_method(rb_cScene, "culling?", scene_culling, 0);
+    rb_define_method(rb_cScene, "culled_count", scene_culled_count, 0);
+    rb_define_method(rb_cScene, "visited_count", scene_visited_count, 0);
     rb_define_method(rb_cScene, "background_color=", scene_background_color_set, 1);
     rb_define_method(rb_cScene, "color=", scene_background_color_set, 1); // depricated
 }
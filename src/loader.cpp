@@ -0,0 +1,378 @@
+#include "rubymotion.h"
+#include "motion-game.h"
+#include <ui/UILoadingBar.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/// @class Loader < Object
+/// A Loader preloads image files and spritesheets in the background, so
+/// that loading screens keep animating. Images are decoded and spritesheets
+/// are read and parsed on worker threads, then textures are created on the
+/// main thread, spending at most {#time_budget} seconds per frame.
+///
+///   loader = MG::Loader.load(['Sprites.plist', 'bg_galaxy.png']) do |progress|
+///     puts "#{(progress * 100).to_i}%"
+///   end
+///   loader.loading_bar = bar
+///   loader.on_complete { director.replace(MainScene.new) }
+
+static VALUE rb_cLoader = Qnil;
+
+class mc_Loader : public cocos2d::Ref {
+    public:
+	struct Item {
+	    std::string name;
+	    std::string path;
+	    std::string texture_path;
+	    std::string plist;
+	    bool spritesheet;
+	    cocos2d::Image *image;
+	    // Set with the image, as rb_cctexture_load would.
+	    cocos2d::Texture2D::PixelFormat format;
+	    std::string key;
+	};
+
+	std::vector<Item> items;
+	std::vector<std::thread> workers;
+	std::atomic<size_t> next;
+	std::mutex mutex;
+	std::deque<Item *> decoded;
+	size_t loaded;
+	std::vector<std::string> failures;
+	float time_budget;
+	VALUE progress_block;
+	VALUE complete_block;
+	cocos2d::ui::LoadingBar *loading_bar;
+
+    mc_Loader() {
+	next = 0;
+	loaded = 0;
+	time_budget = 1.0 / 240.0;
+	progress_block = complete_block = Qnil;
+	loading_bar = NULL;
+    }
+
+    ~mc_Loader() {
+	if (loading_bar != NULL) {
+	    loading_bar->release();
+	}
+    }
+
+    bool done(void) {
+	return loaded == items.size();
+    }
+
+    float progress(void) {
+	return items.empty() ? 1.0 : (float)loaded / items.size();
+    }
+
+    // Runs on worker threads, which only touch the items they pick and the
+    // queue of decoded items. Images are decoded with the pixel format rules
+    // and compressed variants of the texture cache, and dithered here.
+    void work(void) {
+	auto utils = cocos2d::FileUtils::getInstance();
+	size_t i;
+	while ((i = next++) < items.size()) {
+	    Item &item = items[i];
+	    item.texture_path = item.path;
+	    // Files which were not found are reported as failures by upload().
+	    if (item.path.empty()) {
+		std::lock_guard<std::mutex> lock(mutex);
+		decoded.push_back(&item);
+		continue;
+	    }
+	    if (item.spritesheet) {
+		item.plist = utils->getStringFromFile(item.path);
+		auto dict = utils->getValueMapFromData(item.plist.c_str(),
+			item.plist.size());
+		auto metadata = dict.find("metadata");
+		std::string texture_file;
+		if (metadata != dict.end()
+			&& metadata->second.getType()
+			== cocos2d::Value::Type::MAP) {
+		    auto &meta = metadata->second.asValueMap();
+		    auto texture = meta.find("textureFileName");
+		    if (texture != meta.end()) {
+			texture_file = texture->second.asString();
+		    }
+		}
+		if (!texture_file.empty()) {
+		    item.texture_path = utils->fullPathFromRelativeFile(
+			    texture_file, item.path);
+		}
+		else {
+		    const size_t dot = item.texture_path.find_last_of(".");
+		    if (dot != std::string::npos) {
+			item.texture_path.erase(dot);
+		    }
+		    item.texture_path.append(".png");
+		}
+	    }
+	    if (!item.spritesheet || !item.plist.empty()) {
+		// Rules match the name the texture is loaded with elsewhere.
+		item.image = rb_cctexture_decode(item.spritesheet
+			? item.texture_path.c_str() : item.name.c_str(),
+			item.texture_path, item.format, item.key);
+	    }
+	    std::lock_guard<std::mutex> lock(mutex);
+	    decoded.push_back(&item);
+	}
+    }
+
+    void start(void) {
+	retain();
+	size_t count = std::max(std::thread::hardware_concurrency(), 1u);
+	count = std::min(std::min(count, items.size()), (size_t)4);
+	for (size_t i = 0; i < count; i++) {
+	    workers.push_back(std::thread(&mc_Loader::work, this));
+	}
+	cocos2d::Director::getInstance()->getScheduler()->schedule(
+		CC_CALLBACK_1(mc_Loader::update, this), this, 0, false,
+		"mc_Loader");
+    }
+
+    void upload(Item *item) {
+	if (item->image == NULL) {
+	    failures.push_back(item->path.empty() ? item->name : item->path);
+	    return;
+	}
+	auto texture = rb_cctexture_create(item->image, item->key,
+		item->format);
+	item->image->release();
+	item->image = NULL;
+	if (item->spritesheet && texture != NULL) {
+	    cocos2d::SpriteFrameCache::getInstance()
+		->addSpriteFramesWithFileContent(item->plist, texture);
+	    item->plist.clear();
+	}
+	rb_texture_cache_used(texture);
+    }
+
+    void update(float delta) {
+	auto started = std::chrono::steady_clock::now();
+	while (true) {
+	    Item *item = NULL;
+	    {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!decoded.empty()) {
+		    item = decoded.front();
+		    decoded.pop_front();
+		}
+	    }
+	    if (item == NULL) {
+		break;
+	    }
+	    upload(item);
+	    loaded++;
+	    if (loading_bar != NULL) {
+		loading_bar->setPercent(progress() * 100);
+	    }
+	    if (progress_block != Qnil) {
+		VALUE progress_obj = DBL2NUM(progress());
+		rb_block_call(progress_block, 1, &progress_obj);
+	    }
+	    std::chrono::duration<float> elapsed =
+		std::chrono::steady_clock::now() - started;
+	    if (elapsed.count() >= time_budget) {
+		break;
+	    }
+	}
+	if (done()) {
+	    finish();
+	}
+    }
+
+    void finish(void) {
+	cocos2d::Director::getInstance()->getScheduler()->unschedule(
+		"mc_Loader", this);
+	for (auto &worker : workers) {
+	    worker.join();
+	}
+	workers.clear();
+	if (progress_block != Qnil) {
+	    rb_release(progress_block);
+	    progress_block = Qnil;
+	}
+	if (complete_block != Qnil) {
+	    VALUE block = complete_block;
+	    complete_block = Qnil;
+	    rb_block_call(block, 0, NULL);
+	    rb_release(block);
+	}
+	release();
+    }
+};
+
+#define LOADER(obj) _COCOS_WRAP_GET(obj, mc_Loader)
+
+/// @group Loading
+
+/// @method .load(file_names)
+/// Starts loading the given files in the background. Image files are added
+/// to the texture cache, so that later calls to {Sprite#initialize} with
+/// their names do not decode them again. Property list spritesheet files
+/// are loaded as with {Sprite.load}, including their texture.
+/// @param file_names [Array<String>] the names of image and spritesheet
+///   files in the application's resource directory.
+/// @yield [Float] if a block is given, it is called on the main thread
+///   after each file is loaded, with the progress of the loader.
+/// @return [Loader] the loader.
+
+static VALUE
+loader_load(VALUE rcv, SEL sel, VALUE file_names)
+{
+    if (!rb_obj_is_kind_of(file_names, rb_cArray)) {
+	rb_raise(rb_eArgError, "expected Array");
+    }
+    auto loader = new mc_Loader();
+    loader->autorelease();
+    auto utils = cocos2d::FileUtils::getInstance();
+    for (long i = 0, count = RARRAY_LEN(file_names); i < count; i++) {
+	std::string name = RSTRING_PTR(StringValue(RARRAY_AT(file_names, i)));
+	mc_Loader::Item item;
+	item.name = name;
+	// Full paths are resolved here because FileUtils caches them and
+	// is not safe to use from the worker threads for that.
+	item.path = utils->fullPathForFilename(name);
+	item.spritesheet = utils->getFileExtension(name) == ".plist";
+	item.image = NULL;
+	// Looking the format up also loads the rules file on this thread.
+	// Spritesheet textures are matched once their path is known.
+	const auto format = rb_cctexture_format_for(name.c_str());
+	item.format = item.spritesheet
+	    ? cocos2d::Texture2D::PixelFormat::AUTO : format;
+	loader->items.push_back(item);
+    }
+
+    VALUE block = rb_current_block();
+    if (block != Qnil) {
+	loader->progress_block = rb_retain(block);
+    }
+    loader->start();
+    return rb_cocos2d_object_new(loader, rcv);
+}
+
+/// @endgroup
+
+/// @method #on_complete
+/// Sets a block to be called on the main thread once all files are loaded.
+/// @yield the block to call.
+/// @return [self] the receiver.
+
+static VALUE
+loader_on_complete(VALUE rcv, SEL sel)
+{
+    VALUE block = rb_current_block();
+    if (block == Qnil) {
+	rb_raise(rb_eArgError, "block not given");
+    }
+    auto loader = LOADER(rcv);
+    if (loader->done()) {
+	rb_block_call(block, 0, NULL);
+	return rcv;
+    }
+    if (loader->complete_block != Qnil) {
+	rb_release(loader->complete_block);
+    }
+    loader->complete_block = rb_retain(block);
+    return rcv;
+}
+
+/// @group Properties
+
+/// @property-readonly #progress
+/// @return [Float] the progress of the loader, from +0.0+ to +1.0+.
+
+static VALUE
+loader_progress(VALUE rcv, SEL sel)
+{
+    return DBL2NUM(LOADER(rcv)->progress());
+}
+
+/// @property-readonly #done?
+/// @return [Boolean] whether all files are loaded.
+
+static VALUE
+loader_done(VALUE rcv, SEL sel)
+{
+    return LOADER(rcv)->done() ? Qtrue : Qfalse;
+}
+
+/// @property-readonly #failures
+/// @return [Array<String>] the paths of the files which could not be
+///   loaded so far.
+
+static VALUE
+loader_failures(VALUE rcv, SEL sel)
+{
+    VALUE ary = rb_ary_new();
+    for (auto &path : LOADER(rcv)->failures) {
+	rb_ary_push(ary, RSTRING_NEW(path.c_str()));
+    }
+    return ary;
+}
+
+/// @property #time_budget
+/// @return [Float] the maximum time, in seconds, spent creating textures
+///   at every frame. The default is +1/240+ of a second. At least one
+///   texture is created per frame.
+
+static VALUE
+loader_time_budget(VALUE rcv, SEL sel)
+{
+    return DBL2NUM(LOADER(rcv)->time_budget);
+}
+
+static VALUE
+loader_time_budget_set(VALUE rcv, SEL sel, VALUE val)
+{
+    LOADER(rcv)->time_budget = NUM2DBL(val);
+    return val;
+}
+
+/// @endgroup
+
+/// @method #loading_bar=(bar)
+/// Sets a loading bar which progress is updated as files are loaded.
+/// @param bar [LoadingBar] the loading bar to update, or +nil+.
+/// @return [LoadingBar] the loading bar.
+
+static VALUE
+loader_loading_bar_set(VALUE rcv, SEL sel, VALUE val)
+{
+    auto loader = LOADER(rcv);
+    auto bar = val == Qnil
+	? NULL : dynamic_cast<cocos2d::ui::LoadingBar *>(NODE(val));
+    if (val != Qnil && bar == NULL) {
+	rb_raise(rb_eArgError, "expected LoadingBar");
+    }
+    if (bar != NULL) {
+	bar->retain();
+	bar->setPercent(loader->progress() * 100);
+    }
+    if (loader->loading_bar != NULL) {
+	loader->loading_bar->release();
+    }
+    loader->loading_bar = bar;
+    return val;
+}
+
+extern "C"
+void
+Init_Loader(void)
+{
+    rb_cLoader = rb_define_class_under(rb_mMC, "Loader", rb_cObject);
+    rb_register_cocos2d_object_finalizer(rb_cLoader);
+
+    rb_define_singleton_method(rb_cLoader, "load", loader_load, 1);
+    rb_define_method(rb_cLoader, "on_complete", loader_on_complete, 0);
+    rb_define_method(rb_cLoader, "progress", loader_progress, 0);
+    rb_define_method(rb_cLoader, "done?", loader_done, 0);
+    rb_define_method(rb_cLoader, "failures", loader_failures, 0);
+    rb_define_method(rb_cLoader, "time_budget", loader_time_budget, 0);
+    rb_define_method(rb_cLoader, "time_budget=", loader_time_budget_set, 1);
+    rb_define_method(rb_cLoader, "loading_bar=", loader_loading_bar_set, 1);
+}
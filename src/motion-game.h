@@ -1,6 +1,9 @@
 #ifndef __MOTION_GAME_H_
 #define __MOTION_GAME_H_
 
+#include <memory>
+#include <typeinfo>
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -21,6 +24,7 @@ extern VALUE rb_cAudio;
 extern VALUE rb_cPoint;
 extern VALUE rb_cSize;
 extern VALUE rb_cColor;
+extern VALUE rb_cAction;
 
 #define _COCOS_WRAP_GET(obj, type) ((type *)rb_class_wrap_get_ptr(obj))
 
@@ -44,6 +48,31 @@ void rb_add_relationship(VALUE container, VALUE child);
 void rb_define_constructor0(VALUE klass, void *func, int arity);
 #define rb_define_constructor(klass, func, arity) rb_define_constructor0(klass, (void*)func, arity)
 
+// Options are given as a Hash, which is read as an Array of [key, value]
+// pairs since there is no Hash API.
+
+static inline VALUE
+rb_options_to_ary(VALUE obj)
+{
+    if (obj == Qnil || rb_obj_is_kind_of(obj, rb_cArray)) {
+	return obj == Qnil ? rb_ary_new() : obj;
+    }
+    return rb_send(obj, rb_selector("to_a"), 0, NULL);
+}
+
+static inline VALUE
+rb_options_get(VALUE pairs, const char *key)
+{
+    VALUE sym = rb_name2sym(key);
+    for (int i = 0, count = RARRAY_LEN(pairs); i < count; i++) {
+	VALUE pair = RARRAY_AT(pairs, i);
+	if (RARRAY_AT(pair, 0) == sym) {
+	    return RARRAY_AT(pair, 1);
+	}
+    }
+    return Qnil;
+}
+
 static inline cocos2d::Vec2
 rb_any_to_ccvec2(VALUE obj)
 {
@@ -168,7 +197,164 @@ rb_cccolor3_to_obj(cocos2d::Color3B obj)
     return rb_cccolor4_to_obj(cocos2d::Color4B(obj.r, obj.g, obj.b, 255));
 }
 
+// A reference to a Ruby block which can be copied into native callbacks.
+// The block is retained once and released with the last copy.
+
+class mc_Block {
+    public:
+	std::shared_ptr<VALUE> block;
+
+    mc_Block() {}
+
+    mc_Block(VALUE obj) : block(new VALUE(rb_retain(obj)), [](VALUE *obj) {
+		rb_release(*obj);
+		delete obj;
+	    }) {}
+
+    bool empty(void) const {
+	return !block;
+    }
+
+    VALUE call(int argc, VALUE *argv) const {
+	return rb_block_call(*block, argc, argv);
+    }
+};
+
+// State kept for a node, as its user object so that it is released with the
+// node.
+
+extern "C" void rb_dynamic_atlas_untrack(cocos2d::Sprite *sprite,
+	const char *name);
+
+class mc_NodeInfo : public cocos2d::Ref {
+    public:
+	// The collision shape of a sprite.
+	bool alpha_shape;
+	// Node#pause_tree state, and the physics body it disabled.
+	bool tree_paused;
+	cocos2d::PhysicsBody *paused_body;
+	// The dynamic atlas image a sprite displays. The atlas does not retain
+	// the sprite, and forgets it here when the sprite is destroyed.
+	cocos2d::Sprite *atlas_sprite;
+	std::string atlas_name;
+	// Node#time_scale, and the product of the time scales of the node and
+	// its ancestors, valid for the given generation.
+	float time_scale;
+	float effective_time_scale;
+	unsigned long time_scale_generation;
+
+    mc_NodeInfo() {
+	alpha_shape = false;
+	tree_paused = false;
+	paused_body = NULL;
+	atlas_sprite = NULL;
+	time_scale = effective_time_scale = 1;
+	time_scale_generation = 0;
+    }
+
+    virtual ~mc_NodeInfo() {
+	CC_SAFE_RELEASE(paused_body);
+	if (atlas_sprite != NULL) {
+	    rb_dynamic_atlas_untrack(atlas_sprite, atlas_name.c_str());
+	}
+    }
+
+    static mc_NodeInfo *get(const cocos2d::Node *node) {
+	// Compared with typeid, as this is called for every node stepped.
+	auto object = const_cast<cocos2d::Node *>(node)->getUserObject();
+	return object != NULL && typeid(*object) == typeid(mc_NodeInfo)
+	    ? static_cast<mc_NodeInfo *>(object) : NULL;
+    }
+
+    static mc_NodeInfo *fetch(cocos2d::Node *node) {
+	auto info = get(node);
+	if (info == NULL) {
+	    info = new mc_NodeInfo();
+	    node->setUserObject(info);
+	    info->release();
+	}
+	return info;
+    }
+};
+
+// Node properties animated by Tween and Timeline. Timeline files store
+// these values.
+
+enum {
+    MC_PROPERTY_X = 0,
+    MC_PROPERTY_Y = 1,
+    MC_PROPERTY_ALPHA = 2,
+    MC_PROPERTY_ROTATION = 3,
+    MC_PROPERTY_SCALE_X = 4,
+    MC_PROPERTY_SCALE_Y = 5,
+    MC_PROPERTY_SKEW_X = 6,
+    MC_PROPERTY_SKEW_Y = 7,
+    MC_PROPERTY_RED = 8,
+    MC_PROPERTY_GREEN = 9,
+    MC_PROPERTY_BLUE = 10,
+    MC_PROPERTY_COUNT = 11
+};
+
 cocos2d::Scene *rb_any_to_scene(VALUE obj);
+cocos2d::Rect rb_ccscene_visible_rect(cocos2d::Scene *scene);
+void rb_scene_update_physics_speed(VALUE obj);
+void rb_scene_node_changed(cocos2d::Node *node);
+void rb_scene_node_removed(cocos2d::Node *node);
+bool rb_scene_node_culled(cocos2d::Node *node);
+void rb_scene_node_uncull(cocos2d::Node *node);
+cocos2d::SpriteFrame *rb_ccsprite_frame(const char *name);
+cocos2d::Sprite *rb_ccsprite_create(const char *name);
+const char *rb_ccsprite_name(cocos2d::Sprite *sprite);
+bool rb_ccnode_is_internal(cocos2d::Node *node);
+void rb_ccnode_changed(cocos2d::Node *node);
+float rb_ccnode_time_scale(cocos2d::Node *node);
+void rb_ccnode_added(cocos2d::Node *node);
+void rb_prefab_save(cocos2d::Node *node, const char *path);
+cocos2d::ActionInterval *rb_ccanimate_create(int argc, VALUE *argv);
+cocos2d::Animation *rb_ccanimation_create(VALUE frame_names, VALUE delay);
+cocos2d::SpriteFrame *rb_dynamic_atlas_frame(const char *name);
+void rb_dynamic_atlas_track(cocos2d::Sprite *sprite, const char *name);
+bool rb_dynamic_atlas_contains(cocos2d::SpriteFrame *frame);
+void rb_texture_cache_used(cocos2d::Texture2D *texture);
+cocos2d::SpriteFrame *rb_texture_cache_restore_frame(const char *name);
+cocos2d::Texture2D::PixelFormat rb_sym_to_cctexture_format(VALUE sym);
+cocos2d::Texture2D::PixelFormat rb_cctexture_format_for(const char *path);
+cocos2d::Texture2D *rb_cctexture_load(const char *path,
+	cocos2d::Texture2D::PixelFormat format);
+bool rb_cctexture_has_variant(const char *path);
+cocos2d::Image *rb_cctexture_decode(const char *path,
+	const std::string &full_path, cocos2d::Texture2D::PixelFormat &format,
+	std::string &key);
+cocos2d::Texture2D *rb_cctexture_create(cocos2d::Image *image,
+	const std::string &key, cocos2d::Texture2D::PixelFormat format);
+bool rb_cctexture_source(cocos2d::Texture2D *texture, std::string &path,
+	int &x, int &y);
+bool rb_dynamic_atlas_source(cocos2d::Texture2D *texture, std::string &path,
+	int &x, int &y);
+bool rb_ccsprite_alpha_shape(cocos2d::Sprite *sprite);
+bool rb_ccsprite_alpha_mask_available(cocos2d::Sprite *sprite);
+bool rb_ccnode_shapes_intersect(cocos2d::Node *node1, cocos2d::Node *node2);
+cocos2d::SpriteFrame *rb_ccsprite_frame_handle(VALUE obj);
+cocos2d::Action *rb_ccaction_instance(VALUE obj);
+void rb_ccaction_manager_install(void);
+cocos2d::FiniteTimeAction *rb_ccaction_completion(VALUE block, VALUE tag);
+cocos2d::MoveBy *rb_ccmove_by_create(float duration,
+	const cocos2d::Vec2 &delta);
+cocos2d::MoveTo *rb_ccmove_to_create(float duration,
+	const cocos2d::Vec2 &position);
+cocos2d::RotateBy *rb_ccrotate_by_create(float duration, float delta_angle);
+cocos2d::RotateTo *rb_ccrotate_to_create(float duration, float angle);
+cocos2d::ScaleBy *rb_ccscale_by_create(float duration, float scale);
+cocos2d::ScaleTo *rb_ccscale_to_create(float duration, float scale);
+cocos2d::FadeTo *rb_ccfade_to_create(float duration, GLubyte opacity);
+cocos2d::FadeIn *rb_ccfade_in_create(float duration);
+cocos2d::FadeOut *rb_ccfade_out_create(float duration);
+cocos2d::Blink *rb_ccblink_create(float duration, int blinks);
+cocos2d::DelayTime *rb_ccdelay_time_create(float duration);
+int rb_sym_to_ease(VALUE sym);
+float rb_ease_apply(int ease, float t);
+float rb_ccnode_property_get(cocos2d::Node *node, int property);
+void rb_ccnode_property_set(cocos2d::Node *node, int property, float value);
 
 #if defined(__cplusplus)
 }
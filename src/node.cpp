@@ -1,5 +1,6 @@
 #include "rubymotion.h"
 #include "motion-game.h"
+#include <unordered_map>
 
 /// @class Node < Object
 /// Node is the base class of objects in the scene graph. You should not
@@ -9,6 +10,260 @@ VALUE rb_cNode = Qnil;
 static VALUE rb_cParallaxNode = Qnil;
 static VALUE rb_cDrawNode = Qnil;
 
+// Bitmap caching is implemented with a pair of hidden children. The head is
+// inserted first among the children that are drawn above the node itself,
+// the tail last, and the cached siblings are the ones between them in the
+// order of the children. The head renders those siblings into a
+// RenderTexture when they are marked as changed, draws the texture as a
+// single quad, and clears their visible flag so that the owner's visit skips
+// them. The tail is visited right after them and sets the flag again, so the
+// skipping is never observable from outside the visit. The flag is set
+// directly rather than with setVisible(), which would mark the transforms of
+// the siblings as dirty every frame.
+//
+// The cached subtree is not inspected between renders. The setters of Node
+// and Sprite, adding and removing children and the actions call
+// rb_ccnode_changed(), which marks the caches of the node's ancestors as
+// dirty, found in a table indexed by their owner.
+
+class mc_BitmapCache;
+static std::unordered_map<cocos2d::Node *, mc_BitmapCache *> bitmap_caches;
+
+class mc_BitmapCache : public cocos2d::Node {
+    public:
+	mc_BitmapCache *head;
+	mc_BitmapCache *tail;
+	cocos2d::Node *owner;
+	cocos2d::RenderTexture *texture;
+	std::vector<cocos2d::Node *> hidden;
+	bool dirty;
+	// The cascaded color of the owner the texture was rendered with.
+	cocos2d::Color4B owner_color;
+	unsigned long hits;
+	unsigned long misses;
+
+    mc_BitmapCache() {
+	head = tail = NULL;
+	owner = NULL;
+	texture = NULL;
+	dirty = true;
+	hits = misses = 0;
+    }
+
+    virtual ~mc_BitmapCache() {
+	CC_SAFE_RELEASE(texture);
+	if (owner != NULL) {
+	    auto iter = bitmap_caches.find(owner);
+	    if (iter != bitmap_caches.end() && iter->second == this) {
+		bitmap_caches.erase(iter);
+	    }
+	}
+    }
+
+    static mc_BitmapCache *create(mc_BitmapCache *head) {
+	auto cache = new mc_BitmapCache();
+	cache->init();
+	cache->autorelease();
+	cache->head = head;
+	return cache;
+    }
+
+    static void set_visible_flag(cocos2d::Node *node, bool flag) {
+	node->*(&mc_BitmapCache::_visible) = flag;
+    }
+
+    // The range of the owner's children between the head and the tail.
+    // Children of the same z-order as the tail which were added after it are
+    // outside of the range.
+    void cached_range(ssize_t &first, ssize_t &last) {
+	auto &children = getParent()->getChildren();
+	first = children.getIndex(this) + 1;
+	last = children.getIndex(tail);
+	if (last < first) {
+	    last = first;
+	}
+    }
+
+    static void compute_bounds(cocos2d::Node *node,
+	    const cocos2d::AffineTransform &parent_transform,
+	    cocos2d::Rect &bounds, bool &empty) {
+	auto transform = cocos2d::AffineTransformConcat(
+		node->getNodeToParentAffineTransform(), parent_transform);
+	auto size = node->getContentSize();
+	auto rect = cocos2d::RectApplyAffineTransform(
+		cocos2d::Rect(0, 0, size.width, size.height), transform);
+	if (empty) {
+	    bounds = rect;
+	    empty = false;
+	}
+	else {
+	    bounds = bounds.unionWithRect(rect);
+	}
+	for (auto child : node->getChildren()) {
+	    if (child->isVisible()) {
+		compute_bounds(child, transform, bounds, empty);
+	    }
+	}
+    }
+
+    void render(cocos2d::Renderer *renderer, ssize_t first, ssize_t last) {
+	auto &children = getParent()->getChildren();
+	cocos2d::Rect bounds;
+	bool empty = true;
+	for (ssize_t i = first; i < last; i++) {
+	    auto child = children.at(i);
+	    if (child->isVisible()) {
+		compute_bounds(child, cocos2d::AffineTransform::IDENTITY,
+			bounds, empty);
+	    }
+	}
+	if (empty || bounds.size.width < 1 || bounds.size.height < 1) {
+	    CC_SAFE_RELEASE_NULL(texture);
+	    dirty = false;
+	    return;
+	}
+
+	int width = ceilf(bounds.size.width);
+	int height = ceilf(bounds.size.height);
+	if (texture == NULL
+		|| (int)texture->getSprite()->getContentSize().width != width
+		|| (int)texture->getSprite()->getContentSize().height != height) {
+	    CC_SAFE_RELEASE(texture);
+	    texture = cocos2d::RenderTexture::create(width, height);
+	    texture->retain();
+	}
+	texture->setPosition(bounds.origin.x + width / 2.0,
+		bounds.origin.y + height / 2.0);
+
+	cocos2d::Mat4 transform;
+	cocos2d::Mat4::createTranslation(-bounds.origin.x, -bounds.origin.y,
+		0, &transform);
+	dirty = false;
+	texture->beginWithClear(0, 0, 0, 0);
+	for (ssize_t i = first; i < last; i++) {
+	    auto child = children.at(i);
+	    if (child->isVisible()) {
+		child->visit(renderer, transform,
+			cocos2d::Node::FLAGS_TRANSFORM_DIRTY);
+	    }
+	}
+	texture->end();
+    }
+
+    virtual void visit(cocos2d::Renderer *renderer,
+	    const cocos2d::Mat4 &parent_transform,
+	    uint32_t parent_flags) override {
+	if (head != NULL) {
+	    // Tail: the siblings were skipped, make them visible again.
+	    for (auto node : head->hidden) {
+		set_visible_flag(node, true);
+	    }
+	    head->hidden.clear();
+	    return;
+	}
+
+	// The texture is in the owner's space, so only the cascaded color of the
+	// owner matters, not its own transform.
+	auto &children = owner->getChildren();
+	ssize_t first, last;
+	cached_range(first, last);
+	const cocos2d::Color4B color(owner->getDisplayedColor(),
+		owner->getDisplayedOpacity());
+	if (dirty || color != owner_color) {
+	    owner_color = color;
+	    render(renderer, first, last);
+	    misses++;
+	}
+	else {
+	    hits++;
+	}
+
+	for (ssize_t i = first; i < last; i++) {
+	    auto child = children.at(i);
+	    if (child->isVisible()) {
+		set_visible_flag(child, false);
+		hidden.push_back(child);
+	    }
+	}
+	if (texture != NULL) {
+	    texture->visit(renderer, parent_transform, parent_flags);
+	}
+    }
+};
+
+// Returns whether the node is a hidden helper child which should not be
+// exposed to the application.
+
+extern "C"
+bool
+rb_ccnode_is_internal(cocos2d::Node *node)
+{
+    return dynamic_cast<mc_BitmapCache *>(node) != NULL;
+}
+
+static mc_BitmapCache *
+bitmap_cache_get(cocos2d::Node *node)
+{
+    auto iter = bitmap_caches.find(node);
+    return iter != bitmap_caches.end() ? iter->second : NULL;
+}
+
+// Marks the bitmap caches of the ancestors of the node as dirty, and the
+// bounds of the node for culling, after the node changed or before it is
+// removed from its parent.
+
+extern "C"
+void
+rb_ccnode_changed(cocos2d::Node *node)
+{
+    rb_scene_node_changed(node);
+    if (bitmap_caches.empty()) {
+	return;
+    }
+    for (node = node->getParent(); node != NULL; node = node->getParent()) {
+	auto cache = bitmap_cache_get(node);
+	if (cache != NULL) {
+	    cache->dirty = true;
+	}
+    }
+}
+
+static unsigned long node_time_scale_generation = 1;
+
+// Called after a node was added to a parent, which may have moved it to
+// another part of the tree.
+
+extern "C"
+void
+rb_ccnode_added(cocos2d::Node *node)
+{
+    node_time_scale_generation++;
+    rb_ccnode_changed(node);
+}
+
+static void
+bitmap_cache_attach(cocos2d::Node *node, mc_BitmapCache *head)
+{
+    auto tail = head->tail;
+    head->owner = node;
+    head->dirty = true;
+    bitmap_caches[node] = head;
+    node->addChild(head, 0);
+    node->addChild(tail, INT_MAX);
+    // Sort the head before every other child of z-order 0, which means right
+    // after the node draws itself.
+    head->setOrderOfArrival(0);
+}
+
+static void
+bitmap_cache_detach(cocos2d::Node *node, mc_BitmapCache *head)
+{
+    bitmap_caches.erase(node);
+    head->owner = NULL;
+    node->removeChild(head->tail, true);
+    node->removeChild(head, true);
+}
+
 static VALUE
 node_alloc(VALUE rcv, SEL sel)
 {
@@ -32,7 +287,9 @@ node_anchor_point(VALUE rcv, SEL sel)
 static VALUE
 node_anchor_point_set(VALUE rcv, SEL sel, VALUE val)
 {
-    NODE(rcv)->setAnchorPoint(rb_any_to_ccvec2(val));
+    auto node = NODE(rcv);
+    node->setAnchorPoint(rb_any_to_ccvec2(val));
+    rb_ccnode_changed(node);
     return val;
 }
 
@@ -49,7 +306,9 @@ node_position(VALUE rcv, SEL sel)
 static VALUE
 node_position_set(VALUE rcv, SEL sel, VALUE val)
 {
-    NODE(rcv)->setPosition(rb_any_to_ccvec2(val));
+    auto node = NODE(rcv);
+    node->setPosition(rb_any_to_ccvec2(val));
+    rb_ccnode_changed(node);
     return val;
 }
 
@@ -65,7 +324,9 @@ node_size(VALUE rcv, SEL sel)
 static VALUE
 node_size_set(VALUE rcv, SEL sel, VALUE val)
 {
-    NODE(rcv)->setContentSize(rb_any_to_ccsize(val));
+    auto node = NODE(rcv);
+    node->setContentSize(rb_any_to_ccsize(val));
+    rb_ccnode_changed(node);
     return val;
 }
 
@@ -76,7 +337,10 @@ node_size_set(VALUE rcv, SEL sel, VALUE val)
 static VALUE
 node_visible_set(VALUE rcv, SEL sel, VALUE val)
 {
-    NODE(rcv)->setVisible(RTEST(val));
+    auto node = NODE(rcv);
+    rb_scene_node_uncull(node);
+    node->setVisible(RTEST(val));
+    rb_ccnode_changed(node);
     return val;
 }
 
@@ -87,7 +351,8 @@ node_visible_set(VALUE rcv, SEL sel, VALUE val)
 static VALUE
 node_visible(VALUE rcv, SEL sel)
 {
-    return NODE(rcv)->isVisible() ? Qtrue : Qfalse;
+    auto node = NODE(rcv);
+    return node->isVisible() || rb_scene_node_culled(node) ? Qtrue : Qfalse;
 }
 
 /// @property #alpha
@@ -103,7 +368,9 @@ node_alpha(VALUE rcv, SEL sel)
 static VALUE
 node_alpha_set(VALUE rcv, SEL sel, VALUE val)
 {
-    NODE(rcv)->setOpacity(NUM2BYTE(val));
+    auto node = NODE(rcv);
+    node->setOpacity(NUM2BYTE(val));
+    rb_ccnode_changed(node);
     return val;
 }
 
@@ -120,7 +387,9 @@ node_z_index(VALUE rcv, SEL sel)
 static VALUE
 node_z_index_set(VALUE rcv, SEL sel, VALUE val)
 {
-    NODE(rcv)->setLocalZOrder(NUM2LONG(val));
+    auto node = NODE(rcv);
+    node->setLocalZOrder(NUM2LONG(val));
+    rb_ccnode_changed(node);
     return val;
 }
 
@@ -136,7 +405,9 @@ node_color(VALUE rcv, SEL sel)
 static VALUE
 node_color_set(VALUE rcv, SEL sel, VALUE val)
 {
-    NODE(rcv)->setColor(rb_any_to_cccolor3(val));
+    auto node = NODE(rcv);
+    node->setColor(rb_any_to_cccolor3(val));
+    rb_ccnode_changed(node);
     return val;
 }
 
@@ -155,7 +426,9 @@ node_rotation(VALUE rcv, SEL sel)
 static VALUE
 node_rotation_set(VALUE rcv, SEL sel, VALUE val)
 {
-    NODE(rcv)->setRotation(NUM2DBL(val));
+    auto node = NODE(rcv);
+    node->setRotation(NUM2DBL(val));
+    rb_ccnode_changed(node);
     return val;
 }
 
@@ -173,7 +446,9 @@ node_scale(VALUE rcv, SEL sel)
 static VALUE
 node_scale_set(VALUE rcv, SEL sel, VALUE val)
 {
-    NODE(rcv)->setScale(NUM2DBL(val));
+    auto node = NODE(rcv);
+    node->setScale(NUM2DBL(val));
+    rb_ccnode_changed(node);
     return val;
 }
 
@@ -193,26 +468,33 @@ node_name_set(VALUE rcv, SEL sel, VALUE val)
     return val;
 }
 
-/// @method #run_action(action)
-/// Run the provided action on the receiver node.
+/// @method #run_action(action, tag=nil)
+/// Run the provided action on the receiver node. If the action is a
+/// template made with {Action#template!}, a copy of it is run.
+/// @param action [Action] the action to run.
+/// @param tag [Symbol] a tag whose handler, registered with
+///   {Action.on_complete}, receives the receiver once the action is done.
+/// @return [self] the receiver.
+/// @yield if passed a block, the block will be called for the action.
+
+/// @method #run(action, tag=nil)
+/// Same as {#run_action}.
 /// @return [self] the receiver.
 /// @yield if passed a block, the block will be called for the action.
 
 static VALUE
-node_run_action(VALUE rcv, SEL sel, VALUE action)
+node_run_action(VALUE rcv, SEL sel, int argc, VALUE *argv)
 {
+    VALUE obj = Qnil, tag = Qnil;
+    rb_scan_args(argc, argv, "11", &obj, &tag);
+
+    auto action = rb_ccaction_instance(obj);
     VALUE block = rb_current_block();
-    if (block != Qnil) {
-	block = rb_retain(block); // FIXME need release...
-	auto call_funcn =
-	    cocos2d::CallFuncN::create(
-		[block](cocos2d::Node *node) {
-		    rb_block_call(block, 0, NULL);
-		});
-	NODE(rcv)->runAction(cocos2d::Sequence::create(FINITE_TIME_ACTION(action), call_funcn, (void *)0));
+    if (block != Qnil || tag != Qnil) {
+	NODE(rcv)->runAction(cocos2d::Sequence::create((cocos2d::FiniteTimeAction *)action, rb_ccaction_completion(block, tag), (void *)0));
     }
     else {
-	NODE(rcv)->runAction(ACTION(action));
+	NODE(rcv)->runAction(action);
     }
 
     return rcv;
@@ -242,13 +524,16 @@ node_stop_action(VALUE rcv, SEL sel, VALUE action)
 /// @method #intersects?(node)
 /// @param node [Node] a given Node object.
 /// @return [Boolean] whether the receiver's bounding box intersects with the
-///   given node's bounding box.
+///   given node's bounding box. When one of the nodes is a sprite whose
+///   {Sprite#collision_shape} is +:alpha+, its opaque pixels are used
+///   instead of its bounding box.
 
 static VALUE
 node_intersects(VALUE rcv, SEL sel, VALUE node)
 {
-    return NODE(rcv)->getBoundingBox().intersectsRect(
-	NODE(node)->getBoundingBox()) ? Qtrue : Qfalse;
+    auto node1 = NODE(rcv), node2 = NODE(node);
+    return node1->getBoundingBox().intersectsRect(node2->getBoundingBox())
+	&& rb_ccnode_shapes_intersect(node1, node2) ? Qtrue : Qfalse;
 }
 
 /// @group Container
@@ -274,6 +559,7 @@ node_add(VALUE rcv, SEL sel, int argc, VALUE *argv)
 	rb_add_relationship(rcv, child);
 	NODE(rcv)->addChild(NODE(child), NUM2LONG(zpos));
     }
+    rb_ccnode_added(NODE(child));
     return rcv;
 }
 
@@ -290,7 +576,22 @@ node_clear(VALUE rcv, SEL sel, int argc, VALUE *argv)
     VALUE cleanup = Qnil;
     rb_scan_args(argc, argv, "01", &cleanup);
 
-    NODE(rcv)->removeAllChildrenWithCleanup(RTEST(cleanup));
+    auto node = NODE(rcv);
+    auto cache = bitmap_cache_get(node);
+    if (cache != NULL) {
+	cache->retain();
+	cache->tail->retain();
+    }
+    for (auto child : node->getChildren()) {
+	rb_scene_node_removed(child);
+    }
+    node->removeAllChildrenWithCleanup(RTEST(cleanup));
+    if (cache != NULL) {
+	bitmap_cache_attach(node, cache);
+	cache->tail->release();
+	cache->release();
+    }
+    rb_ccnode_changed(node);
     return rcv;
 }
 
@@ -306,6 +607,8 @@ node_delete(VALUE rcv, SEL sel, int argc, VALUE *argv)
     VALUE node = Qnil, cleanup = Qnil;
     rb_scan_args(argc, argv, "11", &node, &cleanup);
 
+    rb_ccnode_changed(NODE(node));
+    rb_scene_node_removed(NODE(node));
     NODE(rcv)->removeChild(NODE(node), RTEST(cleanup));
     return rcv;
 }
@@ -330,7 +633,10 @@ node_children(VALUE rcv, SEL sel)
     VALUE ary = rb_ary_new();
     auto vector = NODE(rcv)->getChildren();
     for (int i = 0, count = vector.size(); i < count; i++) {
-	rb_ary_push(ary, rb_cocos2d_object_new(vector.at(i), rb_cNode));
+	auto child = vector.at(i);
+	if (!rb_ccnode_is_internal(child)) {
+	    rb_ary_push(ary, rb_cocos2d_object_new(child, rb_cNode));
+	}
     }
     return ary;
 }
@@ -349,12 +655,46 @@ node_delete_from_parent(VALUE rcv, SEL sel, int argc, VALUE *argv)
     VALUE cleanup = Qnil;
     rb_scan_args(argc, argv, "01", &cleanup);
 
+    rb_ccnode_changed(NODE(rcv));
+    rb_scene_node_removed(NODE(rcv));
     NODE(rcv)->removeFromParentAndCleanup(RTEST(cleanup));
     return rcv;
 }
 
 /// @endgroup
 
+// Scheduled blocks are called from a callback which runs every frame and
+// counts the delay and the interval in the time of the node, so that they
+// follow #time_scale. Like cocos2d timers, the block is first called after
+// the delay (or the interval if there is no delay) then repeated, and is
+// given the time elapsed since the previous call.
+
+static void
+node_schedule_block(cocos2d::Node *node, VALUE block, float interval,
+	unsigned int repeat, float delay, const std::string &key)
+{
+    float wait = delay > 0 ? delay : interval;
+    float elapsed = 0;
+    unsigned int count = 0;
+    node->schedule([=](float delta) mutable {
+		elapsed += delta * rb_ccnode_time_scale(node);
+		if (elapsed < wait) {
+		    return;
+		}
+		VALUE delta_obj = DBL2NUM(elapsed);
+		elapsed = 0;
+		wait = interval;
+		// The callback is kept alive by the scheduler until it returns
+		// when it unschedules itself.
+		VALUE current_block = block;
+		if (repeat != kRepeatForever && count++ >= repeat) {
+		    node->unschedule(key);
+		}
+		rb_block_call(current_block, 1, &delta_obj);
+	    },
+	    0, kRepeatForever, 0, key);
+}
+
 /// @method #schedule(delay, repeat=0, interval=0)
 /// Schedules a given block for execution.
 /// @param delay [Float] the duration of the block, in seconds.
@@ -385,11 +725,7 @@ node_schedule(VALUE rcv, SEL sel, int argc, VALUE *argv)
     char key[100];
     snprintf(key, sizeof key, "schedule_lambda_%p", (void *)block);
 
-    NODE(rcv)->schedule([block](float delta) {
-		VALUE delta_obj = DBL2NUM(delta);
-		rb_block_call(block, 1, &delta_obj);
-	    },
-	    interval_c, repeat_c, delay_c, key);
+    node_schedule_block(NODE(rcv), block, interval_c, repeat_c, delay_c, key);
 
     return RSTRING_NEW(key);
 }
@@ -415,11 +751,7 @@ node_schedule_once(VALUE rcv, SEL sel, VALUE delay)
     char key[100];
     snprintf(key, sizeof key, "schedule_once_lambda_%p", (void *)block);
 
-    NODE(rcv)->scheduleOnce([block](float delta) {
-		VALUE delta_obj = DBL2NUM(delta);
-		rb_block_call(block, 1, &delta_obj);
-	    },
-	    delay_c, key);
+    node_schedule_block(NODE(rcv), block, 0, 0, delay_c, key);
 
     return RSTRING_NEW(key);
 }
@@ -446,6 +778,251 @@ node_number_of_running_actions(VALUE rcv, SEL sel)
     return SSIZET2NUM(NODE(rcv)->getNumberOfRunningActions());
 }
 
+// Paused nodes remember it in their info, with the physics body they
+// disabled, retained until #resume_tree so that bodies which were already
+// disabled by the application are left alone. Node::onEnter resumes a node,
+// so it is paused again when it enters a scene.
+
+static void
+node_pause_tree_walk(cocos2d::Node *node)
+{
+    // Suspends the actions, scheduled selectors and event listeners of the
+    // node, all of which stay registered.
+    node->pause();
+    auto info = mc_NodeInfo::fetch(node);
+    if (!info->tree_paused) {
+	info->tree_paused = true;
+	node->setonEnterTransitionDidFinishCallback([node]() {
+		node->pause();
+	    });
+    }
+    auto body = node->getPhysicsBody();
+    if (body != NULL && body->isEnabled() && info->paused_body == NULL) {
+	body->retain();
+	info->paused_body = body;
+	body->setEnabled(false);
+    }
+    for (auto child : node->getChildren()) {
+	node_pause_tree_walk(child);
+    }
+}
+
+static void
+node_resume_tree_walk(cocos2d::Node *node)
+{
+    node->resume();
+    auto info = mc_NodeInfo::get(node);
+    if (info != NULL && info->tree_paused) {
+	info->tree_paused = false;
+	node->setonEnterTransitionDidFinishCallback(nullptr);
+	auto body = info->paused_body;
+	if (body != NULL) {
+	    info->paused_body = NULL;
+	    body->setEnabled(true);
+	    body->release();
+	}
+    }
+    for (auto child : node->getChildren()) {
+	node_resume_tree_walk(child);
+    }
+}
+
+/// @method #pause_tree
+/// Suspends the receiver and all of its descendants: running actions,
+/// scheduled blocks, event listeners and physics bodies are frozen in their
+/// current state, without being removed. Use {#resume_tree} to continue.
+/// The nodes stay paused when they are removed and added to a scene again.
+/// Nodes added to the subtree afterwards are not paused.
+/// @return [self] the receiver.
+
+static VALUE
+node_pause_tree(VALUE rcv, SEL sel)
+{
+    node_pause_tree_walk(NODE(rcv));
+    return rcv;
+}
+
+/// @method #resume_tree
+/// Resumes the receiver and all of its descendants, after a call to
+/// {#pause_tree}.
+/// @return [self] the receiver.
+
+static VALUE
+node_resume_tree(VALUE rcv, SEL sel)
+{
+    node_resume_tree_walk(NODE(rcv));
+    return rcv;
+}
+
+// The time scale of a node is kept in its node info. Nodes without one have
+// a time scale of 1, and ancestors are only walked once a time scale was set.
+// The product of the time scales of the node and its ancestors is then
+// cached in the node info, until a time scale changes or a node is added
+// to a parent. Nodes moved natively by other classes keep the time scale of
+// their previous parent until then.
+
+static bool node_time_scale_used = false;
+
+static float
+node_time_scale_get(cocos2d::Node *node)
+{
+    auto info = mc_NodeInfo::get(node);
+    return info != NULL ? info->time_scale : 1;
+}
+
+// Returns the product of the time scales of the node and its ancestors.
+extern "C"
+float
+rb_ccnode_time_scale(cocos2d::Node *node)
+{
+    if (!node_time_scale_used) {
+	return 1;
+    }
+    auto info = mc_NodeInfo::get(node);
+    if (info != NULL
+	    && info->time_scale_generation == node_time_scale_generation) {
+	return info->effective_time_scale;
+    }
+    float scale = 1;
+    for (auto ancestor = node; ancestor != NULL;
+	    ancestor = ancestor->getParent()) {
+	scale *= node_time_scale_get(ancestor);
+    }
+    if (info == NULL) {
+	info = mc_NodeInfo::fetch(node);
+    }
+    info->effective_time_scale = scale;
+    info->time_scale_generation = node_time_scale_generation;
+    return scale;
+}
+
+/// @property #time_scale
+/// The speed at which time passes for the receiver and its descendants,
+/// multiplied by the time scales of its ancestors and {Director#time_scale}.
+/// Running actions, particles, blocks given to {#schedule} and
+/// {#schedule_once} and the {Scene#update} loop follow it, for slow motion
+/// or to freeze a part of a scene with +0+. Physics bodies all share the
+/// physics world of the scene, which only follows the time scale of the
+/// {Scene} itself.
+/// @return [Float] the time scale of the receiver, 1.0 by default.
+
+static VALUE
+node_time_scale(VALUE rcv, SEL sel)
+{
+    return DBL2NUM(node_time_scale_get(NODE(rcv)));
+}
+
+static VALUE
+node_time_scale_set(VALUE rcv, SEL sel, VALUE val)
+{
+    const float scale = NUM2DBL(val);
+    if (scale < 0) {
+	rb_raise(rb_eArgError, "time scale must not be negative");
+    }
+    node_time_scale_used = true;
+    node_time_scale_generation++;
+    mc_NodeInfo::fetch(NODE(rcv))->time_scale = scale;
+    rb_scene_update_physics_speed(rcv);
+    return val;
+}
+
+/// @method #save_prefab(path)
+/// Writes the receiver and all of its descendants into a binary prefab
+/// file, which can be instantiated again with {Prefab.load}. Only {Node} and
+/// {Sprite} objects can be saved; the receiver itself is saved as a plain
+/// {Node}.
+/// @param path [String] the path of the file to write.
+/// @return [self] the receiver.
+
+static VALUE
+node_save_prefab(VALUE rcv, SEL sel, VALUE path)
+{
+    rb_prefab_save(NODE(rcv), RSTRING_PTR(StringValue(path)));
+    return rcv;
+}
+
+/// @group Caching
+
+/// @method #cache_as_bitmap=(value)
+/// Set whether the children of the node should be rendered once into an
+/// offscreen texture, which is then drawn as a single quad for every frame.
+/// The texture is rendered again when a descendant is changed by the
+/// {Node} and {Sprite} setters, when children are added or removed, or when
+/// an action runs on a descendant. Other changes, such as the text of a
+/// widget or the motion of a physics body, require calling
+/// {#refresh_bitmap_cache}. This is intended for subtrees that rarely change,
+/// such as HUD frames or composed UI panels. Children with a negative
+/// z-order, or added with the maximum z-order after caching was enabled, are
+/// not cached and are drawn as usual.
+/// @param value [Boolean] true if the children should be cached.
+
+static VALUE
+node_cache_as_bitmap_set(VALUE rcv, SEL sel, VALUE val)
+{
+    auto node = NODE(rcv);
+    auto cache = bitmap_cache_get(node);
+    if (RTEST(val)) {
+	if (cache == NULL) {
+	    cache = mc_BitmapCache::create(NULL);
+	    cache->tail = mc_BitmapCache::create(cache);
+	    bitmap_cache_attach(node, cache);
+	}
+    }
+    else if (cache != NULL) {
+	bitmap_cache_detach(node, cache);
+    }
+    return val;
+}
+
+/// @method #cache_as_bitmap?
+/// @return [Boolean] whether the children of the node are cached into a
+///   texture. The default value is false.
+
+static VALUE
+node_cache_as_bitmap(VALUE rcv, SEL sel)
+{
+    return bitmap_cache_get(NODE(rcv)) != NULL ? Qtrue : Qfalse;
+}
+
+/// @method #refresh_bitmap_cache
+/// Renders the cached children into the texture again before the next
+/// frame, after changes which are not detected automatically.
+/// @return [self] the receiver.
+
+static VALUE
+node_refresh_bitmap_cache(VALUE rcv, SEL sel)
+{
+    auto cache = bitmap_cache_get(NODE(rcv));
+    if (cache != NULL) {
+	cache->dirty = true;
+    }
+    return rcv;
+}
+
+/// @property-readonly #bitmap_cache_hits
+/// @return [Integer] the number of frames where the cached texture was drawn
+///   as is.
+
+static VALUE
+node_bitmap_cache_hits(VALUE rcv, SEL sel)
+{
+    auto cache = bitmap_cache_get(NODE(rcv));
+    return LONG2NUM(cache != NULL ? cache->hits : 0);
+}
+
+/// @property-readonly #bitmap_cache_misses
+/// @return [Integer] the number of frames where the cached texture had to be
+///   rendered again.
+
+static VALUE
+node_bitmap_cache_misses(VALUE rcv, SEL sel)
+{
+    auto cache = bitmap_cache_get(NODE(rcv));
+    return LONG2NUM(cache != NULL ? cache->misses : 0);
+}
+
+/// @endgroup
+
 /// @class Parallax < Node
 
 #define PNODE(obj) _COCOS_WRAP_GET(obj, cocos2d::ParallaxNode)
@@ -474,9 +1051,237 @@ pnode_add(VALUE rcv, SEL sel, VALUE child, VALUE z, VALUE parallax_ratio,
     PNODE(rcv)->addChild(NODE(child), NUM2INT(z),
 	    rb_any_to_ccvec2(parallax_ratio),
 	    rb_any_to_ccvec2(position_offset));
+    rb_ccnode_added(NODE(child));
     return child;
 }
 
+/// @class ScrollingLayer < Node
+/// A ScrollingLayer tiles a sequence of sprites along one axis and scrolls
+/// them at a constant speed, moving segments that leave the screen back to
+/// the other end. All the work happens in native code at every frame, so
+/// infinite backgrounds do not need a Ruby update loop.
+///
+/// Segments are positioned relative to the bottom-left corner of the layer,
+/// which covers the visible area of the director along its scrolling axis.
+
+static VALUE rb_cScrollingLayer = Qnil;
+static VALUE sym_horizontal = Qnil, sym_vertical = Qnil;
+
+class mc_ScrollingLayer : public cocos2d::Node {
+    public:
+	std::vector<std::string> names;
+	std::vector<cocos2d::Sprite *> segments;
+	bool vertical;
+	float speed;
+	float spacing;
+	float offset;
+
+    mc_ScrollingLayer() {
+	vertical = false;
+	speed = spacing = offset = 0;
+    }
+
+    ~mc_ScrollingLayer() {
+	for (auto segment : segments) {
+	    segment->release();
+	}
+    }
+
+    static mc_ScrollingLayer *create(void) {
+	auto layer = new mc_ScrollingLayer();
+	layer->init();
+	layer->autorelease();
+	layer->scheduleUpdate();
+	return layer;
+    }
+
+    float length(cocos2d::Node *node) {
+	auto size = node->getContentSize();
+	return vertical ? size.height : size.width;
+    }
+
+    float stride(cocos2d::Node *node) {
+	return std::max(length(node) + spacing, 1.0f);
+    }
+
+    float period(void) {
+	float total = 0;
+	for (auto segment : segments) {
+	    total += stride(segment);
+	}
+	return total;
+    }
+
+    // Appends segments, cycling through the sprite names, until the layer
+    // can cover the visible area plus the largest segment, which is needed
+    // for the wrap-around to never leave a gap on screen.
+    void fill(void) {
+	auto visible = cocos2d::Director::getInstance()->getVisibleSize();
+	const float needed = vertical ? visible.height : visible.width;
+	float total = 0, largest = 0;
+	for (auto segment : segments) {
+	    total += stride(segment);
+	    largest = std::max(largest, stride(segment));
+	}
+	while (total < needed + largest) {
+	    auto segment = rb_ccsprite_create(
+		    names[segments.size() % names.size()].c_str());
+	    segment->setAnchorPoint(cocos2d::Vec2::ZERO);
+	    addChild(segment);
+	    segment->retain();
+	    segments.push_back(segment);
+	    total += stride(segment);
+	    largest = std::max(largest, stride(segment));
+	}
+
+	float breadth = 0;
+	for (auto segment : segments) {
+	    auto size = segment->getContentSize();
+	    breadth = std::max(breadth, vertical ? size.width : size.height);
+	}
+	setContentSize(vertical ? cocos2d::Size(breadth, needed)
+		: cocos2d::Size(needed, breadth));
+	place();
+    }
+
+    void place(void) {
+	const float total = period();
+	float start = 0;
+	for (auto segment : segments) {
+	    const float segment_stride = stride(segment);
+	    float pos = fmodf(start - offset, total);
+	    if (pos < 0) {
+		pos += total;
+	    }
+	    if (pos + segment_stride > total) {
+		pos -= total;
+	    }
+	    segment->setPosition(vertical ? cocos2d::Vec2(0, pos)
+		    : cocos2d::Vec2(pos, 0));
+	    start += segment_stride;
+	}
+    }
+
+    virtual void update(float delta) override {
+	if (speed != 0 && !segments.empty()) {
+	    offset = fmodf(offset + speed * delta * rb_ccnode_time_scale(this),
+		    period());
+	    place();
+	}
+    }
+};
+
+#define SCROLLING(obj) _COCOS_WRAP_GET(obj, mc_ScrollingLayer)
+
+/// @group Constructors
+
+/// @method #initialize(sprite_names, speed, direction=:horizontal)
+/// Creates a new scrolling layer.
+/// @param sprite_names [String, Array<String>] the name of the sprite, or
+///   the names of the sprites, to tile. Names are cycled in order and follow
+///   the same rules as {Sprite#initialize}.
+/// @param speed [Float] the scrolling speed, in points per second.
+///   Positive values scroll to the left (or down for vertical layers).
+/// @param direction [Symbol] either +:horizontal+ or +:vertical+.
+
+static VALUE
+scrolling_new(VALUE rcv, SEL sel, int argc, VALUE *argv)
+{
+    VALUE names = Qnil, speed = Qnil, direction = Qnil;
+
+    rb_scan_args(argc, argv, "21", &names, &speed, &direction);
+
+    if (!rb_obj_is_kind_of(names, rb_cArray)) {
+	VALUE ary = rb_ary_new();
+	rb_ary_push(ary, names);
+	names = ary;
+    }
+    if (RARRAY_LEN(names) == 0) {
+	rb_raise(rb_eArgError, "expected at least one sprite name");
+    }
+    bool vertical = false;
+    if (direction == sym_vertical) {
+	vertical = true;
+    }
+    else if (direction != Qnil && direction != sym_horizontal) {
+	rb_raise(rb_eArgError, "expected :horizontal or :vertical symbol");
+    }
+
+    auto layer = mc_ScrollingLayer::create();
+    layer->vertical = vertical;
+    layer->speed = NUM2DBL(speed);
+    for (long i = 0, count = RARRAY_LEN(names); i < count; i++) {
+	layer->names.push_back(RSTRING_PTR(StringValue(RARRAY_AT(names, i))));
+    }
+    layer->fill();
+    return rb_cocos2d_object_new(layer, rcv);
+}
+
+/// @endgroup
+
+/// @group Properties
+
+/// @property #speed
+/// @return [Float] the scrolling speed, in points per second. Set it to
+///   +0+ to stop the layer.
+
+static VALUE
+scrolling_speed(VALUE rcv, SEL sel)
+{
+    return DBL2NUM(SCROLLING(rcv)->speed);
+}
+
+static VALUE
+scrolling_speed_set(VALUE rcv, SEL sel, VALUE speed)
+{
+    SCROLLING(rcv)->speed = NUM2DBL(speed);
+    return speed;
+}
+
+/// @property #spacing
+/// @return [Float] the distance between two consecutive segments. Use a
+///   negative value to make segments overlap and hide seams.
+
+static VALUE
+scrolling_spacing(VALUE rcv, SEL sel)
+{
+    return DBL2NUM(SCROLLING(rcv)->spacing);
+}
+
+static VALUE
+scrolling_spacing_set(VALUE rcv, SEL sel, VALUE spacing)
+{
+    auto layer = SCROLLING(rcv);
+    layer->spacing = NUM2DBL(spacing);
+    layer->fill();
+    return spacing;
+}
+
+/// @property-readonly #direction
+/// @return [Symbol] either +:horizontal+ or +:vertical+.
+
+static VALUE
+scrolling_direction(VALUE rcv, SEL sel)
+{
+    return SCROLLING(rcv)->vertical ? sym_vertical : sym_horizontal;
+}
+
+/// @property-readonly #segments
+/// @return [Array<Sprite>] the sprites tiled by the layer, for example to
+///   attach physics bodies to them.
+
+static VALUE
+scrolling_segments(VALUE rcv, SEL sel)
+{
+    VALUE ary = rb_ary_new();
+    for (auto segment : SCROLLING(rcv)->segments) {
+	rb_ary_push(ary, rb_cocos2d_object_new(segment, rb_cSprite));
+    }
+    return ary;
+}
+
+/// @endgroup
+
 /// @class Draw < Node
 
 #define DRAW(obj) _COCOS_WRAP_GET(obj, cocos2d::DrawNode)
@@ -620,18 +1425,42 @@ Init_Node(void)
     rb_define_method(rb_cNode, "parent", node_parent, 0);
     rb_define_method(rb_cNode, "children", node_children, 0);
     rb_define_method(rb_cNode, "delete_from_parent", node_delete_from_parent, -1);
-    rb_define_method(rb_cNode, "run_action", node_run_action, 1);
+    rb_define_method(rb_cNode, "run_action", node_run_action, -1);
+    rb_define_method(rb_cNode, "run", node_run_action, -1);
     rb_define_method(rb_cNode, "stop_all_actions", node_stop_all_actions, 0);
     rb_define_method(rb_cNode, "schedule", node_schedule, -1);
     rb_define_method(rb_cNode, "schedule_once", node_schedule_once, 1);
     rb_define_method(rb_cNode, "unschedule", node_unschedule, 1);
     rb_define_method(rb_cNode, "number_of_running_actions", node_number_of_running_actions, 0);
+    rb_define_method(rb_cNode, "pause_tree", node_pause_tree, 0);
+    rb_define_method(rb_cNode, "resume_tree", node_resume_tree, 0);
+    rb_define_method(rb_cNode, "time_scale", node_time_scale, 0);
+    rb_define_method(rb_cNode, "time_scale=", node_time_scale_set, 1);
+    rb_define_method(rb_cNode, "save_prefab", node_save_prefab, 1);
+    rb_define_method(rb_cNode, "cache_as_bitmap=", node_cache_as_bitmap_set, 1);
+    rb_define_method(rb_cNode, "cache_as_bitmap?", node_cache_as_bitmap, 0);
+    rb_define_method(rb_cNode, "bitmap_cache_hits", node_bitmap_cache_hits, 0);
+    rb_define_method(rb_cNode, "bitmap_cache_misses", node_bitmap_cache_misses, 0);
+    rb_define_method(rb_cNode, "refresh_bitmap_cache", node_refresh_bitmap_cache, 0);
 
     rb_cParallaxNode = rb_define_class_under(rb_mMC, "Parallax", rb_cNode);
 
     rb_define_singleton_method(rb_cParallaxNode, "alloc", pnode_alloc, 0);
     rb_define_method(rb_cParallaxNode, "add", pnode_add, 4);
 
+    sym_horizontal = rb_name2sym("horizontal");
+    sym_vertical = rb_name2sym("vertical");
+
+    rb_cScrollingLayer = rb_define_class_under(rb_mMC, "ScrollingLayer", rb_cNode);
+
+    rb_define_constructor(rb_cScrollingLayer, scrolling_new, -1);
+    rb_define_method(rb_cScrollingLayer, "speed", scrolling_speed, 0);
+    rb_define_method(rb_cScrollingLayer, "speed=", scrolling_speed_set, 1);
+    rb_define_method(rb_cScrollingLayer, "spacing", scrolling_spacing, 0);
+    rb_define_method(rb_cScrollingLayer, "spacing=", scrolling_spacing_set, 1);
+    rb_define_method(rb_cScrollingLayer, "direction", scrolling_direction, 0);
+    rb_define_method(rb_cScrollingLayer, "segments", scrolling_segments, 0);
+
     rb_cDrawNode = rb_define_class_under(rb_mMC, "Draw", rb_cNode);
 
     rb_define_singleton_method(rb_cDrawNode, "alloc", draw_alloc, 0);
@@ -7,6 +7,33 @@ VALUE rb_cParticle = Qnil;
 
 #define PARTICLE(obj) _COCOS_WRAP_GET(obj, cocos2d::ParticleSystemQuad)
 
+// Particle systems are simulated in the time of the node, see
+// Node#time_scale.
+
+class mc_ParticleSystem : public cocos2d::ParticleSystemQuad {
+    public:
+    static mc_ParticleSystem *create(const char *file) {
+	auto particle = new mc_ParticleSystem();
+	if (!particle->initWithFile(file)) {
+	    delete particle;
+	    return NULL;
+	}
+	particle->autorelease();
+	return particle;
+    }
+
+    static mc_ParticleSystem *createWithTotalParticles(int count) {
+	auto particle = new mc_ParticleSystem();
+	particle->initWithTotalParticles(count);
+	particle->autorelease();
+	return particle;
+    }
+
+    virtual void update(float delta) override {
+	cocos2d::ParticleSystemQuad::update(delta * rb_ccnode_time_scale(this));
+    }
+};
+
 /// @group Constructors
 
 /// @method #initialize(file_name=nil)
@@ -26,28 +53,46 @@ particle_new(VALUE rcv, SEL sel, int argc, VALUE *argv)
 
     cocos2d::ParticleSystem *particle = NULL;
     if (RTEST(name)) {
-	particle = cocos2d::ParticleSystemQuad::create(RSTRING_PTR(StringValue(name)));
+	particle = mc_ParticleSystem::create(RSTRING_PTR(StringValue(name)));
+	if (particle == NULL) {
+	    rb_raise(rb_eArgError, "can't load particle file `%s'",
+		    RSTRING_PTR(name));
+	}
     }
     else {
-	particle = cocos2d::ParticleSystemQuad::createWithTotalParticles(50);
+	particle = mc_ParticleSystem::createWithTotalParticles(50);
 	particle->setAutoRemoveOnFinish(true);
     }
     return rb_cocos2d_object_new(particle, rcv);
 }
 
 /// @property-writeonly #texture
-/// @return [String] the path of the texture file.
+/// @return [String, Array] the path of the texture file, or an array with
+///   the path and the pixel format of the texture, see {TextureCache}.
 
 static VALUE
-particle_texture_set(VALUE rcv, SEL sel, VALUE path)
+particle_texture_set(VALUE rcv, SEL sel, VALUE val)
 {
-    auto texture_cache = cocos2d::Director::getInstance()->getTextureCache();
-    auto texture = texture_cache->addImage(RSTRING_PTR(StringValue(path)));
+    VALUE path = val, format = Qnil;
+    if (rb_obj_is_kind_of(val, rb_cArray)) {
+	if (RARRAY_LEN(val) != 2) {
+	    rb_raise(rb_eArgError, "expected Array of 2 elements");
+	}
+	path = RARRAY_AT(val, 0);
+	format = RARRAY_AT(val, 1);
+    }
+    auto texture = rb_cctexture_load(RSTRING_PTR(StringValue(path)),
+	    rb_sym_to_cctexture_format(format));
+    if (texture == NULL) {
+	rb_raise(rb_eArgError, "can't load texture `%s'",
+		RSTRING_PTR(StringValue(path)));
+    }
     auto particle = PARTICLE(rcv);
     particle->setTexture(texture);
+    rb_texture_cache_used(texture);
     particle->setStartSize(texture->getPixelsWide());
     particle->setEndSize(texture->getPixelsWide());
-    return path;
+    return val;
 }
 
 /// @property #speed
@@ -0,0 +1,256 @@
+#include "rubymotion.h"
+#include "motion-game.h"
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+/// @class FollowPath < Action
+/// An action which moves a node along a curved path, at a constant speed.
+///
+///   path = MG::FollowPath.new([[0, 100], [200, 300], [400, 100]], 3,
+///     spline: :catmull_rom, orient: true).template!
+///   MG::Action.run_on(enemies, path, stagger: 0.5)
+///
+/// The path is sampled once, when the action is created, into a table of
+/// points and distances, which is then shared by all the copies of the
+/// action, for example the ones created by {Action#template!} and
+/// {Action.run_on}. Moving a node then only takes a binary search in the
+/// table.
+
+static VALUE rb_cFollowPath = Qnil;
+
+// Samples of a path, with the distance of each sample from the start of the
+// path.
+
+class mc_Path : public cocos2d::Ref {
+    public:
+	std::vector<cocos2d::Vec2> points;
+	std::vector<float> lengths;
+
+    static const int SEGMENT_SAMPLES = 24;
+
+    void add(const cocos2d::Vec2 &point) {
+	if (!points.empty()) {
+	    const float distance = point.distance(points.back());
+	    if (distance <= 0) {
+		return;
+	    }
+	    lengths.push_back(lengths.back() + distance);
+	}
+	else {
+	    lengths.push_back(0);
+	}
+	points.push_back(point);
+    }
+
+    float length(void) const {
+	return lengths.back();
+    }
+
+    // Returns the point at the given distance from the start of the path,
+    // and the direction of the path there.
+    cocos2d::Vec2 at(float distance, cocos2d::Vec2 *direction) const {
+	if (points.size() < 2) {
+	    if (direction != NULL) {
+		*direction = cocos2d::Vec2(1, 0);
+	    }
+	    return points.front();
+	}
+	auto next = std::upper_bound(lengths.begin() + 1, lengths.end() - 1,
+		distance);
+	const size_t i = next - lengths.begin();
+	const cocos2d::Vec2 &a = points[i - 1], &b = points[i];
+	const float t = std::min(std::max((distance - lengths[i - 1])
+		    / (lengths[i] - lengths[i - 1]), 0.0f), 1.0f);
+	if (direction != NULL) {
+	    *direction = b - a;
+	}
+	return a + (b - a) * t;
+    }
+
+    static cocos2d::Vec2 catmull_rom(const cocos2d::Vec2 &p0,
+	    const cocos2d::Vec2 &p1, const cocos2d::Vec2 &p2,
+	    const cocos2d::Vec2 &p3, float t) {
+	const float t2 = t * t, t3 = t2 * t;
+	return (p1 * 2 + (p2 - p0) * t + (p0 * 2 - p1 * 5 + p2 * 4 - p3) * t2
+		+ (p1 * 3 - p0 - p2 * 3 + p3) * t3) * 0.5f;
+    }
+
+    static cocos2d::Vec2 bezier(const cocos2d::Vec2 &p0,
+	    const cocos2d::Vec2 &p1, const cocos2d::Vec2 &p2,
+	    const cocos2d::Vec2 &p3, float t) {
+	const float u = 1 - t;
+	return p0 * (u * u * u) + p1 * (3 * u * u * t) + p2 * (3 * u * t * t)
+	    + p3 * (t * t * t);
+    }
+
+    static mc_Path *create(const std::vector<cocos2d::Vec2> &controls,
+	    const char *spline) {
+	auto path = new mc_Path();
+	path->autorelease();
+	const size_t count = controls.size();
+	if (strcmp(spline, "linear") == 0) {
+	    for (auto &point : controls) {
+		path->add(point);
+	    }
+	}
+	else if (strcmp(spline, "catmull_rom") == 0) {
+	    path->add(controls[0]);
+	    for (size_t i = 0; i + 1 < count; i++) {
+		// The end points are repeated.
+		const cocos2d::Vec2 &p0 = controls[i > 0 ? i - 1 : 0];
+		const cocos2d::Vec2 &p3 = controls[i + 2 < count ? i + 2 : i + 1];
+		for (int j = 1; j <= SEGMENT_SAMPLES; j++) {
+		    path->add(catmull_rom(p0, controls[i], controls[i + 1], p3,
+				(float)j / SEGMENT_SAMPLES));
+		}
+	    }
+	}
+	else if (strcmp(spline, "bezier") == 0) {
+	    if (count < 4 || (count - 1) % 3 != 0) {
+		rb_raise(rb_eArgError,
+			"a bezier path needs 3n+1 points, got %d", (int)count);
+	    }
+	    path->add(controls[0]);
+	    for (size_t i = 0; i + 3 < count; i += 3) {
+		for (int j = 1; j <= SEGMENT_SAMPLES; j++) {
+		    path->add(bezier(controls[i], controls[i + 1],
+				controls[i + 2], controls[i + 3],
+				(float)j / SEGMENT_SAMPLES));
+		}
+	    }
+	}
+	else {
+	    rb_raise(rb_eArgError, "invalid spline `%s'", spline);
+	}
+	return path;
+    }
+};
+
+class mc_FollowPath : public cocos2d::ActionInterval {
+    public:
+	mc_Path *path;
+	int ease;
+	bool orient;
+	bool relative;
+	cocos2d::Vec2 origin;
+
+    static mc_FollowPath *create(float duration, mc_Path *path, int ease,
+	    bool orient, bool relative) {
+	auto action = new mc_FollowPath();
+	action->initWithDuration(duration);
+	action->path = path;
+	path->retain();
+	action->ease = ease;
+	action->orient = orient;
+	action->relative = relative;
+	action->autorelease();
+	return action;
+    }
+
+    virtual ~mc_FollowPath() {
+	path->release();
+    }
+
+    virtual void startWithTarget(cocos2d::Node *target) override {
+	cocos2d::ActionInterval::startWithTarget(target);
+	origin = relative ? target->getPosition() - path->points.front()
+	    : cocos2d::Vec2::ZERO;
+    }
+
+    virtual void update(float t) override {
+	if (_target == NULL) {
+	    return;
+	}
+	cocos2d::Vec2 direction;
+	const cocos2d::Vec2 point = path->at(
+		rb_ease_apply(ease, t) * path->length(),
+		orient ? &direction : NULL);
+	_target->setPosition(origin + point);
+	if (orient) {
+	    _target->setRotation(-CC_RADIANS_TO_DEGREES(
+			atan2f(direction.y, direction.x)));
+	}
+    }
+
+    virtual mc_FollowPath *clone() const override {
+	return create(_duration, path, ease, orient, relative);
+    }
+
+    virtual mc_FollowPath *reverse() const override {
+	std::vector<cocos2d::Vec2> points(path->points.rbegin(),
+		path->points.rend());
+	return create(_duration, mc_Path::create(points, "linear"), ease,
+		orient, relative);
+    }
+};
+
+/// @group Constructors
+
+/// @method #initialize(points, duration, options=nil)
+/// Creates an action which moves the receiver along a path.
+/// @param points [Array<Point>] the control points of the path.
+/// @param duration [Float] the duration of the action, in seconds.
+/// @param options [Hash] the options.
+/// @option options [Symbol] :spline the curve going through the points,
+///   +:catmull_rom+ (the default) for a smooth curve through all the points,
+///   +:bezier+ for cubic Bézier curves where each point of the path is
+///   followed by 2 control points, or +:linear+ for straight lines.
+/// @option options [Boolean] :orient whether the receiver is rotated to face
+///   the direction of the path, +false+ by default.
+/// @option options [Boolean] :relative whether the path is relative to the
+///   position of the receiver when the action starts, +false+ by default.
+/// @option options [Symbol] :ease the easing curve, as accepted by {Tween}.
+/// @return [FollowPath] the action.
+
+static VALUE
+follow_path_new(VALUE rcv, SEL sel, int argc, VALUE *argv)
+{
+    VALUE points = Qnil, duration = Qnil, options = Qnil;
+    rb_scan_args(argc, argv, "21", &points, &duration, &options);
+
+    if (!rb_obj_is_kind_of(points, rb_cArray)) {
+	rb_raise(rb_eArgError, "expected Array of points");
+    }
+    std::vector<cocos2d::Vec2> controls;
+    for (int i = 0, count = RARRAY_LEN(points); i < count; i++) {
+	controls.push_back(rb_any_to_ccvec2(RARRAY_AT(points, i)));
+    }
+    if (controls.empty()) {
+	rb_raise(rb_eArgError, "a path needs at least one point");
+    }
+
+    VALUE pairs = rb_options_to_ary(options);
+    VALUE spline = rb_options_get(pairs, "spline");
+    if (spline != Qnil && !rb_obj_is_kind_of(spline, rb_cSymbol)) {
+	rb_raise(rb_eArgError, "expected Symbol spline");
+    }
+    auto path = mc_Path::create(controls,
+	    spline != Qnil ? rb_sym2name(spline) : "catmull_rom");
+    auto action = mc_FollowPath::create(NUM2DBL(duration), path,
+	    rb_sym_to_ease(rb_options_get(pairs, "ease")),
+	    RTEST(rb_options_get(pairs, "orient")),
+	    RTEST(rb_options_get(pairs, "relative")));
+    return rb_cocos2d_object_new(action, rcv);
+}
+
+/// @endgroup
+
+/// @property-readonly #length
+/// @return [Float] the length of the path.
+
+static VALUE
+follow_path_length(VALUE rcv, SEL sel)
+{
+    return DBL2NUM(((mc_FollowPath *)ACTION(rcv))->path->length());
+}
+
+extern "C"
+void
+Init_FollowPath(void)
+{
+    rb_cFollowPath = rb_define_class_under(rb_mMC, "FollowPath", rb_cAction);
+
+    rb_define_constructor(rb_cFollowPath, follow_path_new, -1);
+    rb_define_method(rb_cFollowPath, "length", follow_path_length, 0);
+}
@@ -0,0 +1,343 @@
+#include "rubymotion.h"
+#include "motion-game.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <typeinfo>
+
+/// @class Prefab < Object
+/// Prefabs are node trees saved into a compact binary file with
+/// {Node#save_prefab}. Loading a prefab creates the whole tree in a single
+/// call, which is much faster than building it node by node from Ruby.
+///
+/// A prefab contains, for every node, its type, name, transform, z-order,
+/// color, visibility, sprite name and physics box and masks.
+
+static VALUE rb_cPrefab = Qnil;
+
+// File layout, all values in little-endian order:
+//
+//   "MGPF" u32:version node
+//
+// where a node is:
+//
+//   u8:type str:name [str:sprite_name u8:flipped_x u8:flipped_y]
+//   f32:x f32:y f32:anchor_x f32:anchor_y f32:width f32:height
+//   f32:scale_x f32:scale_y f32:rotation i32:z u8:visible u8:r u8:g u8:b
+//   u8:opacity u8:has_body [f32:width f32:height u8:dynamic u8:gravitates
+//   i32:category i32:contact i32:collision] u32:children_count node*
+//
+// and a str is a u32 length followed by the bytes of the string.
+
+#define PREFAB_MAGIC	"MGPF"
+#define PREFAB_VERSION	1
+
+// Limits checked when reading, so that a corrupt file can neither exhaust the
+// stack nor make the reader allocate nodes for data it does not contain. The
+// smallest node is a plain node with an empty name, no body and no children.
+#define PREFAB_MAX_DEPTH	256
+#define PREFAB_MIN_NODE_SIZE	55
+
+enum {
+    PREFAB_NODE = 0,
+    PREFAB_SPRITE = 1
+};
+
+class mc_PrefabWriter {
+    public:
+	std::string buf;
+
+    void u8(uint8_t val) {
+	buf.push_back((char)val);
+    }
+
+    void u32(uint32_t val) {
+	for (int i = 0; i < 4; i++) {
+	    u8((val >> (i * 8)) & 0xff);
+	}
+    }
+
+    void i32(int32_t val) {
+	u32((uint32_t)val);
+    }
+
+    void f32(float val) {
+	uint32_t bits;
+	memcpy(&bits, &val, sizeof bits);
+	u32(bits);
+    }
+
+    void str(const std::string &val) {
+	u32(val.size());
+	buf.append(val);
+    }
+
+    void node(cocos2d::Node *node, bool root) {
+	cocos2d::Sprite *sprite = NULL;
+	const char *sprite_name = NULL;
+	if (!root) {
+	    sprite = dynamic_cast<cocos2d::Sprite *>(node);
+	    if (sprite != NULL) {
+		sprite_name = rb_ccsprite_name(sprite);
+		if (sprite_name == NULL) {
+		    rb_raise(rb_eArgError,
+			    "can't save a sprite which was not created with Sprite.new in a prefab");
+		}
+	    }
+	    else if (typeid(*node) != typeid(cocos2d::Node)) {
+		rb_raise(rb_eArgError,
+			"can't save a node of type `%s' in a prefab",
+			typeid(*node).name());
+	    }
+	}
+
+	u8(sprite != NULL ? PREFAB_SPRITE : PREFAB_NODE);
+	str(node->getName());
+	if (sprite != NULL) {
+	    str(sprite_name);
+	    u8(sprite->isFlippedX());
+	    u8(sprite->isFlippedY());
+	}
+
+	auto position = node->getPosition();
+	auto anchor = node->getAnchorPoint();
+	auto size = node->getContentSize();
+	f32(position.x);
+	f32(position.y);
+	f32(anchor.x);
+	f32(anchor.y);
+	f32(size.width);
+	f32(size.height);
+	f32(node->getScaleX());
+	f32(node->getScaleY());
+	f32(node->getRotation());
+	i32(node->getLocalZOrder());
+	u8(node->isVisible());
+	auto color = node->getColor();
+	u8(color.r);
+	u8(color.g);
+	u8(color.b);
+	u8(node->getOpacity());
+
+	auto body = node->getPhysicsBody();
+	cocos2d::PhysicsShapeBox *box = NULL;
+	if (body != NULL && body->getShapes().size() == 1) {
+	    box = dynamic_cast<cocos2d::PhysicsShapeBox *>(body->getShape(0));
+	}
+	u8(box != NULL);
+	if (box != NULL) {
+	    auto box_size = box->getSize();
+	    f32(box_size.width);
+	    f32(box_size.height);
+	    u8(body->isDynamic());
+	    u8(body->isGravityEnabled());
+	    i32(body->getCategoryBitmask());
+	    i32(body->getContactTestBitmask());
+	    i32(body->getCollisionBitmask());
+	}
+
+	std::vector<cocos2d::Node *> children;
+	for (auto child : node->getChildren()) {
+	    if (!rb_ccnode_is_internal(child)) {
+		children.push_back(child);
+	    }
+	}
+	u32(children.size());
+	for (auto child : children) {
+	    this->node(child, false);
+	}
+    }
+};
+
+class mc_PrefabReader {
+    public:
+	const unsigned char *bytes;
+	ssize_t size;
+	ssize_t pos;
+	std::string path;
+
+    mc_PrefabReader(const unsigned char *_bytes, ssize_t _size,
+	    const std::string &_path) {
+	bytes = _bytes;
+	size = _size;
+	pos = 0;
+	path = _path;
+    }
+
+    void need(ssize_t len) {
+	if (len < 0 || pos + len > size) {
+	    rb_raise(rb_eRuntimeError, "prefab file `%s' is truncated",
+		    path.c_str());
+	}
+    }
+
+    uint8_t u8(void) {
+	need(1);
+	return bytes[pos++];
+    }
+
+    uint32_t u32(void) {
+	uint32_t val = 0;
+	for (int i = 0; i < 4; i++) {
+	    val |= (uint32_t)u8() << (i * 8);
+	}
+	return val;
+    }
+
+    int32_t i32(void) {
+	return (int32_t)u32();
+    }
+
+    float f32(void) {
+	uint32_t bits = u32();
+	float val;
+	memcpy(&val, &bits, sizeof val);
+	return val;
+    }
+
+    std::string str(void) {
+	uint32_t len = u32();
+	need(len);
+	std::string val((const char *)bytes + pos, len);
+	pos += len;
+	return val;
+    }
+
+    cocos2d::Node *node(int depth = 0) {
+	if (depth > PREFAB_MAX_DEPTH) {
+	    rb_raise(rb_eRuntimeError,
+		    "prefab file `%s' has nodes nested deeper than %d levels",
+		    path.c_str(), PREFAB_MAX_DEPTH);
+	}
+	cocos2d::Node *node = NULL;
+	const uint8_t type = u8();
+	const std::string name = str();
+	switch (type) {
+	  case PREFAB_NODE:
+	    node = cocos2d::Node::create();
+	    break;
+
+	  case PREFAB_SPRITE:
+	    {
+		auto sprite = rb_ccsprite_create(str().c_str());
+		sprite->setFlippedX(u8());
+		sprite->setFlippedY(u8());
+		node = sprite;
+	    }
+	    break;
+
+	  default:
+	    rb_raise(rb_eRuntimeError,
+		    "prefab file `%s' contains an unknown node type %d",
+		    path.c_str(), type);
+	}
+	node->setName(name);
+
+	const float x = f32(), y = f32();
+	const float anchor_x = f32(), anchor_y = f32();
+	const float width = f32(), height = f32();
+	node->setPosition(x, y);
+	node->setAnchorPoint(cocos2d::Vec2(anchor_x, anchor_y));
+	if (type == PREFAB_NODE) {
+	    node->setContentSize(cocos2d::Size(width, height));
+	}
+	const float scale_x = f32(), scale_y = f32();
+	node->setScaleX(scale_x);
+	node->setScaleY(scale_y);
+	node->setRotation(f32());
+	node->setLocalZOrder(i32());
+	node->setVisible(u8());
+	const uint8_t r = u8(), g = u8(), b = u8();
+	node->setColor(cocos2d::Color3B(r, g, b));
+	node->setOpacity(u8());
+
+	if (u8()) {
+	    const float box_width = f32(), box_height = f32();
+	    auto body = cocos2d::PhysicsBody::createBox(
+		    cocos2d::Size(box_width, box_height));
+	    body->setDynamic(u8());
+	    body->setGravityEnable(u8());
+	    body->setCategoryBitmask(i32());
+	    body->setContactTestBitmask(i32());
+	    body->setCollisionBitmask(i32());
+	    node->setPhysicsBody(body);
+	}
+
+	const uint32_t count = u32();
+	if (count > (size - pos) / PREFAB_MIN_NODE_SIZE) {
+	    rb_raise(rb_eRuntimeError,
+		    "prefab file `%s' is truncated", path.c_str());
+	}
+	for (uint32_t i = 0; i < count; i++) {
+	    auto child = this->node(depth + 1);
+	    node->addChild(child, child->getLocalZOrder());
+	}
+	return node;
+    }
+};
+
+extern "C"
+void
+rb_prefab_save(cocos2d::Node *node, const char *path)
+{
+    mc_PrefabWriter writer;
+    writer.buf.append(PREFAB_MAGIC);
+    writer.u32(PREFAB_VERSION);
+    writer.node(node, true);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+	rb_raise(rb_eRuntimeError, "can't open `%s' for writing: %s", path,
+		strerror(errno));
+    }
+    const size_t written = fwrite(writer.buf.data(), 1, writer.buf.size(),
+	    file);
+    fclose(file);
+    if (written != writer.buf.size()) {
+	rb_raise(rb_eRuntimeError, "can't write prefab to `%s'", path);
+    }
+}
+
+/// @group Loading
+
+/// @method .load(path)
+/// Creates the node tree saved in the given prefab file.
+/// @param path [String] the path of a prefab file, either absolute or
+///   relative to the application's resource directory.
+/// @return [Node] the root node of the tree.
+
+static VALUE
+prefab_load(VALUE rcv, SEL sel, VALUE path)
+{
+    std::string path_str = RSTRING_PTR(StringValue(path));
+    auto data = cocos2d::FileUtils::getInstance()->getDataFromFile(path_str);
+    if (data.isNull()) {
+	rb_raise(rb_eArgError, "can't read prefab file `%s'",
+		path_str.c_str());
+    }
+
+    mc_PrefabReader reader(data.getBytes(), data.getSize(), path_str);
+    reader.need(4);
+    if (memcmp(data.getBytes(), PREFAB_MAGIC, 4) != 0) {
+	rb_raise(rb_eArgError, "`%s' is not a prefab file", path_str.c_str());
+    }
+    reader.pos += 4;
+    const uint32_t version = reader.u32();
+    if (version != PREFAB_VERSION) {
+	rb_raise(rb_eArgError, "prefab file `%s' has unsupported version %d",
+		path_str.c_str(), (int)version);
+    }
+    return rb_cocos2d_object_new(reader.node(), rb_cNode);
+}
+
+/// @endgroup
+
+extern "C"
+void
+Init_Prefab(void)
+{
+    rb_cPrefab = rb_define_class_under(rb_mMC, "Prefab", rb_cObject);
+
+    rb_define_singleton_method(rb_cPrefab, "load", prefab_load, 1);
+}
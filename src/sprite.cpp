@@ -1,13 +1,62 @@
 #include "rubymotion.h"
 #include "motion-game.h"
+#include <unordered_map>
+#include <unordered_set>
 
 /// @class Sprite < Node
 
 VALUE rb_cSprite = Qnil;
 
+// Returns the path of the texture used by the given spritesheet, following
+// the same rules as SpriteFrameCache.
+
+static std::string
+spritesheet_texture_path(const std::string &plist)
+{
+    auto utils = cocos2d::FileUtils::getInstance();
+    auto dict = utils->getValueMapFromFile(utils->fullPathForFilename(plist));
+    auto metadata = dict.find("metadata");
+    if (metadata != dict.end()
+	    && metadata->second.getType() == cocos2d::Value::Type::MAP) {
+	auto &meta = metadata->second.asValueMap();
+	auto texture = meta.find("textureFileName");
+	if (texture != meta.end()) {
+	    return utils->fullPathFromRelativeFile(texture->second.asString(),
+		    plist);
+	}
+    }
+    std::string path = plist;
+    const size_t dot = path.find_last_of(".");
+    if (dot != std::string::npos) {
+	path.erase(dot);
+    }
+    return path.append(".png");
+}
+
+// Loads a spritesheet, creating its texture with the given pixel format or
+// the one of the matching texture rule.
+
+static void
+spritesheet_load(const std::string &plist,
+	cocos2d::Texture2D::PixelFormat format)
+{
+    auto cache = cocos2d::SpriteFrameCache::getInstance();
+    if (cache->isSpriteFramesWithFileLoaded(plist)) {
+	return;
+    }
+    auto texture = rb_cctexture_load(spritesheet_texture_path(plist).c_str(),
+	    format);
+    if (texture != NULL) {
+	cache->addSpriteFramesWithFile(plist, texture);
+    }
+    else {
+	cache->addSpriteFramesWithFile(plist);
+    }
+}
+
 /// @group Spritesheets
 
-/// @method .load(file_name)
+/// @method .load(file_name, format=nil)
 /// Loads all sprites from the content of +file_name+, which should be
 /// the name of a property list spritesheet file in the application's resource
 /// directory. Once a spritesheet file is loaded, individual sprites can be
@@ -15,47 +64,272 @@ VALUE rb_cSprite = Qnil;
 /// Sprite frames files can be created with a visual editor such as
 /// TexturePacker.
 /// @param file_name [String] the name of the sprite frames property list file.
+/// @param format [Symbol] the pixel format of the spritesheet texture, see
+///   {TextureCache}. If not given, the format of the matching texture rule
+///   is used, or 32-bit RGBA.
 /// @return [nil]
 
 static VALUE
-sprite_load(VALUE rcv, SEL sel, VALUE plist_path)
+sprite_load(VALUE rcv, SEL sel, int argc, VALUE *argv)
 {
-    cocos2d::SpriteFrameCache::getInstance()->addSpriteFramesWithFile(
-	    RSTRING_PTR(StringValue(plist_path)));
+    VALUE plist_path = Qnil, format = Qnil;
+
+    rb_scan_args(argc, argv, "11", &plist_path, &format);
+
+    spritesheet_load(RSTRING_PTR(StringValue(plist_path)),
+	    rb_sym_to_cctexture_format(format));
     return Qnil;
 }
 
-/// @group Constructors
+// Images packed by `rake assets:pack' are listed in atlas_index.plist, which
+// maps their file names to the spritesheet of their atlas. A spritesheet is
+// loaded the first time one of its frames is needed, so that packed images
+// can still be referred to by their file names.
 
-/// @method #initialize(sprite_name)
-/// Creates a new sprite object from +sprite_name+, which must be either the
-/// name of a standalone image file in the application's resource directory
-/// or the name of a sprite frame which was loaded from a spritesheet using
-/// {load}.
-/// @param sprite_name [String] the name of the sprite to create.
+#define ATLAS_INDEX "atlas_index.plist"
 
-static VALUE
-sprite_new(VALUE rcv, SEL sel, VALUE name)
+static cocos2d::ValueMap *atlas_index = NULL;
+
+extern "C"
+cocos2d::SpriteFrame *
+rb_ccsprite_frame(const char *name)
+{
+    auto cache = cocos2d::SpriteFrameCache::getInstance();
+    auto frame = cache->getSpriteFrameByName(name);
+    if (frame == NULL) {
+	// Frames whose texture was evicted by the texture cache budget.
+	frame = rb_texture_cache_restore_frame(name);
+    }
+    if (frame == NULL) {
+	if (atlas_index == NULL) {
+	    atlas_index = new cocos2d::ValueMap();
+	    auto utils = cocos2d::FileUtils::getInstance();
+	    if (utils->isFileExist(ATLAS_INDEX)) {
+		*atlas_index = utils->getValueMapFromFile(ATLAS_INDEX);
+	    }
+	}
+	auto atlas = atlas_index->find(name);
+	if (atlas != atlas_index->end()) {
+	    spritesheet_load(atlas->second.asString(),
+		    cocos2d::Texture2D::PixelFormat::AUTO);
+	    frame = cache->getSpriteFrameByName(name);
+	}
+	else {
+	    // Loose image, which may be copied into the dynamic atlas.
+	    frame = rb_dynamic_atlas_frame(name);
+	}
+    }
+    return frame;
+}
+
+static mc_NodeInfo *
+sprite_info(cocos2d::Sprite *sprite)
 {
-    std::string name_str = RSTRING_PTR(StringValue(name));
+    return mc_NodeInfo::fetch(sprite);
+}
+
+// The names sprites were created with, so that they can be written into a
+// prefab and created again later. Names are interned and the user data of a
+// sprite points to its own, so that sprites do not need a copy.
+
+static std::unordered_set<std::string> sprite_names;
+
+static const std::string *
+sprite_name_intern(const std::string &name)
+{
+    return &*sprite_names.insert(name).first;
+}
+
+static void
+sprite_set_name(cocos2d::Sprite *sprite, const std::string *name)
+{
+    sprite->setUserData((void *)name);
+}
+
+static cocos2d::Sprite *
+sprite_create(const char *name, cocos2d::Texture2D::PixelFormat format)
+{
+    std::string name_str = name;
     cocos2d::Sprite *sprite = NULL;
 
-    // Are we trying to retrieve a sprite frame?
+    // Are we trying to retrieve a sprite frame? An explicit pixel format
+    // means the image gets its own texture, so atlases are not looked up.
     cocos2d::SpriteFrame *sprite_frame =
-	cocos2d::SpriteFrameCache::getInstance()->getSpriteFrameByName(
-		name_str);
+	format == cocos2d::Texture2D::PixelFormat::AUTO
+	? rb_ccsprite_frame(name)
+	: cocos2d::SpriteFrameCache::getInstance()->getSpriteFrameByName(name);
     if (sprite_frame != NULL) {
 	sprite = cocos2d::Sprite::createWithSpriteFrame(sprite_frame);
+	if (sprite != NULL) {
+	    rb_dynamic_atlas_track(sprite, name);
+	}
     }
     else {
 	// A regular sprite file.
-	sprite = cocos2d::Sprite::create(name_str);
+	auto texture = rb_cctexture_load(name, format);
+	if (texture != NULL) {
+	    sprite = cocos2d::Sprite::createWithTexture(texture);
+	}
     }
     if (sprite == NULL) {
 	rb_raise(rb_eRuntimeError, "Can't create Sprite with `%s'. " \
 		"Need a proper sprite name or calling Sprite.load() for sprite frame.", name_str.c_str());
     }
-    return rb_cocos2d_object_new(sprite, rcv);
+    rb_texture_cache_used(sprite->getTexture());
+    sprite_set_name(sprite, sprite_name_intern(name_str));
+    return sprite;
+}
+
+extern "C"
+cocos2d::Sprite *
+rb_ccsprite_create(const char *name)
+{
+    return sprite_create(name, cocos2d::Texture2D::PixelFormat::AUTO);
+}
+
+extern "C"
+const char *
+rb_ccsprite_name(cocos2d::Sprite *sprite)
+{
+    auto name = (const std::string *)sprite->getUserData();
+    return name != NULL ? name->c_str() : NULL;
+}
+
+extern "C"
+bool
+rb_ccsprite_alpha_shape(cocos2d::Sprite *sprite)
+{
+    auto info = mc_NodeInfo::get(sprite);
+    return info != NULL && info->alpha_shape;
+}
+
+// Sprite frame handles, see the SpriteFrame class below.
+
+static VALUE rb_cSpriteFrame = Qnil;
+
+// The object wrapped by a handle, which keeps everything setting the frame
+// of a sprite needs, so that handles do not have to be looked up.
+
+class mc_SpriteFrameHandle : public cocos2d::Ref {
+    public:
+	cocos2d::SpriteFrame *frame;
+	const std::string *name;
+	// Whether the frame is in the dynamic atlas, which tracks the sprites
+	// displaying it.
+	bool atlas;
+
+    mc_SpriteFrameHandle(cocos2d::SpriteFrame *_frame,
+	    const std::string *_name) {
+	frame = _frame;
+	frame->retain();
+	name = _name;
+	atlas = rb_dynamic_atlas_contains(frame);
+    }
+
+    virtual ~mc_SpriteFrameHandle() {
+	frame->release();
+    }
+};
+
+#define SPRITE_FRAME(obj) _COCOS_WRAP_GET(obj, mc_SpriteFrameHandle)
+
+static std::unordered_map<std::string, VALUE> sprite_frame_handles;
+
+extern "C"
+cocos2d::SpriteFrame *
+rb_ccsprite_frame_handle(VALUE obj)
+{
+    return rb_obj_is_kind_of(obj, rb_cSpriteFrame)
+	? SPRITE_FRAME(obj)->frame : NULL;
+}
+
+// Gives a sprite a frame, remembering its name for prefabs. The texture
+// cache is only told about textures the sprite did not use already.
+
+static void
+sprite_set_frame(cocos2d::Sprite *sprite, cocos2d::SpriteFrame *frame,
+	const std::string *name, bool atlas)
+{
+    auto texture = sprite->getTexture();
+    sprite->setSpriteFrame(frame);
+    rb_ccnode_changed(sprite);
+    sprite_set_name(sprite, name);
+    if (atlas) {
+	rb_dynamic_atlas_track(sprite, name->c_str());
+    }
+    if (sprite->getTexture() != texture) {
+	rb_texture_cache_used(sprite->getTexture());
+    }
+}
+
+static void
+sprite_set_frame_handle(cocos2d::Sprite *sprite, VALUE obj)
+{
+    auto handle = SPRITE_FRAME(obj);
+    sprite_set_frame(sprite, handle->frame, handle->name, handle->atlas);
+}
+
+static cocos2d::SpriteFrame *sprite_frame_lookup(const std::string &name);
+
+/// @group Constructors
+
+/// @method #initialize(sprite_name, format=nil)
+/// Creates a new sprite object from +sprite_name+, which must be either the
+/// name of a standalone image file in the application's resource directory
+/// or the name of a sprite frame which was loaded from a spritesheet using
+/// {load}. Standalone images are copied into the {DynamicAtlas} when it is
+/// enabled.
+/// @param sprite_name [String, SpriteFrame] the name of the sprite to
+///   create, or a sprite frame handle, which creates the sprite without any
+///   lookup.
+/// @param format [Symbol] the pixel format of the texture created for a
+///   standalone image file, see {TextureCache}. It is ignored if the texture
+///   is already loaded.
+
+static VALUE
+sprite_new(VALUE rcv, SEL sel, int argc, VALUE *argv)
+{
+    VALUE name = Qnil, format = Qnil;
+
+    rb_scan_args(argc, argv, "11", &name, &format);
+
+    if (rb_obj_is_kind_of(name, rb_cSpriteFrame)) {
+	auto sprite = cocos2d::Sprite::create();
+	sprite_set_frame_handle(sprite, name);
+	return rb_cocos2d_object_new(sprite, rcv);
+    }
+    return rb_cocos2d_object_new(sprite_create(RSTRING_PTR(StringValue(name)),
+		rb_sym_to_cctexture_format(format)), rcv);
+}
+
+/// @group Frames
+
+/// @property-writeonly #frame
+/// Changes the image of the sprite. Names are looked up every time, unless
+/// a handle was created for them, so handles are faster for frames which
+/// change often.
+/// @return [SpriteFrame, String] a sprite frame handle, or the name of a
+///   sprite frame as accepted by {SpriteFrame.[]}.
+
+static VALUE
+sprite_frame_set(VALUE rcv, SEL sel, VALUE frame)
+{
+    if (rb_obj_is_kind_of(frame, rb_cSpriteFrame)) {
+	sprite_set_frame_handle(SPRITE(rcv), frame);
+	return frame;
+    }
+    // Names are looked up without creating a handle, which would be kept
+    // forever.
+    std::string name = RSTRING_PTR(StringValue(frame));
+    auto iter = sprite_frame_handles.find(name);
+    if (iter != sprite_frame_handles.end()) {
+	sprite_set_frame_handle(SPRITE(rcv), iter->second);
+    }
+    else {
+	sprite_set_frame(SPRITE(rcv), sprite_frame_lookup(name),
+		sprite_name_intern(name), true);
+    }
+    return frame;
 }
 
 /// @group Actions
@@ -65,12 +339,8 @@ run_action(VALUE rcv, cocos2d::FiniteTimeAction *action)
 {
     VALUE block = rb_current_block();
     if (block != Qnil) {
-	block = rb_retain(block); // FIXME need release...
-	auto call_funcn =
-	    cocos2d::CallFuncN::create([block](cocos2d::Node *node) {
-		rb_block_call(block, 0, NULL);
-	    });
-	action = cocos2d::Sequence::create(action, call_funcn, (void *)0);
+	action = cocos2d::Sequence::create(action,
+		rb_ccaction_completion(block, Qnil), (void *)0);
     }
     SPRITE(rcv)->runAction(action);
     return rcv;
@@ -88,7 +358,7 @@ run_action(VALUE rcv, cocos2d::FiniteTimeAction *action)
 static VALUE
 sprite_move_by(VALUE rcv, SEL sel, VALUE delta_location, VALUE interval)
 {
-    return run_action(rcv, cocos2d::MoveBy::create(NUM2DBL(interval),
+    return run_action(rcv, rb_ccmove_by_create(NUM2DBL(interval),
 		    rb_any_to_ccvec2(delta_location)));
 }
 
@@ -102,7 +372,7 @@ sprite_move_by(VALUE rcv, SEL sel, VALUE delta_location, VALUE interval)
 static VALUE
 sprite_move_to(VALUE rcv, SEL sel, VALUE location, VALUE interval)
 {
-    return run_action(rcv, cocos2d::MoveTo::create(NUM2DBL(interval),
+    return run_action(rcv, rb_ccmove_to_create(NUM2DBL(interval),
 		    rb_any_to_ccvec2(location)));
 }
 
@@ -117,7 +387,7 @@ sprite_move_to(VALUE rcv, SEL sel, VALUE location, VALUE interval)
 static VALUE
 sprite_rotate_by(VALUE rcv, SEL sel, VALUE delta_angle, VALUE interval)
 {
-    return run_action(rcv, cocos2d::RotateBy::create(NUM2DBL(interval),
+    return run_action(rcv, rb_ccrotate_by_create(NUM2DBL(interval),
 		    NUM2DBL(delta_angle)));
 }
 
@@ -132,7 +402,7 @@ sprite_rotate_by(VALUE rcv, SEL sel, VALUE delta_angle, VALUE interval)
 static VALUE
 sprite_rotate_to(VALUE rcv, SEL sel, VALUE angle, VALUE interval)
 {
-    return run_action(rcv, cocos2d::RotateTo::create(NUM2DBL(interval),
+    return run_action(rcv, rb_ccrotate_to_create(NUM2DBL(interval),
 		    NUM2DBL(angle)));
 }
 
@@ -147,7 +417,7 @@ sprite_rotate_to(VALUE rcv, SEL sel, VALUE angle, VALUE interval)
 static VALUE
 sprite_blink(VALUE rcv, SEL sel, VALUE blinks, VALUE interval)
 {
-    return run_action(rcv, cocos2d::Blink::create(NUM2DBL(interval),
+    return run_action(rcv, rb_ccblink_create(NUM2DBL(interval),
 		    NUM2INT(blinks)));
 }
 
@@ -155,56 +425,30 @@ sprite_blink(VALUE rcv, SEL sel, VALUE blinks, VALUE interval)
 /// Starts an animation where the sprite display frame will be changed to
 /// the given frames in +sprite_frames_names+ based on the given +delay+ and
 /// repeated +loops+ times.
-/// @param frame_names [Array<String>] an array of sprite frames to load and
-///   use for the animation, which can be either the names of standalone image
-///   files in the application's resource directory or the names of sprite
-///   frames loaded from a spritesheet using {load}.
+/// @param frame_names [Array<String, SpriteFrame>] an array of sprite
+///   frames to load and use for the animation, which can be either the names
+///   of standalone image files in the application's resource directory, the
+///   names of sprite frames loaded from a spritesheet using {load}, or
+///   {SpriteFrame} handles.
 /// @param delay [Float] the delay in seconds between each frame animation.
 /// @param loops [Integer] the number of times the animation should loop.
 ///   If {Repeat::FOREVER} (or negative value directly) was given, the animation will loop forever.
 /// @return [self] the receiver.
 /// @yield if passed a block, the block will be called for the action.
 
+/// @method #animate(animation_name, loops=1)
+/// Starts an animation registered with {Animation.define}, repeated +loops+
+/// times. The sprite frames of the animation are not looked up again.
+/// @param animation_name [Symbol] the name of the animation.
+/// @param loops [Integer] the number of times the animation should loop.
+///   If {Repeat::FOREVER} (or negative value directly) was given, the animation will loop forever.
+/// @return [self] the receiver.
+/// @yield if passed a block, the block will be called for the action.
+
 static VALUE
 sprite_animate(VALUE rcv, SEL sel, int argc, VALUE *argv)
 {
-    VALUE frame_names = Qnil, delay = Qnil, loops = Qnil;
-
-    rb_scan_args(argc, argv, "21", &frame_names, &delay, &loops);
-
-    cocos2d::Vector<cocos2d::SpriteFrame *> frames;
-    auto texture_cache = cocos2d::Director::getInstance()->getTextureCache();
-    for (int i = 0, count = RARRAY_LEN(frame_names); i < count; i++) {
-	VALUE name = RARRAY_AT(frame_names, i);
-	std::string frame_name = RSTRING_PTR(StringValue(name));
-	auto texture = texture_cache->addImage(frame_name);
-	cocos2d::SpriteFrame *frame = NULL;
-	if (texture != NULL) {
-	    cocos2d::Rect rect = cocos2d::Rect::ZERO;
-	    rect.size = texture->getContentSize();
-	    frame = cocos2d::SpriteFrame::createWithTexture(texture, rect);
-	}
-	else {
-	    frame = cocos2d::SpriteFrameCache::getInstance()->getSpriteFrameByName(frame_name);
-	}
-	if (frame == NULL) {
-	    rb_raise(rb_eRuntimeError, "Failed to create sprite frame.");
-	}
-	frames.pushBack(frame);
-    }
-
-    int loops_i = 1;
-    if (loops != Qnil) {
-	loops_i = NUM2LONG(loops);
-    }
-
-    auto animation = cocos2d::Animation::createWithSpriteFrames(frames,
-	    NUM2DBL(delay), loops_i);
-    cocos2d::ActionInterval *action = cocos2d::Animate::create(animation);
-    if (loops_i < 0) {
-	action = cocos2d::RepeatForever::create(action);
-    }
-    return run_action(rcv, action);
+    return run_action(rcv, rb_ccanimate_create(argc, argv));
 }
 
 
@@ -221,6 +465,7 @@ static VALUE
 sprite_flipped_horizontally_set(VALUE rcv, SEL sel, VALUE arg)
 {
     SPRITE(rcv)->setFlippedX(RTEST(arg));
+    rb_ccnode_changed(SPRITE(rcv));
     return arg;
 }
 
@@ -237,6 +482,7 @@ static VALUE
 sprite_flipped_vertically_set(VALUE rcv, SEL sel, VALUE arg)
 {
     SPRITE(rcv)->setFlippedY(RTEST(arg));
+    rb_ccnode_changed(SPRITE(rcv));
     return arg;
 }
 
@@ -475,6 +721,182 @@ sprite_collision_mask_set(VALUE rcv, SEL sel, VALUE arg)
     return arg;
 }
 
+/// @group Collisions
+
+/// @property #collision_shape
+/// The shape used by {Node#intersects?} for the sprite. With +:box+, the
+/// default, the sprite collides with its bounding box. With +:alpha+, it
+/// collides with the pixels of its frame which are more than half opaque,
+/// following its scale, flips and rotation. The pixel masks are created from
+/// the image files once per frame and cached.
+/// @return [Symbol] either +:box+ or +:alpha+.
+
+static VALUE
+sprite_collision_shape(VALUE rcv, SEL sel)
+{
+    return rb_name2sym(rb_ccsprite_alpha_shape(SPRITE(rcv)) ? "alpha" : "box");
+}
+
+static VALUE
+sprite_collision_shape_set(VALUE rcv, SEL sel, VALUE shape)
+{
+    bool alpha = false;
+    if (shape == rb_name2sym("alpha")) {
+	if (!rb_ccsprite_alpha_mask_available(SPRITE(rcv))) {
+	    rb_raise(rb_eArgError, "can't create an alpha mask for the sprite");
+	}
+	alpha = true;
+    }
+    else if (shape != rb_name2sym("box")) {
+	rb_raise(rb_eArgError, "expected :box or :alpha");
+    }
+    sprite_info(SPRITE(rcv))->alpha_shape = alpha;
+    return shape;
+}
+
+/// @endgroup
+
+/// @class SpriteFrame < Object
+/// A sprite frame is a handle on the image of a sprite, which is either a
+/// frame of a spritesheet or a standalone image file. Handles are resolved
+/// once and kept for the lifetime of the application, so creating sprites,
+/// changing their frame or animating them with handles does not look up any
+/// name, path or texture.
+///
+///   ASTEROID = MG::SpriteFrame['asteroid.png']
+///   rock = MG::Sprite.new(ASTEROID)
+
+/// @method .[](name)
+/// Returns the handle of a sprite frame.
+/// @param name [String] the name of a sprite frame loaded with
+///   {Sprite.load}, of an image packed by +rake assets:pack+, or of a
+///   standalone image file.
+/// @return [SpriteFrame] the handle, which is always the same object for a
+///   given name.
+
+static cocos2d::SpriteFrame *
+sprite_frame_lookup(const std::string &name)
+{
+    auto frame = rb_ccsprite_frame(name.c_str());
+    if (frame == NULL) {
+	auto texture = rb_cctexture_load(name.c_str(),
+		cocos2d::Texture2D::PixelFormat::AUTO);
+	if (texture != NULL) {
+	    cocos2d::Rect rect = cocos2d::Rect::ZERO;
+	    rect.size = texture->getContentSize();
+	    frame = cocos2d::SpriteFrame::createWithTexture(texture, rect);
+	}
+    }
+    if (frame == NULL) {
+	rb_raise(rb_eArgError, "Can't find sprite frame `%s'", name.c_str());
+    }
+    return frame;
+}
+
+static VALUE
+sprite_frame_get(VALUE rcv, SEL sel, VALUE name)
+{
+    std::string name_str = RSTRING_PTR(StringValue(name));
+    auto iter = sprite_frame_handles.find(name_str);
+    if (iter != sprite_frame_handles.end()) {
+	return iter->second;
+    }
+
+    auto handle = new mc_SpriteFrameHandle(sprite_frame_lookup(name_str),
+	    sprite_name_intern(name_str));
+    handle->autorelease();
+    VALUE obj = rb_retain(rb_cocos2d_object_new(handle, rb_cSpriteFrame));
+    sprite_frame_handles[name_str] = obj;
+    return obj;
+}
+
+/// @property-readonly #name
+/// @return [String] the name the handle was created with.
+
+static VALUE
+sprite_frame_name(VALUE rcv, SEL sel)
+{
+    return RSTRING_NEW(SPRITE_FRAME(rcv)->name->c_str());
+}
+
+/// @property-readonly #size
+/// @return [Size] the original size of the frame, in points.
+
+static VALUE
+sprite_frame_size(VALUE rcv, SEL sel)
+{
+    return rb_ccsize_to_obj(SPRITE_FRAME(rcv)->frame->getOriginalSize());
+}
+
+/// @class SpriteBatch < Node
+/// A SpriteBatch draws all of its sprites with a single draw call. Every
+/// sprite added to the batch must use the texture of the batch, which means
+/// it must be either created from the same image file or from a frame of the
+/// same spritesheet. The z-order of the sprites is honored inside the batch.
+
+static VALUE rb_cSpriteBatch = Qnil;
+
+#define SPRITE_BATCH(obj) _COCOS_WRAP_GET(obj, cocos2d::SpriteBatchNode)
+
+/// @group Constructors
+
+/// @method #initialize(file_name)
+/// Creates a new sprite batch.
+/// @param file_name [String] the name of either an image file or a
+///   property list spritesheet file in the application's resource
+///   directory. Spritesheets are loaded as with {Sprite.load}.
+
+static VALUE
+sprite_batch_new(VALUE rcv, SEL sel, VALUE name)
+{
+    std::string name_str = RSTRING_PTR(StringValue(name));
+    std::string texture_path = name_str;
+    if (cocos2d::FileUtils::getInstance()->getFileExtension(name_str)
+	    == ".plist") {
+	spritesheet_load(name_str, cocos2d::Texture2D::PixelFormat::AUTO);
+	texture_path = spritesheet_texture_path(name_str);
+    }
+    auto texture = rb_cctexture_load(texture_path.c_str(),
+	    cocos2d::Texture2D::PixelFormat::AUTO);
+    auto batch = texture == NULL
+	? NULL : cocos2d::SpriteBatchNode::createWithTexture(texture);
+    if (batch == NULL) {
+	rb_raise(rb_eRuntimeError, "Can't create SpriteBatch with `%s'",
+		name_str.c_str());
+    }
+    return rb_cocos2d_object_new(batch, rcv);
+}
+
+/// @endgroup
+
+/// @method #add(sprite, zpos=0)
+/// Adds a sprite to the receiver with a local z-order.
+/// @param sprite [Sprite] the sprite to add, which must use the texture of
+///   the receiver.
+/// @param zpos [Integer] the local z-order.
+/// @return [self] the receiver.
+
+static VALUE
+sprite_batch_add(VALUE rcv, SEL sel, int argc, VALUE *argv)
+{
+    VALUE child = Qnil, zpos = Qnil;
+    rb_scan_args(argc, argv, "11", &child, &zpos);
+
+    if (!rb_obj_is_kind_of(child, rb_cSprite)) {
+	rb_raise(rb_eArgError, "expected Sprite");
+    }
+    auto batch = SPRITE_BATCH(rcv);
+    auto sprite = SPRITE(child);
+    if (sprite->getTexture() != batch->getTexture()) {
+	rb_raise(rb_eArgError,
+		"sprite does not use the texture of the sprite batch");
+    }
+    rb_add_relationship(rcv, child);
+    batch->addChild(sprite, zpos == Qnil ? 0 : NUM2LONG(zpos));
+    rb_ccnode_added(sprite);
+    return rcv;
+}
+
 extern "C"
 void
 Init_Sprite(void)
@@ -482,8 +904,9 @@ Init_Sprite(void)
     rb_cSprite = rb_define_class_under(rb_mMC, "Sprite", rb_cNode);
     // rb_register_cocos2d_object_finalizer(rb_cSprite); removed because rb_cSprite inherits rb_cNode and it already has finalizer.
 
-    rb_define_singleton_method(rb_cSprite, "load", sprite_load, 1);
-    rb_define_constructor(rb_cSprite, sprite_new, 1);
+    rb_define_singleton_method(rb_cSprite, "load", sprite_load, -1);
+    rb_define_constructor(rb_cSprite, sprite_new, -1);
+    rb_define_method(rb_cSprite, "frame=", sprite_frame_set, 1);
     rb_define_method(rb_cSprite, "move_by", sprite_move_by, 2);
     rb_define_method(rb_cSprite, "move_to", sprite_move_to, 2);
     rb_define_method(rb_cSprite, "rotate_by", sprite_rotate_by, 2);
@@ -515,6 +938,20 @@ Init_Sprite(void)
     rb_define_method(rb_cSprite, "category_mask=", sprite_category_mask_set, 1);
     rb_define_method(rb_cSprite, "collision_mask", sprite_collision_mask, 0);
     rb_define_method(rb_cSprite, "collision_mask=", sprite_collision_mask_set, 1);
+    rb_define_method(rb_cSprite, "collision_shape", sprite_collision_shape, 0);
+    rb_define_method(rb_cSprite, "collision_shape=", sprite_collision_shape_set, 1);
     rb_define_method(rb_cSprite, "contact_mask", sprite_contact_mask, 0);
     rb_define_method(rb_cSprite, "contact_mask=", sprite_contact_mask_set, 1);
+
+    rb_cSpriteFrame = rb_define_class_under(rb_mMC, "SpriteFrame", rb_cObject);
+    rb_register_cocos2d_object_finalizer(rb_cSpriteFrame);
+
+    rb_define_singleton_method(rb_cSpriteFrame, "[]", sprite_frame_get, 1);
+    rb_define_method(rb_cSpriteFrame, "name", sprite_frame_name, 0);
+    rb_define_method(rb_cSpriteFrame, "size", sprite_frame_size, 0);
+
+    rb_cSpriteBatch = rb_define_class_under(rb_mMC, "SpriteBatch", rb_cNode);
+
+    rb_define_constructor(rb_cSpriteBatch, sprite_batch_new, 1);
+    rb_define_method(rb_cSpriteBatch, "add", sprite_batch_add, -1);
 }
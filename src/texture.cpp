@@ -0,0 +1,720 @@
+#include "rubymotion.h"
+#include "motion-game.h"
+#include <algorithm>
+#include <chrono>
+#include <fnmatch.h>
+#include <map>
+#include <mutex>
+#include <string.h>
+#include <strings.h>
+#include <unordered_map>
+
+/// @class TextureCache < Object
+/// The texture cache keeps the textures loaded from image files, so that they
+/// are shared by the sprites, particles and widgets which use the same files.
+///
+/// By default textures stay in the cache forever. When a {budget} is set, the
+/// least recently used textures which are not referenced by any node are
+/// removed from the cache when it grows larger than the budget. Removed
+/// textures are loaded again the next time they are needed, and so are the
+/// sprite frames which used them.
+///
+/// Textures are created as 32-bit RGBA by default. A smaller pixel format can
+/// be requested when loading an image, for instance with {Sprite#initialize}
+/// or {Sprite.load}, or with rules matching file names, which are read from
+/// the +texture_formats.plist+ file of the application's resource directory
+/// when it exists, or set with {format_rule}. The supported formats are
+/// +:rgba8888+, +:rgb888+, +:rgb565+, +:rgba4444+ and +:a8+.
+///
+/// When a PNG file has compressed variants made by +rake assets:compress+,
+/// the one supported by the device is loaded instead, unless a pixel format
+/// is requested.
+
+static VALUE rb_cTextureCache = Qnil;
+
+// Gives access to the textures and sprite frames kept by the caches, which
+// cocos2d-x does not expose.
+
+struct mc_TextureCacheAccess : public cocos2d::TextureCache {
+    static std::unordered_map<std::string, cocos2d::Texture2D *> &
+    textures(cocos2d::TextureCache *cache) {
+	return cache->*(&mc_TextureCacheAccess::_textures);
+    }
+};
+
+struct mc_SpriteFrameCacheAccess : public cocos2d::SpriteFrameCache {
+    static cocos2d::Map<std::string, cocos2d::SpriteFrame *> &
+    frames(cocos2d::SpriteFrameCache *cache) {
+	return cache->*(&mc_SpriteFrameCacheAccess::_spriteFrames);
+    }
+};
+
+class mc_TextureBudget {
+    public:
+	struct EvictedFrame {
+	    cocos2d::SpriteFrame *frame;
+	    std::string texture_path;
+	    cocos2d::Texture2D::PixelFormat format;
+	};
+
+	// The sprite frames of a texture, and whether one of them is retained
+	// outside of the frame cache.
+	struct TextureFrames {
+	    std::vector<std::string> names;
+	    bool used;
+	};
+
+	long budget;
+	std::unordered_map<cocos2d::Texture2D *, double> last_use;
+	std::map<std::string, EvictedFrame> evicted_frames;
+	// The number of textures in the cache when the budget was last
+	// enforced, so that it is only enforced again once textures are added.
+	size_t texture_count;
+
+    mc_TextureBudget() {
+	budget = 0;
+	texture_count = 0;
+    }
+
+    static mc_TextureBudget *shared(void) {
+	static mc_TextureBudget *budget = NULL;
+	if (budget == NULL) {
+	    budget = new mc_TextureBudget();
+	}
+	return budget;
+    }
+
+    static double now(void) {
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static long texture_size(cocos2d::Texture2D *texture) {
+	return (long)texture->getPixelsWide() * texture->getPixelsHigh()
+	    * texture->getBitsPerPixelForFormat() / 8;
+    }
+
+    static cocos2d::TextureCache *texture_cache(void) {
+	return cocos2d::Director::getInstance()->getTextureCache();
+    }
+
+    long usage(void) {
+	long total = 0;
+	for (auto &iter : mc_TextureCacheAccess::textures(texture_cache())) {
+	    total += texture_size(iter.second);
+	}
+	return total;
+    }
+
+    // Groups the frames of the frame cache by texture, in a single pass.
+    static std::unordered_map<cocos2d::Texture2D *, TextureFrames>
+    texture_frames(void) {
+	std::unordered_map<cocos2d::Texture2D *, TextureFrames> frames;
+	for (auto &iter : mc_SpriteFrameCacheAccess::frames(
+		    cocos2d::SpriteFrameCache::getInstance())) {
+	    auto &texture_frames = frames[iter.second->getTexture()];
+	    texture_frames.names.push_back(iter.first);
+	    if (iter.second->getReferenceCount() != 1) {
+		texture_frames.used = true;
+	    }
+	}
+	return frames;
+    }
+
+    // A texture can be removed when it is only retained by the cache and by
+    // sprite frames which are themselves only retained by the frame cache.
+    // In that case no node, action or animation uses it.
+    static bool is_evictable(cocos2d::Texture2D *texture,
+	    const TextureFrames *frames) {
+	if (frames == NULL) {
+	    return texture->getReferenceCount() == 1;
+	}
+	return !frames->used
+	    && texture->getReferenceCount() == 1 + frames->names.size();
+    }
+
+    void evict(const std::string &path, cocos2d::Texture2D *texture,
+	    const std::vector<std::string> &frame_names) {
+	auto frame_cache = cocos2d::SpriteFrameCache::getInstance();
+	for (auto &name : frame_names) {
+	    // The frame is kept without its texture, and restored when
+	    // looked up again.
+	    auto frame = frame_cache->getSpriteFrameByName(name);
+	    frame->retain();
+	    frame_cache->removeSpriteFrameByName(name);
+	    frame->setTexture(NULL);
+	    evicted_frames[name] = { frame, path, texture->getPixelFormat() };
+	}
+	last_use.erase(texture);
+	texture_cache()->removeTexture(texture);
+    }
+
+    void enforce(void) {
+	auto &textures = mc_TextureCacheAccess::textures(texture_cache());
+	texture_count = textures.size();
+	if (budget <= 0) {
+	    return;
+	}
+	long total = usage();
+	if (total <= budget) {
+	    return;
+	}
+
+	struct Candidate {
+	    std::string path;
+	    cocos2d::Texture2D *texture;
+	    std::vector<std::string> frame_names;
+	    double last_use;
+	};
+	std::vector<Candidate> candidates;
+	const double time = now();
+	auto frames = texture_frames();
+	for (auto &iter : textures) {
+	    auto found = frames.find(iter.second);
+	    const TextureFrames *frames_of_texture =
+		found == frames.end() ? NULL : &found->second;
+	    if (is_evictable(iter.second, frames_of_texture)) {
+		Candidate candidate;
+		if (frames_of_texture != NULL) {
+		    candidate.frame_names = frames_of_texture->names;
+		}
+		candidate.path = iter.first;
+		candidate.texture = iter.second;
+		auto use = last_use.find(iter.second);
+		candidate.last_use = use == last_use.end() ? 0 : use->second;
+		candidates.push_back(candidate);
+	    }
+	    else {
+		// Still used, which counts as a use.
+		last_use[iter.second] = time;
+	    }
+	}
+	std::sort(candidates.begin(), candidates.end(),
+		[](const Candidate &a, const Candidate &b) {
+		    return a.last_use < b.last_use;
+		});
+	for (auto &candidate : candidates) {
+	    if (total <= budget) {
+		break;
+	    }
+	    total -= texture_size(candidate.texture);
+	    evict(candidate.path, candidate.texture, candidate.frame_names);
+	}
+	texture_count = textures.size();
+    }
+
+    void used(cocos2d::Texture2D *texture) {
+	if (texture != NULL) {
+	    last_use[texture] = now();
+	}
+	if (mc_TextureCacheAccess::textures(texture_cache()).size()
+		> texture_count) {
+	    enforce();
+	}
+    }
+
+    cocos2d::SpriteFrame *restore(const std::string &name) {
+	auto iter = evicted_frames.find(name);
+	if (iter == evicted_frames.end()) {
+	    return NULL;
+	}
+	auto texture = rb_cctexture_load(iter->second.texture_path.c_str(),
+		iter->second.format);
+	if (texture == NULL) {
+	    return NULL;
+	}
+	auto frame = iter->second.frame;
+	frame->setTexture(texture);
+	cocos2d::SpriteFrameCache::getInstance()->addSpriteFrame(frame, name);
+	frame->release();
+	evicted_frames.erase(iter);
+	last_use[texture] = now();
+	return frame;
+    }
+};
+
+extern "C"
+void
+rb_texture_cache_used(cocos2d::Texture2D *texture)
+{
+    mc_TextureBudget::shared()->used(texture);
+}
+
+extern "C"
+cocos2d::SpriteFrame *
+rb_texture_cache_restore_frame(const char *name)
+{
+    auto budget = mc_TextureBudget::shared();
+    return budget->evicted_frames.empty() ? NULL : budget->restore(name);
+}
+
+// Pixel formats. Rules map file name patterns to the format of the textures
+// created from matching images; the most specific pattern wins. The loader's
+// worker threads look rules up too, hence the mutex.
+
+#define TEXTURE_FORMATS "texture_formats.plist"
+
+static std::vector<std::pair<std::string, cocos2d::Texture2D::PixelFormat>>
+    *texture_rules = NULL;
+static std::mutex texture_rules_mutex;
+static bool texture_dither = true;
+
+static bool
+texture_format_from_name(std::string name,
+	cocos2d::Texture2D::PixelFormat &format)
+{
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name == "rgba8888") {
+	format = cocos2d::Texture2D::PixelFormat::RGBA8888;
+    }
+    else if (name == "rgb888") {
+	format = cocos2d::Texture2D::PixelFormat::RGB888;
+    }
+    else if (name == "rgb565") {
+	format = cocos2d::Texture2D::PixelFormat::RGB565;
+    }
+    else if (name == "rgba4444") {
+	format = cocos2d::Texture2D::PixelFormat::RGBA4444;
+    }
+    else if (name == "a8") {
+	format = cocos2d::Texture2D::PixelFormat::A8;
+    }
+    else {
+	return false;
+    }
+    return true;
+}
+
+static void
+texture_rule_add(const std::string &pattern,
+	cocos2d::Texture2D::PixelFormat format)
+{
+    for (auto &rule : *texture_rules) {
+	if (rule.first == pattern) {
+	    rule.second = format;
+	    return;
+	}
+    }
+    texture_rules->push_back(std::make_pair(pattern, format));
+}
+
+static void
+texture_rules_load(void)
+{
+    if (texture_rules != NULL) {
+	return;
+    }
+    texture_rules = new std::vector<std::pair<std::string,
+		  cocos2d::Texture2D::PixelFormat>>();
+    auto utils = cocos2d::FileUtils::getInstance();
+    if (utils->isFileExist(TEXTURE_FORMATS)) {
+	for (auto &iter : utils->getValueMapFromFile(TEXTURE_FORMATS)) {
+	    cocos2d::Texture2D::PixelFormat format;
+	    if (texture_format_from_name(iter.second.asString(), format)) {
+		texture_rule_add(iter.first, format);
+	    }
+	    else {
+		CCLOG("%s: unknown pixel format `%s' for `%s'", TEXTURE_FORMATS,
+			iter.second.asString().c_str(), iter.first.c_str());
+	    }
+	}
+    }
+}
+
+extern "C"
+cocos2d::Texture2D::PixelFormat
+rb_cctexture_format_for(const char *path)
+{
+    std::lock_guard<std::mutex> lock(texture_rules_mutex);
+    texture_rules_load();
+    // Patterns without a directory match the file name in any directory.
+    const char *base = strrchr(path, '/');
+    base = base == NULL ? path : base + 1;
+    const std::pair<std::string, cocos2d::Texture2D::PixelFormat> *best =
+	NULL;
+    for (auto &rule : *texture_rules) {
+	const char *name =
+	    rule.first.find('/') == std::string::npos ? base : path;
+	if (rule.first == name) {
+	    return rule.second;
+	}
+	if (fnmatch(rule.first.c_str(), name, 0) == 0
+		&& (best == NULL || rule.first.size() > best->first.size())) {
+	    best = &rule;
+	}
+    }
+    return best == NULL ? cocos2d::Texture2D::PixelFormat::AUTO
+	: best->second;
+}
+
+extern "C"
+cocos2d::Texture2D::PixelFormat
+rb_sym_to_cctexture_format(VALUE sym)
+{
+    if (NIL_P(sym)) {
+	return cocos2d::Texture2D::PixelFormat::AUTO;
+    }
+    cocos2d::Texture2D::PixelFormat format;
+    if (!rb_obj_is_kind_of(sym, rb_cSymbol)
+	    || !texture_format_from_name(rb_sym2name(sym), format)) {
+	rb_raise(rb_eArgError, "invalid pixel format");
+    }
+    return format;
+}
+
+// Floyd-Steinberg error diffusion towards the given number of bits per
+// channel. Dithered values are stored so that the truncation done by
+// cocos2d-x when converting the image gives the nearest level.
+
+static void
+texture_dither_image(unsigned char *data, int width, int height,
+	int channels, const int *bits)
+{
+    std::vector<float> errors((size_t)(width + 2) * channels * 2, 0);
+    float *current = &errors[0];
+    float *next = &errors[(size_t)(width + 2) * channels];
+    for (int y = 0; y < height; y++) {
+	std::fill(next, next + (width + 2) * channels, 0);
+	for (int x = 0; x < width; x++) {
+	    unsigned char *px = data + ((size_t)y * width + x) * channels;
+	    for (int c = 0; c < channels; c++) {
+		if (bits[c] >= 8) {
+		    continue;
+		}
+		const float max_level = (1 << bits[c]) - 1;
+		const float value = std::min(255.0f, std::max(0.0f,
+			    px[c] + current[(x + 1) * channels + c]));
+		const int level = (int)(value * max_level / 255.0f + 0.5f);
+		const float error = value - level * 255.0f / max_level;
+		px[c] = level << (8 - bits[c]);
+		current[(x + 2) * channels + c] += error * 7 / 16;
+		next[x * channels + c] += error * 3 / 16;
+		next[(x + 1) * channels + c] += error * 5 / 16;
+		next[(x + 2) * channels + c] += error * 1 / 16;
+	    }
+	}
+	std::swap(current, next);
+    }
+}
+
+// Compressed variants created by `rake assets:compress' sit next to the PNG
+// files, x.pvr for PVRTC and x.pkm for ETC1. The first one supported by the
+// device is used instead of the PNG file.
+
+static std::unordered_map<std::string, std::string> *texture_variants = NULL;
+static std::mutex texture_variants_mutex;
+
+static const std::string &
+texture_variant(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(texture_variants_mutex);
+    if (texture_variants == NULL) {
+	texture_variants =
+	    new std::unordered_map<std::string, std::string>();
+    }
+    auto iter = texture_variants->find(path);
+    if (iter != texture_variants->end()) {
+	return iter->second;
+    }
+
+    std::string variant = path;
+    const size_t len = path.size();
+    if (len > 4 && strcasecmp(path.c_str() + len - 4, ".png") == 0) {
+	auto configuration = cocos2d::Configuration::getInstance();
+	auto utils = cocos2d::FileUtils::getInstance();
+	const std::string base = path.substr(0, len - 4);
+	if (configuration->supportsPVRTC() && utils->isFileExist(base + ".pvr")) {
+	    variant = base + ".pvr";
+	}
+	else if (configuration->supportsETC()
+		&& utils->isFileExist(base + ".pkm")) {
+	    variant = base + ".pkm";
+	}
+    }
+    return (*texture_variants)[path] = variant;
+}
+
+extern "C"
+bool
+rb_cctexture_has_variant(const char *path)
+{
+    return texture_variant(path) != path;
+}
+
+// Finds the image file a texture was loaded from, so that its pixels can be
+// read again. Compressed variants are mapped back to their PNG file, and
+// frames of the dynamic atlas to their own file, in which case x and y are
+// updated to be relative to it.
+
+extern "C"
+bool
+rb_cctexture_source(cocos2d::Texture2D *texture, std::string &path, int &x,
+	int &y)
+{
+    for (auto &iter : mc_TextureCacheAccess::textures(
+		mc_TextureBudget::texture_cache())) {
+	if (iter.second == texture) {
+	    path = iter.first;
+	    const size_t len = path.size();
+	    if (len > 4 && (strcasecmp(path.c_str() + len - 4, ".pvr") == 0
+			|| strcasecmp(path.c_str() + len - 4, ".pkm") == 0)) {
+		path.replace(len - 4, 4, ".png");
+	    }
+	    return true;
+	}
+    }
+    return rb_dynamic_atlas_source(texture, path, x, y);
+}
+
+// Dithers an image which is about to be converted to the given format.
+
+static void
+texture_dither_for(cocos2d::Image *image,
+	cocos2d::Texture2D::PixelFormat format)
+{
+    const auto render_format = image->getRenderFormat();
+    const int channels =
+	render_format == cocos2d::Texture2D::PixelFormat::RGBA8888
+	? 4 : render_format == cocos2d::Texture2D::PixelFormat::RGB888
+	? 3 : 0;
+    static const int rgb565_bits[] = { 5, 6, 5, 8 };
+    static const int rgba4444_bits[] = { 4, 4, 4, 4 };
+    if (texture_dither && channels > 0 && !image->isCompressed()) {
+	if (format == cocos2d::Texture2D::PixelFormat::RGB565) {
+	    texture_dither_image(image->getData(), image->getWidth(),
+		    image->getHeight(), channels, rgb565_bits);
+	}
+	else if (format == cocos2d::Texture2D::PixelFormat::RGBA4444) {
+	    texture_dither_image(image->getData(), image->getWidth(),
+		    image->getHeight(), channels, rgba4444_bits);
+	}
+    }
+}
+
+// Decodes the image of a texture as rb_cctexture_load would, resolving the
+// format from the rules when it is AUTO and setting key to the path the
+// texture is cached under, which is the one of the compressed variant when
+// one is used. This does not touch the texture cache, so that the loader can
+// call it from its worker threads.
+
+extern "C"
+cocos2d::Image *
+rb_cctexture_decode(const char *path, const std::string &full_path,
+	cocos2d::Texture2D::PixelFormat &format, std::string &key)
+{
+    if (format == cocos2d::Texture2D::PixelFormat::AUTO) {
+	format = rb_cctexture_format_for(path);
+    }
+    key = format == cocos2d::Texture2D::PixelFormat::AUTO
+	? texture_variant(full_path) : full_path;
+    auto image = new cocos2d::Image();
+    if (!image->initWithImageFile(key)) {
+	image->release();
+	return NULL;
+    }
+    if (format != cocos2d::Texture2D::PixelFormat::AUTO) {
+	texture_dither_for(image, format);
+    }
+    return image;
+}
+
+// Creates a texture from an image returned by rb_cctexture_decode, unless
+// the cache already has one for its key.
+
+extern "C"
+cocos2d::Texture2D *
+rb_cctexture_create(cocos2d::Image *image, const std::string &key,
+	cocos2d::Texture2D::PixelFormat format)
+{
+    auto cache = mc_TextureBudget::texture_cache();
+    auto texture = cache->getTextureForKey(key);
+    if (texture == NULL) {
+	// Images are converted to the default format when the texture is
+	// created.
+	const auto default_format =
+	    cocos2d::Texture2D::getDefaultAlphaPixelFormat();
+	if (format != cocos2d::Texture2D::PixelFormat::AUTO) {
+	    cocos2d::Texture2D::setDefaultAlphaPixelFormat(format);
+	}
+	texture = cache->addImage(image, key);
+	cocos2d::Texture2D::setDefaultAlphaPixelFormat(default_format);
+    }
+    if (texture != NULL) {
+	mc_TextureBudget::shared()->last_use[texture] =
+	    mc_TextureBudget::now();
+    }
+    return texture;
+}
+
+// Loads a texture into the cache with the given pixel format, or the one of
+// the matching rule. Without any, the compressed variant of the image is
+// used when there is one. A texture already in the cache is returned as is.
+
+extern "C"
+cocos2d::Texture2D *
+rb_cctexture_load(const char *path, cocos2d::Texture2D::PixelFormat format)
+{
+    auto cache = mc_TextureBudget::texture_cache();
+    const std::string full_path =
+	cocos2d::FileUtils::getInstance()->fullPathForFilename(path);
+    if (full_path.empty()) {
+	return NULL;
+    }
+    auto texture = cache->getTextureForKey(full_path);
+    if (texture == NULL) {
+	if (format == cocos2d::Texture2D::PixelFormat::AUTO) {
+	    format = rb_cctexture_format_for(path);
+	}
+	if (format == cocos2d::Texture2D::PixelFormat::AUTO) {
+	    texture = cache->addImage(texture_variant(full_path));
+	}
+	else {
+	    std::string key;
+	    auto image = rb_cctexture_decode(path, full_path, format, key);
+	    if (image != NULL) {
+		texture = rb_cctexture_create(image, key, format);
+		image->release();
+	    }
+	}
+    }
+    if (texture != NULL) {
+	mc_TextureBudget::shared()->last_use[texture] =
+	    mc_TextureBudget::now();
+    }
+    return texture;
+}
+
+/// @group Memory Budget
+
+/// @property .budget
+/// @return [Integer] the maximum size of the textures kept in the cache, in
+///   bytes. Textures used by nodes are never removed, so the cache can still
+///   grow larger. The default is +0+, which means no limit.
+
+static VALUE
+texture_cache_budget(VALUE rcv, SEL sel)
+{
+    return LONG2NUM(mc_TextureBudget::shared()->budget);
+}
+
+static VALUE
+texture_cache_budget_set(VALUE rcv, SEL sel, VALUE val)
+{
+    auto budget = mc_TextureBudget::shared();
+    budget->budget = std::max(0L, (long)NUM2LONG(val));
+    budget->enforce();
+    return val;
+}
+
+/// @property-readonly .usage
+/// @return [Integer] the size of the textures in the cache, in bytes.
+
+static VALUE
+texture_cache_usage(VALUE rcv, SEL sel)
+{
+    return LONG2NUM(mc_TextureBudget::shared()->usage());
+}
+
+/// @method .report
+/// Describes the textures in the cache, from the largest to the smallest.
+/// @return [Array] an array with, for every texture, an array containing
+///   its file path, width and height in pixels, size in bytes, pixel format
+///   name, reference count, the number of seconds since it was last used or
+///   +nil+ if unknown, and the size in bytes it would have as 32-bit RGBA,
+///   which shows the savings of compressed and smaller pixel formats.
+
+static VALUE
+texture_cache_report(VALUE rcv, SEL sel)
+{
+    auto budget = mc_TextureBudget::shared();
+    std::vector<std::pair<std::string, cocos2d::Texture2D *>> textures;
+    for (auto &iter : mc_TextureCacheAccess::textures(
+		mc_TextureBudget::texture_cache())) {
+	textures.push_back(iter);
+    }
+    std::sort(textures.begin(), textures.end(),
+	    [](const std::pair<std::string, cocos2d::Texture2D *> &a,
+		const std::pair<std::string, cocos2d::Texture2D *> &b) {
+		return mc_TextureBudget::texture_size(a.second)
+		    > mc_TextureBudget::texture_size(b.second);
+	    });
+
+    const double time = mc_TextureBudget::now();
+    VALUE report = rb_ary_new();
+    for (auto &iter : textures) {
+	auto texture = iter.second;
+	VALUE line = rb_ary_new();
+	rb_ary_push(line, RSTRING_NEW(iter.first.c_str()));
+	rb_ary_push(line, LONG2NUM(texture->getPixelsWide()));
+	rb_ary_push(line, LONG2NUM(texture->getPixelsHigh()));
+	rb_ary_push(line, LONG2NUM(mc_TextureBudget::texture_size(texture)));
+	rb_ary_push(line, RSTRING_NEW(texture->getStringForFormat()));
+	rb_ary_push(line, LONG2NUM(texture->getReferenceCount()));
+	auto use = budget->last_use.find(texture);
+	rb_ary_push(line, use == budget->last_use.end()
+		? Qnil : DBL2NUM(time - use->second));
+	rb_ary_push(line, LONG2NUM((long)texture->getPixelsWide()
+		    * texture->getPixelsHigh() * 4));
+	rb_ary_push(report, line);
+    }
+    return report;
+}
+
+/// @endgroup
+
+/// @group Pixel Formats
+
+/// @method .format_rule(pattern, format)
+/// Sets the pixel format of the textures created from the image files whose
+/// names match +pattern+. When several patterns match, the longest one is
+/// used. Textures already in the cache are not affected.
+/// @param pattern [String] a file name, or a shell pattern such as
+///   +'bg_*.png'+.
+/// @param format [Symbol] the pixel format.
+/// @return [nil]
+
+static VALUE
+texture_cache_format_rule(VALUE rcv, SEL sel, VALUE pattern, VALUE format)
+{
+    std::string pattern_str = RSTRING_PTR(StringValue(pattern));
+    auto pixel_format = rb_sym_to_cctexture_format(format);
+    std::lock_guard<std::mutex> lock(texture_rules_mutex);
+    texture_rules_load();
+    texture_rule_add(pattern_str, pixel_format);
+    return Qnil;
+}
+
+/// @property .dither?
+/// @return [Boolean] whether images are dithered when they are converted to
+///   the +:rgb565+ or +:rgba4444+ formats. The default is +true+.
+
+static VALUE
+texture_cache_dither(VALUE rcv, SEL sel)
+{
+    return texture_dither ? Qtrue : Qfalse;
+}
+
+static VALUE
+texture_cache_dither_set(VALUE rcv, SEL sel, VALUE val)
+{
+    texture_dither = RTEST(val);
+    return val;
+}
+
+/// @endgroup
+
+extern "C"
+void
+Init_TextureCache(void)
+{
+    rb_cTextureCache = rb_define_class_under(rb_mMC, "TextureCache",
+	    rb_cObject);
+
+    rb_define_singleton_method(rb_cTextureCache, "budget", texture_cache_budget, 0);
+    rb_define_singleton_method(rb_cTextureCache, "budget=", texture_cache_budget_set, 1);
+    rb_define_singleton_method(rb_cTextureCache, "usage", texture_cache_usage, 0);
+    rb_define_singleton_method(rb_cTextureCache, "report", texture_cache_report, 0);
+    rb_define_singleton_method(rb_cTextureCache, "format_rule", texture_cache_format_rule, 2);
+    rb_define_singleton_method(rb_cTextureCache, "dither?", texture_cache_dither, 0);
+    rb_define_singleton_method(rb_cTextureCache, "dither=", texture_cache_dither_set, 1);
+}
@@ -0,0 +1,383 @@
+#include "rubymotion.h"
+#include "motion-game.h"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+/// @class Timeline < Object
+/// Timelines describe the animation of a node tree with keyframes, for
+/// cutscenes or menu transitions. A timeline has tracks, which animate a
+/// property of a node, and event markers.
+///
+/// Timelines are authored as JSON files in the +assets/timelines+ directory
+/// of the project, which are compiled into +.tl+ files of the +resources+
+/// directory when the application is built:
+///
+///   {
+///     "duration": 2.5,
+///     "tracks": {
+///       "logo": {
+///         "position": [[0, [160, 600]], [1.2, [160, 400], "out_bounce"]],
+///         "alpha": [[0, 0], [0.5, 1]]
+///       },
+///       "menu/play": { "scale": [[1.2, 0], [1.6, 1, "out_back"]] }
+///     },
+///     "events": [[1.2, "shake"], [2.5, "done"]]
+///   }
+///
+/// Tracks are bound to the nodes of the tree by name, a path like
+/// +"menu/play"+ is the node named +play+ in the node named +menu+, and an
+/// empty path is the root node. A key is a time in seconds, a value, and an
+/// optional easing curve used from the previous key, as accepted by
+/// {Tween}. The properties are the ones supported by {Tween}.
+///
+/// Timelines are evaluated natively, Ruby code only runs at event markers.
+
+static VALUE rb_cTimeline = Qnil;
+
+// File layout, all values in little-endian order:
+//
+//   "MGTL" u32:version f32:duration u32:tracks_count track*
+//   u32:events_count event*
+//
+// where a track is:
+//
+//   str:node_path u8:property u32:keys_count key*
+//
+// a key is:
+//
+//   f32:time f32:value u8:ease
+//
+// an event is:
+//
+//   f32:time str:name
+//
+// and a str is a u32 length followed by the bytes of the string. Properties
+// are MC_PROPERTY_* values and easing curves rb_sym_to_ease() values. Keys
+// and events are sorted by time.
+
+#define TIMELINE_MAGIC		"MGTL"
+#define TIMELINE_VERSION	1
+
+class mc_Timeline : public cocos2d::Ref {
+    public:
+	struct Key {
+	    float time;
+	    float value;
+	    int ease;
+	};
+
+	struct Track {
+	    std::string path;
+	    int property;
+	    std::vector<Key> keys;
+	};
+
+	struct Event {
+	    float time;
+	    std::string name;
+	};
+
+	std::string file;
+	float duration;
+	std::vector<Track> tracks;
+	std::vector<Event> events;
+
+    static float evaluate(const std::vector<Key> &keys, float time) {
+	auto next = std::upper_bound(keys.begin(), keys.end(), time,
+		[](float time, const Key &key) { return time < key.time; });
+	if (next == keys.begin()) {
+	    return next->value;
+	}
+	if (next == keys.end()) {
+	    return keys.back().value;
+	}
+	auto prev = next - 1;
+	const float t = (time - prev->time) / (next->time - prev->time);
+	return prev->value
+	    + (next->value - prev->value) * rb_ease_apply(next->ease, t);
+    }
+};
+
+class mc_TimelineReader {
+    public:
+	const unsigned char *bytes;
+	ssize_t size;
+	ssize_t pos;
+	std::string path;
+
+    mc_TimelineReader(const unsigned char *_bytes, ssize_t _size,
+	    const std::string &_path) {
+	bytes = _bytes;
+	size = _size;
+	pos = 0;
+	path = _path;
+    }
+
+    void need(ssize_t len) {
+	if (len < 0 || pos + len > size) {
+	    rb_raise(rb_eRuntimeError, "timeline file `%s' is truncated",
+		    path.c_str());
+	}
+    }
+
+    uint8_t u8(void) {
+	need(1);
+	return bytes[pos++];
+    }
+
+    uint32_t u32(void) {
+	uint32_t val = 0;
+	for (int i = 0; i < 4; i++) {
+	    val |= (uint32_t)u8() << (i * 8);
+	}
+	return val;
+    }
+
+    float f32(void) {
+	uint32_t bits = u32();
+	float val;
+	memcpy(&val, &bits, sizeof val);
+	return val;
+    }
+
+    std::string str(void) {
+	uint32_t len = u32();
+	need(len);
+	std::string val((const char *)bytes + pos, len);
+	pos += len;
+	return val;
+    }
+
+    void timeline(mc_Timeline *timeline) {
+	timeline->duration = f32();
+	for (uint32_t i = 0, count = u32(); i < count; i++) {
+	    mc_Timeline::Track track;
+	    track.path = str();
+	    track.property = u8();
+	    if (track.property >= MC_PROPERTY_COUNT) {
+		rb_raise(rb_eRuntimeError,
+			"timeline file `%s' contains an unknown property %d",
+			path.c_str(), track.property);
+	    }
+	    for (uint32_t j = 0, keys_count = u32(); j < keys_count; j++) {
+		mc_Timeline::Key key;
+		key.time = f32();
+		key.value = f32();
+		key.ease = u8();
+		track.keys.push_back(key);
+	    }
+	    if (!track.keys.empty()) {
+		timeline->tracks.push_back(track);
+	    }
+	}
+	for (uint32_t i = 0, count = u32(); i < count; i++) {
+	    mc_Timeline::Event event;
+	    event.time = f32();
+	    event.name = str();
+	    timeline->events.push_back(event);
+	}
+    }
+};
+
+// Plays a timeline on a node tree. The tracks are bound to their nodes once,
+// when the action is created.
+
+class mc_TimelineAction : public cocos2d::ActionInterval {
+    public:
+	mc_Timeline *timeline;
+	std::vector<cocos2d::Node *> nodes;
+	mc_Block events_block;
+	float last_time;
+
+    static mc_TimelineAction *create(mc_Timeline *timeline,
+	    const std::vector<cocos2d::Node *> &nodes, mc_Block events_block) {
+	auto action = new mc_TimelineAction();
+	action->initWithDuration(timeline->duration);
+	action->timeline = timeline;
+	timeline->retain();
+	action->nodes = nodes;
+	for (auto node : nodes) {
+	    node->retain();
+	}
+	action->events_block = events_block;
+	action->last_time = -1;
+	action->autorelease();
+	return action;
+    }
+
+    virtual ~mc_TimelineAction() {
+	for (auto node : nodes) {
+	    node->release();
+	}
+	timeline->release();
+    }
+
+    virtual void startWithTarget(cocos2d::Node *target) override {
+	cocos2d::ActionInterval::startWithTarget(target);
+	last_time = -1;
+    }
+
+    virtual void update(float t) override {
+	const float time = t * timeline->duration;
+	for (size_t i = 0, count = timeline->tracks.size(); i < count; i++) {
+	    auto &track = timeline->tracks[i];
+	    rb_ccnode_property_set(nodes[i], track.property,
+		    mc_Timeline::evaluate(track.keys, time));
+	}
+
+	if (events_block.empty()) {
+	    return;
+	}
+	std::vector<const std::string *> names;
+	for (auto &event : timeline->events) {
+	    if (event.time > last_time && event.time <= time) {
+		names.push_back(&event.name);
+	    }
+	}
+	last_time = time;
+	if (!names.empty()) {
+	    // The block may stop the action.
+	    retain();
+	    auto block = events_block;
+	    for (auto name : names) {
+		VALUE name_obj = RSTRING_NEW(name->c_str());
+		block.call(1, &name_obj);
+	    }
+	    release();
+	}
+    }
+
+    virtual mc_TimelineAction *clone() const override {
+	return create(timeline, nodes, events_block);
+    }
+};
+
+#define TIMELINE(obj) _COCOS_WRAP_GET(obj, mc_Timeline)
+
+static cocos2d::Node *
+timeline_bind(mc_Timeline *timeline, cocos2d::Node *root,
+	const std::string &path)
+{
+    cocos2d::Node *node = root;
+    size_t pos = 0;
+    while (node != NULL && pos < path.size()) {
+	size_t end = path.find('/', pos);
+	if (end == std::string::npos) {
+	    end = path.size();
+	}
+	node = node->getChildByName(path.substr(pos, end - pos));
+	pos = end + 1;
+    }
+    if (node == NULL) {
+	rb_raise(rb_eArgError,
+		"timeline `%s' animates node `%s' which was not found",
+		timeline->file.c_str(), path.c_str());
+    }
+    return node;
+}
+
+/// @group Loading
+
+/// @method .load(path)
+/// Loads a timeline.
+/// @param path [String] the path of a +.tl+ file, either absolute or
+///   relative to the application's resource directory.
+/// @return [Timeline] the timeline.
+
+static VALUE
+timeline_load(VALUE rcv, SEL sel, VALUE path)
+{
+    std::string path_str = RSTRING_PTR(StringValue(path));
+    auto data = cocos2d::FileUtils::getInstance()->getDataFromFile(path_str);
+    if (data.isNull()) {
+	rb_raise(rb_eArgError, "can't read timeline file `%s'",
+		path_str.c_str());
+    }
+
+    mc_TimelineReader reader(data.getBytes(), data.getSize(), path_str);
+    reader.need(4);
+    if (memcmp(data.getBytes(), TIMELINE_MAGIC, 4) != 0) {
+	rb_raise(rb_eArgError, "`%s' is not a timeline file",
+		path_str.c_str());
+    }
+    reader.pos += 4;
+    const uint32_t version = reader.u32();
+    if (version != TIMELINE_VERSION) {
+	rb_raise(rb_eArgError, "timeline file `%s' has unsupported version %d",
+		path_str.c_str(), (int)version);
+    }
+
+    auto timeline = new mc_Timeline();
+    timeline->autorelease();
+    timeline->file = path_str;
+    reader.timeline(timeline);
+    return rb_cocos2d_object_new(timeline, rb_cTimeline);
+}
+
+/// @endgroup
+
+/// @property-readonly #duration
+/// @return [Float] the duration of the timeline, in seconds.
+
+static VALUE
+timeline_duration(VALUE rcv, SEL sel)
+{
+    return DBL2NUM(TIMELINE(rcv)->duration);
+}
+
+/// @method #play(node, loops=1)
+/// Plays the timeline on the given node tree.
+///   timeline = MG::Timeline.load('intro.tl')
+///   timeline.play(scene) do |event|
+///     case event
+///       when 'shake' then shake_screen
+///       when 'done' then show_menu
+///     end
+///   end
+/// @param node [Node] the root node of the tree, whose descendants are
+///   found by name when the timeline starts.
+/// @param loops [Integer] the number of times the timeline should be
+///   played. If {Repeat::FOREVER} (or negative value directly) was given, it
+///   is played forever.
+/// @yield [String] the name of an event marker, when it is reached.
+/// @return [Action] the action playing the timeline, which runs on +node+.
+
+static VALUE
+timeline_play(VALUE rcv, SEL sel, int argc, VALUE *argv)
+{
+    VALUE node = Qnil, loops = Qnil;
+    rb_scan_args(argc, argv, "11", &node, &loops);
+
+    auto timeline = TIMELINE(rcv);
+    auto root = NODE(node);
+    std::vector<cocos2d::Node *> nodes;
+    for (auto &track : timeline->tracks) {
+	nodes.push_back(timeline_bind(timeline, root, track.path));
+    }
+
+    VALUE block = rb_current_block();
+    cocos2d::ActionInterval *action = mc_TimelineAction::create(timeline,
+	    nodes, block != Qnil ? mc_Block(block) : mc_Block());
+    const long loops_i = loops != Qnil ? NUM2LONG(loops) : 1;
+    if (loops_i < 0) {
+	action = cocos2d::RepeatForever::create(action);
+    }
+    else if (loops_i != 1) {
+	action = cocos2d::Repeat::create(action, loops_i);
+    }
+    root->runAction(action);
+    return rb_cocos2d_object_new(action, rb_cAction);
+}
+
+extern "C"
+void
+Init_Timeline(void)
+{
+    rb_cTimeline = rb_define_class_under(rb_mMC, "Timeline", rb_cObject);
+    rb_register_cocos2d_object_finalizer(rb_cTimeline);
+
+    rb_define_singleton_method(rb_cTimeline, "load", timeline_load, 1);
+    rb_define_method(rb_cTimeline, "duration", timeline_duration, 0);
+    rb_define_method(rb_cTimeline, "play", timeline_play, -1);
+}
@@ -0,0 +1,490 @@
+#include "rubymotion.h"
+#include "motion-game.h"
+#include <cmath>
+
+/// @class Tween < Action
+/// A tween animates properties of a node from their current values to new
+/// ones, following an easing curve. Every property is updated natively at
+/// each frame, so running many tweens does not execute any Ruby code until
+/// they complete.
+///
+///   MG::Tween.new(button, to: { position: [100, 200], alpha: 0.5 },
+///     duration: 0.4, ease: :out_back) { puts 'done' }
+///
+/// The animated properties are +position+ (an Array or a {Point}), +x+,
+/// +y+, +alpha+, +rotation+, +scale+ (a Float or an Array of 2 Floats),
+/// +scale_x+, +scale_y+, +skew_x+, +skew_y+ and +color+ (a {Color}, an Array
+/// or a Symbol).
+///
+/// The easing curve is either +:linear+ or one of the +sine+, +quad+,
+/// +cubic+, +quart+, +quint+, +expo+, +circ+, +back+, +elastic+ and +bounce+
+/// families prefixed by +in_+, +out_+ or +in_out_+, for instance
+/// +:in_out_quad+ or +:out_bounce+.
+
+static VALUE rb_cTween = Qnil;
+
+// Easing curves, described by a family and a mode. The curves of every
+// family are defined for the in mode, out and in-out are derived from it.
+
+enum {
+    EASE_IN = 1,
+    EASE_OUT = 2,
+    EASE_IN_OUT = 3
+};
+
+static float
+ease_bounce_out(float t)
+{
+    if (t < 1 / 2.75f) {
+	return 7.5625f * t * t;
+    }
+    if (t < 2 / 2.75f) {
+	t -= 1.5f / 2.75f;
+	return 7.5625f * t * t + 0.75f;
+    }
+    if (t < 2.5f / 2.75f) {
+	t -= 2.25f / 2.75f;
+	return 7.5625f * t * t + 0.9375f;
+    }
+    t -= 2.625f / 2.75f;
+    return 7.5625f * t * t + 0.984375f;
+}
+
+static float
+ease_in(int family, float t)
+{
+    switch (family) {
+      case 1:	// sine
+	return 1 - cosf(t * (float)M_PI_2);
+      case 2:	// quad
+	return t * t;
+      case 3:	// cubic
+	return t * t * t;
+      case 4:	// quart
+	return t * t * t * t;
+      case 5:	// quint
+	return t * t * t * t * t;
+      case 6:	// expo
+	return t == 0 ? 0 : powf(2, 10 * (t - 1));
+      case 7:	// circ
+	return 1 - sqrtf(1 - t * t);
+      case 8:	// back
+	return t * t * (2.70158f * t - 1.70158f);
+      case 9:	// elastic
+	if (t == 0 || t == 1) {
+	    return t;
+	}
+	return -powf(2, 10 * (t - 1))
+	    * sinf((t - 1.075f) * 2 * (float)M_PI / 0.3f);
+      case 10:	// bounce
+	return 1 - ease_bounce_out(1 - t);
+    }
+    return t;
+}
+
+static const char *ease_families[] = {
+    "linear", "sine", "quad", "cubic", "quart", "quint", "expo", "circ",
+    "back", "elastic", "bounce", NULL
+};
+
+// Returns the easing curve named by the given symbol, as an integer which
+// can be passed to rb_ease_apply().
+extern "C"
+int
+rb_sym_to_ease(VALUE sym)
+{
+    if (sym == Qnil) {
+	return 0;
+    }
+    if (!rb_obj_is_kind_of(sym, rb_cSymbol)) {
+	rb_raise(rb_eArgError, "expected Symbol easing curve");
+    }
+    const char *name = rb_sym2name(sym);
+    int mode = 0;
+    if (strncmp(name, "in_out_", 7) == 0) {
+	mode = EASE_IN_OUT;
+	name += 7;
+    }
+    else if (strncmp(name, "in_", 3) == 0) {
+	mode = EASE_IN;
+	name += 3;
+    }
+    else if (strncmp(name, "out_", 4) == 0) {
+	mode = EASE_OUT;
+	name += 4;
+    }
+    for (int family = 0; ease_families[family] != NULL; family++) {
+	if (strcmp(name, ease_families[family]) == 0
+		&& (family == 0) == (mode == 0)) {
+	    return family * 4 + mode;
+	}
+    }
+    rb_raise(rb_eArgError, "invalid easing curve `%s'", rb_sym2name(sym));
+}
+
+extern "C"
+float
+rb_ease_apply(int ease, float t)
+{
+    const int family = ease / 4;
+    switch (ease % 4) {
+      case EASE_IN:
+	return ease_in(family, t);
+      case EASE_OUT:
+	return 1 - ease_in(family, 1 - t);
+      case EASE_IN_OUT:
+	return t < 0.5f ? ease_in(family, t * 2) / 2
+	    : 1 - ease_in(family, 2 - t * 2) / 2;
+    }
+    return t;
+}
+
+extern "C"
+float
+rb_ccnode_property_get(cocos2d::Node *node, int property)
+{
+    switch (property) {
+      case MC_PROPERTY_X:
+	return node->getPositionX();
+      case MC_PROPERTY_Y:
+	return node->getPositionY();
+      case MC_PROPERTY_ALPHA:
+	return node->getOpacity() / 255.0f;
+      case MC_PROPERTY_ROTATION:
+	return node->getRotation();
+      case MC_PROPERTY_SCALE_X:
+	return node->getScaleX();
+      case MC_PROPERTY_SCALE_Y:
+	return node->getScaleY();
+      case MC_PROPERTY_SKEW_X:
+	return node->getSkewX();
+      case MC_PROPERTY_SKEW_Y:
+	return node->getSkewY();
+      case MC_PROPERTY_RED:
+	return node->getColor().r;
+      case MC_PROPERTY_GREEN:
+	return node->getColor().g;
+      case MC_PROPERTY_BLUE:
+	return node->getColor().b;
+    }
+    return 0;
+}
+
+extern "C"
+void
+rb_ccnode_property_set(cocos2d::Node *node, int property, float value)
+{
+    switch (property) {
+      case MC_PROPERTY_X:
+	node->setPositionX(value);
+	break;
+      case MC_PROPERTY_Y:
+	node->setPositionY(value);
+	break;
+      case MC_PROPERTY_ALPHA:
+	node->setOpacity(std::min(std::max(value, 0.0f), 1.0f) * 255);
+	break;
+      case MC_PROPERTY_ROTATION:
+	node->setRotation(value);
+	break;
+      case MC_PROPERTY_SCALE_X:
+	node->setScaleX(value);
+	break;
+      case MC_PROPERTY_SCALE_Y:
+	node->setScaleY(value);
+	break;
+      case MC_PROPERTY_SKEW_X:
+	node->setSkewX(value);
+	break;
+      case MC_PROPERTY_SKEW_Y:
+	node->setSkewY(value);
+	break;
+      case MC_PROPERTY_RED:
+      case MC_PROPERTY_GREEN:
+      case MC_PROPERTY_BLUE:
+	{
+	    cocos2d::Color3B color = node->getColor();
+	    const GLubyte component = std::min(std::max(value, 0.0f), 255.0f);
+	    if (property == MC_PROPERTY_RED) {
+		color.r = component;
+	    }
+	    else if (property == MC_PROPERTY_GREEN) {
+		color.g = component;
+	    }
+	    else {
+		color.b = component;
+	    }
+	    node->setColor(color);
+	}
+	break;
+    }
+}
+
+class mc_Tween : public cocos2d::ActionInterval {
+    public:
+	struct Track {
+	    int property;
+	    float from, to;
+	    bool has_from, has_to;
+	};
+
+	std::vector<Track> tracks;
+	int ease;
+	bool yoyo;
+	bool started;
+
+    static mc_Tween *create(float duration, int ease, bool yoyo) {
+	auto tween = new mc_Tween();
+	tween->initWithDuration(duration);
+	tween->ease = ease;
+	tween->yoyo = yoyo;
+	tween->started = false;
+	tween->autorelease();
+	return tween;
+    }
+
+    void set_track(int property, float value, bool from) {
+	for (auto &track : tracks) {
+	    if (track.property == property) {
+		(from ? track.from : track.to) = value;
+		(from ? track.has_from : track.has_to) = true;
+		return;
+	    }
+	}
+	Track track;
+	track.property = property;
+	track.from = track.to = value;
+	track.has_from = from;
+	track.has_to = !from;
+	tracks.push_back(track);
+    }
+
+    virtual void startWithTarget(cocos2d::Node *target) override {
+	cocos2d::ActionInterval::startWithTarget(target);
+	// Repeats start again from the initial values.
+	if (!started) {
+	    for (auto &track : tracks) {
+		if (!track.has_from) {
+		    track.from = rb_ccnode_property_get(target, track.property);
+		}
+		if (!track.has_to) {
+		    track.to = rb_ccnode_property_get(target, track.property);
+		}
+	    }
+	    started = true;
+	}
+    }
+
+    virtual void update(float t) override {
+	if (_target == NULL) {
+	    return;
+	}
+	if (yoyo) {
+	    t = t < 0.5f ? t * 2 : 2 - t * 2;
+	}
+	const float e = rb_ease_apply(ease, t);
+	// The color components are set at once.
+	bool color_changed = false;
+	float color[3] = { 0, 0, 0 };
+	for (auto &track : tracks) {
+	    const float value = track.from + (track.to - track.from) * e;
+	    switch (track.property) {
+	      case MC_PROPERTY_RED:
+	      case MC_PROPERTY_GREEN:
+	      case MC_PROPERTY_BLUE:
+		if (!color_changed) {
+		    const cocos2d::Color3B current = _target->getColor();
+		    color[0] = current.r;
+		    color[1] = current.g;
+		    color[2] = current.b;
+		    color_changed = true;
+		}
+		color[track.property - MC_PROPERTY_RED] =
+		    std::min(std::max(value, 0.0f), 255.0f);
+		break;
+
+	      default:
+		rb_ccnode_property_set(_target, track.property, value);
+	    }
+	}
+	if (color_changed) {
+	    _target->setColor(cocos2d::Color3B(color[0], color[1], color[2]));
+	}
+    }
+
+    virtual mc_Tween *clone() const override {
+	auto tween = create(_duration, ease, yoyo);
+	tween->tracks = tracks;
+	return tween;
+    }
+
+    virtual mc_Tween *reverse() const override {
+	auto tween = clone();
+	for (auto &track : tween->tracks) {
+	    std::swap(track.from, track.to);
+	    std::swap(track.has_from, track.has_to);
+	}
+	return tween;
+    }
+};
+
+static void
+tween_add_properties(mc_Tween *tween, VALUE properties, bool from)
+{
+    VALUE pairs = rb_options_to_ary(properties);
+    for (int i = 0, count = RARRAY_LEN(pairs); i < count; i++) {
+	VALUE pair = RARRAY_AT(pairs, i);
+	const char *name = rb_sym2name(RARRAY_AT(pair, 0));
+	VALUE val = RARRAY_AT(pair, 1);
+	if (strcmp(name, "position") == 0) {
+	    const cocos2d::Vec2 pos = rb_any_to_ccvec2(val);
+	    tween->set_track(MC_PROPERTY_X, pos.x, from);
+	    tween->set_track(MC_PROPERTY_Y, pos.y, from);
+	}
+	else if (strcmp(name, "x") == 0) {
+	    tween->set_track(MC_PROPERTY_X, NUM2DBL(val), from);
+	}
+	else if (strcmp(name, "y") == 0) {
+	    tween->set_track(MC_PROPERTY_Y, NUM2DBL(val), from);
+	}
+	else if (strcmp(name, "alpha") == 0) {
+	    tween->set_track(MC_PROPERTY_ALPHA, NUM2DBL(val), from);
+	}
+	else if (strcmp(name, "rotation") == 0) {
+	    tween->set_track(MC_PROPERTY_ROTATION, NUM2DBL(val), from);
+	}
+	else if (strcmp(name, "scale") == 0) {
+	    if (rb_obj_is_kind_of(val, rb_cArray)) {
+		const cocos2d::Vec2 scale = rb_any_to_ccvec2(val);
+		tween->set_track(MC_PROPERTY_SCALE_X, scale.x, from);
+		tween->set_track(MC_PROPERTY_SCALE_Y, scale.y, from);
+	    }
+	    else {
+		tween->set_track(MC_PROPERTY_SCALE_X, NUM2DBL(val), from);
+		tween->set_track(MC_PROPERTY_SCALE_Y, NUM2DBL(val), from);
+	    }
+	}
+	else if (strcmp(name, "scale_x") == 0) {
+	    tween->set_track(MC_PROPERTY_SCALE_X, NUM2DBL(val), from);
+	}
+	else if (strcmp(name, "scale_y") == 0) {
+	    tween->set_track(MC_PROPERTY_SCALE_Y, NUM2DBL(val), from);
+	}
+	else if (strcmp(name, "skew_x") == 0) {
+	    tween->set_track(MC_PROPERTY_SKEW_X, NUM2DBL(val), from);
+	}
+	else if (strcmp(name, "skew_y") == 0) {
+	    tween->set_track(MC_PROPERTY_SKEW_Y, NUM2DBL(val), from);
+	}
+	else if (strcmp(name, "color") == 0) {
+	    const cocos2d::Color3B color = rb_any_to_cccolor3(val);
+	    tween->set_track(MC_PROPERTY_RED, color.r, from);
+	    tween->set_track(MC_PROPERTY_GREEN, color.g, from);
+	    tween->set_track(MC_PROPERTY_BLUE, color.b, from);
+	}
+	else {
+	    rb_raise(rb_eArgError, "can't tween property `%s'", name);
+	}
+    }
+}
+
+// Creates the action of a tween from its options, without the completion
+// block.
+static cocos2d::FiniteTimeAction *
+tween_create(VALUE options)
+{
+    VALUE pairs = rb_options_to_ary(options);
+    VALUE duration = rb_options_get(pairs, "duration");
+    if (duration == Qnil) {
+	rb_raise(rb_eArgError, "missing duration");
+    }
+    VALUE repeat = rb_options_get(pairs, "repeat");
+    VALUE delay = rb_options_get(pairs, "delay");
+    const bool yoyo = RTEST(rb_options_get(pairs, "yoyo"));
+
+    // A yoyo cycle goes to the end values and back.
+    auto tween = mc_Tween::create(NUM2DBL(duration) * (yoyo ? 2 : 1),
+	    rb_sym_to_ease(rb_options_get(pairs, "ease")), yoyo);
+    tween_add_properties(tween, rb_options_get(pairs, "from"), true);
+    tween_add_properties(tween, rb_options_get(pairs, "to"), false);
+    if (tween->tracks.empty()) {
+	rb_raise(rb_eArgError, "nothing to tween, expected to: or from:");
+    }
+
+    cocos2d::ActionInterval *action = tween;
+    if (repeat != Qnil) {
+	const long times = NUM2LONG(repeat);
+	if (times < 0) {
+	    action = cocos2d::RepeatForever::create(action);
+	}
+	else if (times > 0) {
+	    action = cocos2d::Repeat::create(action, times + 1);
+	}
+    }
+    if (delay != Qnil && NUM2DBL(delay) > 0) {
+	action = cocos2d::Sequence::create(
+		rb_ccdelay_time_create(NUM2DBL(delay)), action,
+		(void *)0);
+    }
+    return action;
+}
+
+/// @group Constructors
+
+/// @method #initialize(node, options)
+/// Creates a tween and starts it on the given node.
+/// @param node [Node] the node to animate.
+/// @param options [Hash] the options of the tween.
+/// @option options [Hash] :to the values the properties should reach.
+/// @option options [Hash] :from the values the properties should start
+///   from, instead of their current values.
+/// @option options [Float] :duration the duration of the tween, in seconds.
+/// @option options [Symbol] :ease the easing curve, +:linear+ by default.
+/// @option options [Float] :delay a delay before the tween starts, in
+///   seconds.
+/// @option options [Boolean] :yoyo whether the properties go back to their
+///   initial values after reaching the end values, doubling the duration.
+/// @option options [Integer] :repeat the number of times the tween is
+///   repeated after its first run, or {Repeat::FOREVER}.
+/// @yield once the tween and its repeats are over, unless it repeats
+///   forever.
+/// @return [Tween] the tween.
+
+static VALUE
+tween_new(VALUE rcv, SEL sel, VALUE node, VALUE options)
+{
+    auto action = tween_create(options);
+    VALUE block = rb_current_block();
+    if (block != Qnil) {
+	action = cocos2d::Sequence::create(action,
+		rb_ccaction_completion(block, Qnil), (void *)0);
+    }
+    NODE(node)->runAction(action);
+    return rb_cocos2d_object_new(action, rcv);
+}
+
+/// @endgroup
+
+/// @method #stop
+/// Stops the tween, leaving the properties at their current values.
+/// @return [self] the receiver.
+
+static VALUE
+tween_stop(VALUE rcv, SEL sel)
+{
+    auto action = ACTION(rcv);
+    if (action->getTarget() != NULL) {
+	action->getTarget()->stopAction(action);
+    }
+    return rcv;
+}
+
+extern "C"
+void
+Init_Tween(void)
+{
+    rb_cTween = rb_define_class_under(rb_mMC, "Tween", rb_cAction);
+
+    rb_define_constructor(rb_cTween, tween_new, 2);
+    rb_define_method(rb_cTween, "stop", tween_stop, 0);
+}
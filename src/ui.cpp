@@ -708,6 +708,7 @@ static VALUE
 button_load_texture_normal(VALUE rcv, SEL sel, VALUE val)
 {
   BUTTON(rcv)->loadTextureNormal(RSTRING_PTR(StringValue(val)));
+  rb_texture_cache_used(NULL);
   return rcv;
 }
 
@@ -720,6 +721,7 @@ static VALUE
 button_load_texture_pressed(VALUE rcv, SEL sel, VALUE val)
 {
   BUTTON(rcv)->loadTexturePressed(RSTRING_PTR(StringValue(val)));
+  rb_texture_cache_used(NULL);
   return rcv;
 }
 
@@ -732,6 +734,7 @@ static VALUE
 button_load_texture_disabled(VALUE rcv, SEL sel, VALUE val)
 {
   BUTTON(rcv)->loadTextureDisabled(RSTRING_PTR(StringValue(val)));
+  rb_texture_cache_used(NULL);
   return rcv;
 }
 
@@ -1096,6 +1099,7 @@ static VALUE
 loadingbar_load_texture(VALUE rcv, SEL sel, VALUE name)
 {
     LOADING_BAR(rcv)->loadTexture(RSTRING_PTR(StringValue(name)));
+    rb_texture_cache_used(NULL);
     return rcv;
 }
 
@@ -1213,6 +1217,7 @@ layout_add(VALUE rcv, SEL sel, VALUE widget)
 {
     rb_add_relationship(rcv, widget);
     LAYOUT(rcv)->addChild(NODE(widget));
+    rb_ccnode_added(NODE(widget));
     return widget;
 }
 